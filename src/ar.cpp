@@ -4,27 +4,79 @@
   CS 5330
 */
 
+#include <functional>
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include "util.hpp"
 #include "csv_util.h"
+#include "benchmark.hpp"
+#include "board_tracker.hpp"
+#include "calibration_store.hpp"
+#include "frame_source.hpp"
+#include "frame_writer.hpp"
+#include "lod.hpp"
+#include "pipeline.hpp"
+#include "pose_estimator.hpp"
+#include "pose_log.hpp"
+#include "profiler.hpp"
+#include "rasterizer.hpp"
+#include "scene.hpp"
+#include "undistorter.hpp"
 
-int main(int argc, char *argv[])
+// a frame travelling through the ar loop, with the results of the detection stage
+struct ArFrame
+{
+  ArFrame() : index(0), captureTime(0), found(false) {}
+
+  cv::Mat frame;
+  long index;          // the index of the frame in the order it was captured
+  int64_t captureTime; // when the frame was captured, on the clock of the pose log
+  bool found;
+  cv::Vec3d rvec, tvec;
+};
+
+// read the calibration of a camera from the store, or the last calibration saved to the csv file if it has none
+// cameraId: the camera
+// imageSize: the resolution of the frames, or an empty size for any resolution
+// cameraMatrix: the camera matrix
+// distCoeffs: the distortion coefficients
+// return: 0 if successful, -1 if error
+static int load_calibration(std::string cameraId, cv::Size imageSize, cv::Mat &cameraMatrix, cv::Mat &distCoeffs)
 {
-  // read the calibration result from a csv file
+  CalibrationRecord record;
+  if (load_calibration_record("../resources/calibration.bin", cameraId, imageSize, record) == 0)
+  {
+    cameraMatrix = record.cameraMatrix;
+    distCoeffs = record.distCoeffs;
+    return (0);
+  }
+
+  // read the calibration result from a csv file, the last one saved in it
   std::vector<std::string> labels;
   std::vector<std::vector<double>> features;
   read_object_data_csv("../resources/data.csv", labels, features);
+  for (int i = (int)features.size() - 1; i >= 0; i--)
+  {
+    if (labels[i] == "calibration" && features[i].size() >= 9 + 14)
+    {
+      printf("no calibration of camera %s at %dx%d in ../resources/calibration.bin, using ../resources/data.csv\n",
+             cameraId.c_str(), imageSize.width, imageSize.height);
+      return (vector_to_mat(features[i], cameraMatrix, distCoeffs));
+    }
+  }
 
-  // convert the calibration result to matrices
-  cv::Mat cameraMatrix;
-  cv::Mat distCoeffs;
-  vector_to_mat(features[0], cameraMatrix, distCoeffs);
+  printf("error: no calibration of camera %s, run calibrate first.\n", cameraId.c_str());
+  return (-1);
+}
 
-  // read the object data from a obj file
-  std::vector<cv::Point3f> vertices;
-  std::vector<std::vector<int>> faces;
-  read_object_data("../resources/teapot.obj", vertices, faces);
+int main(int argc, char *argv[])
+{
+  // read the object data from a obj file, simplified for when it is far away, down to 8 grid cells across
+  // the levels are mapped from the mesh cache with the object, and only built when the cache is written
+  std::string objectFile = "../resources/teapot.obj";
+  LodChain lods;
+  read_lod_chain(objectFile, 64, 8, lods);
+  Mesh mesh = lods.levels.empty() ? Mesh() : lods.levels[0];
 
   // the number of corners in the chessboard
   int cornersPerRow = 9;
@@ -40,108 +92,398 @@ int main(int argc, char *argv[])
     }
   }
 
-  // whether to use the camera or process a static image
-  bool useCamera;
-  cv::Mat image;
-  cv::VideoCapture *vidCap;
-
-  // read image path from command line
-  if (argc > 1)
+  // read the frame options from the command line, a plain argument is the path of a static image
+  FrameOptions options;
+  std::vector<std::string> args;
+  if (parse_frame_options(argc, argv, options, args) != 0)
   {
-    useCamera = false;
+    return (-1);
+  }
 
-    // read the image
-    image = cv::imread(argv[1]);
+  // read the ar options
+  //   --pipeline            run capture, detection and rendering on separate threads
+  //   --queue-depth <n>     the number of frames queued between two pipeline stages
+  //   --drop-policy <p>     "oldest" drops the oldest queued frame when a stage falls behind, "block" waits
+  //   --track <n>           track the corners with optical flow, running a full detection at least every n frames
+  //   --full-search         always search the whole frame for the chessboard, without a region of interest or pyramid
+  //   --solver <s>          the pose solver, "iterative", "guess" (warm-started from the predicted pose) or "ippe"
+  //   --predict <n>         render the pose predicted n frames ahead, to compensate for the rendering latency
+  //   --lod <px>            draw the coarsest level of detail with grid cells of at most px pixels, 0 for the full mesh
+  //   --render <mode>       draw the object as "wire" edges, or as "flat" or "gouraud" shaded solid triangles
+  //   --undistort           remove the lens distortion from every frame first, and work on it as a pinhole camera
+  //   --scene <file>        draw the instances of the meshes listed in a scene file instead of the object
+  //   --camera-id <id>      use the calibration stored for this camera at the resolution of the frames
+  //   --pose-log <file>     write the pose of every frame to a binary log, see poselog2csv
+  //   --record <file>       record the rendered frames to a video file
+  //   --bench <name>        run a benchmark on the frames instead of the ar loop
+  bool usePipeline = false;
+  int trackInterval = 0;
+  bool fullSearch = false;
+  PoseSolver solver = POSE_ITERATIVE_GUESS;
+  double predictFrames = 0;
+  RenderMode renderMode = RENDER_WIREFRAME;
+  float lodPixels = 3;
+  bool undistort = false;
+  std::string sceneFile;
+  std::string cameraId = "default";
+  std::string poseLogFile;
+  std::string recordFile;
+  std::string benchmark;
+  bool dropPolicySet = false;
+  PipelineOptions pipelineOptions;
+  for (size_t i = 0; i < args.size(); i++)
+  {
+    if (args[i] == "--pipeline")
+    {
+      usePipeline = true;
+    }
+    else if (args[i] == "--queue-depth" && i + 1 < args.size())
+    {
+      pipelineOptions.queueDepth = (size_t)atoi(args[++i].c_str());
+    }
+    else if (args[i] == "--drop-policy" && i + 1 < args.size())
+    {
+      if (parse_drop_policy(args[++i], pipelineOptions.policy) != 0)
+      {
+        printf("error: unknown drop policy %s.\n", args[i].c_str());
+        return (-1);
+      }
+      dropPolicySet = true;
+    }
+    else if (args[i] == "--track" && i + 1 < args.size())
+    {
+      trackInterval = atoi(args[++i].c_str());
+    }
+    else if (args[i] == "--full-search")
+    {
+      fullSearch = true;
+    }
+    else if (args[i] == "--solver" && i + 1 < args.size())
+    {
+      if (parse_pose_solver(args[++i], solver) != 0)
+      {
+        printf("error: unknown pose solver %s.\n", args[i].c_str());
+        return (-1);
+      }
+    }
+    else if (args[i] == "--predict" && i + 1 < args.size())
+    {
+      predictFrames = atof(args[++i].c_str());
+    }
+    else if (args[i] == "--lod" && i + 1 < args.size())
+    {
+      lodPixels = (float)atof(args[++i].c_str());
+    }
+    else if (args[i] == "--render" && i + 1 < args.size())
+    {
+      if (parse_render_mode(args[++i], renderMode) != 0)
+      {
+        printf("error: unknown render mode %s.\n", args[i].c_str());
+        return (-1);
+      }
+    }
+    else if (args[i] == "--undistort")
+    {
+      undistort = true;
+    }
+    else if (args[i] == "--scene" && i + 1 < args.size())
+    {
+      sceneFile = args[++i];
+    }
+    else if (args[i] == "--camera-id" && i + 1 < args.size())
+    {
+      cameraId = args[++i];
+    }
+    else if (args[i] == "--pose-log" && i + 1 < args.size())
+    {
+      poseLogFile = args[++i];
+    }
+    else if (args[i] == "--record" && i + 1 < args.size())
+    {
+      recordFile = args[++i];
+    }
+    else if (args[i] == "--bench" && i + 1 < args.size())
+    {
+      benchmark = args[++i];
+    }
+    else if (args[i].compare(0, 2, "--") == 0)
+    {
+      printf("error: unknown option %s.\n", args[i].c_str());
+      return (-1);
+    }
+    else
+    {
+      options.source = args[i];
+    }
   }
-  else
+
+  // read the scene, whose meshes are drawn at the places of their instances
+  Scene scene;
+  if (!sceneFile.empty() && read_scene(sceneFile, scene) != 0)
   {
-    useCamera = true;
+    return (-1);
+  }
 
-    // open the video device
-    vidCap = new cv::VideoCapture(0);
+  // open the frame source, unless a benchmark runs without frames
+  FrameSource *source = NULL;
+  if (benchmark.empty() || benchmark_needs_frames(benchmark))
+  {
+    source = open_frame_source(options.source);
 
     // error checking
-    if (!vidCap->isOpened())
+    if (source == NULL)
     {
-      std::cerr << "error: unable to open video device" << std::endl;
       return (-2);
     }
   }
 
-  cv::Mat frame;
-  while (true)
+  // read the calibration of the camera, at the resolution of the frames if there are any
+  cv::Mat cameraMatrix;
+  cv::Mat distCoeffs;
+  if (load_calibration(cameraId, source == NULL ? cv::Size() : source->size(), cameraMatrix, distCoeffs) != 0)
   {
-    // if using the camera
-    if (useCamera)
-    {
-      // read a frame from the video stream
-      *vidCap >> frame;
-    }
-    else // if using a static image
+    delete source;
+    return (-1);
+  }
+
+  cv::Size pattern_size = cv::Size(cornersPerRow, cornersPerCol);
+
+  // run a benchmark instead of the ar loop
+  if (!benchmark.empty())
+  {
+    BenchmarkContext context;
+    context.source = source;
+    context.mesh = &mesh;
+    context.lods = &lods;
+    context.objectFile = objectFile;
+    context.maxFrames = options.maxFrames;
+    context.cameraMatrix = cameraMatrix;
+    context.distCoeffs = distCoeffs;
+    context.patternSize = pattern_size;
+    context.pointSet = pointSet;
+    int result = run_benchmark(benchmark, context);
+    delete source;
+    return (result);
+  }
+
+  // a camera keeps producing frames, so drop the oldest ones instead of falling behind it,
+  // while a recorded source waits so that every frame is processed
+  if (!dropPolicySet)
+  {
+    pipelineOptions.policy = source->live() ? DROP_OLDEST : DROP_BLOCK;
+  }
+
+  // show the frames in a window, or process them as fast as possible when headless
+  FrameSink sink(options);
+
+  // snapshots and the recorded video are encoded on a background thread
+  // the video plays at the usual camera rate, whatever rate the frames were rendered at
+  const double RECORD_FPS = 30;
+  FrameWriter writer;
+  if (!recordFile.empty())
+  {
+    writer.startRecording(recordFile, RECORD_FPS);
+  }
+
+  // the chessboard finder, which tracks the corners between full detections if enabled
+  BoardTracker tracker(pattern_size, trackInterval);
+  tracker.setAcceleratedSearch(!fullSearch);
+
+  // the undistortion maps, after which the frames are seen by a pinhole camera with the same camera matrix
+  Undistorter undistorter(cameraMatrix, distCoeffs);
+  if (undistort)
+  {
+    distCoeffs = undistorter.distCoeffs();
+  }
+
+  // the pose estimator, which keeps the previous poses to warm-start and predict from
+  PoseEstimator estimator(cameraMatrix, distCoeffs, solver);
+
+  // the poses are written on a background thread, the frame loop only queues them
+  PoseLog poseLog;
+  if (!poseLogFile.empty() && poseLog.open(poseLogFile) != 0)
+  {
+    delete source;
+    return (-1);
+  }
+
+  // the capture stage reads a frame from the frame source, and undistorts it if enabled
+  long captured = 0;
+  std::function<bool(ArFrame &)> capture = [&](ArFrame &item)
+  {
+    item.index = captured++;
+    item.captureTime = poseLog.clock();
+    cv::Mat raw;
     {
-      // copy the image to the frame
-      frame = image.clone();
+      ScopedTimer timer(PROFILE_CAPTURE);
+      if (!source->read(undistort ? raw : item.frame))
+      {
+        return (false);
+      }
     }
-
-    // error checking
-    if (frame.empty())
+    if (undistort)
     {
-      std::cerr << "error: frame is empty" << std::endl;
-      break;
+      ScopedTimer timer(PROFILE_UNDISTORT);
+      undistorter.apply(raw, item.frame);
     }
+    return (true);
+  };
 
+  // the detection stage finds the chessboard and its pose
+  std::function<void(ArFrame &)> detect = [&](ArFrame &item)
+  {
     // convert the frame to grayscale
     cv::Mat gray;
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    {
+      ScopedTimer timer(PROFILE_GRAY);
+      cv::cvtColor(item.frame, gray, cv::COLOR_BGR2GRAY);
+    }
 
-    // find the chessboard corners
-    cv::Size pattern_size = cv::Size(cornersPerRow, cornersPerCol);
+    // find the refined chessboard corners
     std::vector<cv::Point2f> cornerSet;
-    cv::TermCriteria termCrit(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01);
-    bool found = cv::findChessboardCorners(gray, pattern_size, cornerSet);
+    item.found = tracker.find(gray, cornerSet);
 
     // if the corners are found
-    if (found)
+    if (item.found)
     {
-      // refine the corner locations
-      cv::cornerSubPix(gray, cornerSet, cv::Size(5, 5), cv::Size(-1, -1), termCrit);
-
       // calculate the pose of the chessboard
-      cv::Vec3d rvec, tvec;
-      cv::solvePnP(pointSet, cornerSet, cameraMatrix, distCoeffs, rvec, tvec);
+      item.found = estimator.estimate(pointSet, cornerSet, item.rvec, item.tvec);
 
-      // print the pose of the chessboard
-      std::cout << "rvec: " << rvec << std::endl;
-      std::cout << "tvec: " << tvec << std::endl;
+      // log the measured pose, before any prediction
+      if (item.found && poseLog.isOpen())
+      {
+        PoseRecord record;
+        record.frame = item.index;
+        record.captureTime = item.captureTime;
+        for (int k = 0; k < 3; k++)
+        {
+          record.rvec[k] = item.rvec[k];
+          record.tvec[k] = item.tvec[k];
+        }
+        record.corners = (int32_t)cornerSet.size();
+        record.error = (float)estimator.error();
+        poseLog.write(record);
+      }
+    }
+    else
+    {
+      // the motion of a lost chessboard is unknown
+      estimator.reset();
+    }
+
+    if (item.found)
+    {
+      // render where the chessboard will be once the frame is displayed
+      if (predictFrames > 0)
+      {
+        estimator.predict(predictFrames, item.rvec, item.tvec);
+      }
+    }
+  };
+
+  // the projection kernel for the calibration, and the buffers of the rendering stage reused from frame to frame
+  Projector projector(cameraMatrix, distCoeffs);
+  RenderBuffers buffers;
+  SceneBuffers sceneBuffers;
+  Rasterizer rasterizer;
+
+  // the rendering stage draws the object and displays the frame
+  // return: false to quit the program
+  std::function<bool(ArFrame &)> render = [&](ArFrame &item)
+  {
+    cv::Mat &frame = item.frame;
+
+    // if the corners are found
+    if (item.found)
+    {
+      ScopedTimer timer(PROFILE_DRAW);
 
       // draw the four outside corners of the chessboard as circles
       // and the 3D axes at the origin of the chessboard
-      draw_corners(cameraMatrix, distCoeffs, rvec, tvec, frame);
+      draw_corners(projector, item.rvec, item.tvec, frame);
 
-      // draw the object on the frame
-      draw_object(cameraMatrix, distCoeffs, rvec, tvec, vertices, faces, frame);
+      // draw the scene on the frame, all of its instances projected in one batch
+      if (!sceneFile.empty())
+      {
+        draw_scene(projector, item.rvec, item.tvec, scene, renderMode, rasterizer, buffers, sceneBuffers, frame);
+      }
+      else
+      {
+        // draw the object on the frame, no more detailed than its size on the frame can show
+        const Mesh &level = lods.levels[select_lod(lods, projector.intrinsics()[0], item.rvec, item.tvec, lodPixels)];
+        if (renderMode == RENDER_WIREFRAME)
+        {
+          draw_object(projector, item.rvec, item.tvec, level, buffers, frame);
+        }
+        else
+        {
+          rasterizer.render(projector, item.rvec, item.tvec, level, renderMode, buffers, frame);
+        }
+      }
     }
 
-    // display the frame
-    cv::imshow("AR", frame);
+    // record the rendered frame, dropped if the encoder falls behind
+    if (writer.recording())
+    {
+      writer.record(frame);
+    }
 
-    // wait for a keypress
-    int key = cv::waitKey(1);
+    // display the frame and wait for a keypress
+    int key = sink.show("AR", frame);
     // if key is 'q', exit the loop and quit the program
     if (key == 'q')
     {
-      break;
+      return (false);
     }
     // if key is 's', save the frame
     else if (key == 's')
     {
-      std::string filename = get_image_name("../resources/", "ar");
-      cv::imwrite(filename, frame);
+      writer.snapshot(get_image_name("../resources/", "ar"), frame);
+    }
+
+    // stop after the requested number of frames
+    return (options.maxFrames < 0 || sink.frames() < options.maxFrames);
+  };
+
+  if (usePipeline)
+  {
+    // overlap the stages of consecutive frames on separate threads
+    PipelineStats stats = run_pipeline<ArFrame>(capture, detect, render, pipelineOptions);
+    printf("pipeline: captured %ld, processed %ld, displayed %ld, dropped %ld frames\n",
+           stats.captured, stats.processed, stats.consumed, stats.dropped);
+  }
+  else
+  {
+    // run the stages one after another
+    while (options.maxFrames != 0)
+    {
+      ArFrame item;
+      if (!capture(item))
+      {
+        break;
+      }
+      detect(item);
+      if (!render(item))
+      {
+        break;
+      }
     }
   }
 
-  // free the video capture object
-  delete vidCap;
+  // print the frame rate and how the chessboard was found
+  sink.report();
+  tracker.report();
+  writer.close();
+  writer.report();
+  if (poseLog.isOpen())
+  {
+    poseLog.close();
+    printf("pose log: wrote %ld, dropped %ld poses to %s\n", poseLog.written(), poseLog.dropped(),
+           poseLogFile.c_str());
+  }
+
+  // free the frame source
+  delete source;
 
   return (0);
 }
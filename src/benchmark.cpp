@@ -0,0 +1,1123 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "benchmark.hpp"
+#include "board_tracker.hpp"
+#include "calibration.hpp"
+#include "csv_util.h"
+#include "obj_parser.hpp"
+#include "pose_estimator.hpp"
+#include "projection.hpp"
+#include "rasterizer.hpp"
+#include "scene.hpp"
+#include "undistorter.hpp"
+#include "util.hpp"
+
+// the number of times each timed loop is repeated, to smooth out the timings
+static const int REPETITIONS = 5;
+
+// the number and the total size of the allocations made with the global operator new, on any thread
+static std::atomic<long> allocationCount(0);
+static std::atomic<long> allocationBytes(0);
+
+// the global operator new of the ar program, which counts every allocation for the alloc benchmark
+// new[] and the nothrow forms go through it, and operator delete frees what it allocated
+void *operator new(std::size_t size)
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add((long)size, std::memory_order_relaxed);
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+
+  return (p);
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+// get the seconds elapsed since a time point
+// start: the time point
+// return: the seconds elapsed
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+// find the chessboard corners in the frames of the benchmark, a frame without a chessboard gets no corners
+// context: the frames and the chessboard
+// cornerSets: the corners of every frame
+// return: the number of frames with a chessboard
+static int collect_corners(BenchmarkContext &context, std::vector<std::vector<cv::Point2f>> &cornerSets)
+{
+  // run a full detection on every frame, so that the corners do not depend on tracking
+  BoardTracker tracker(context.patternSize, 0);
+  int found = 0;
+  cv::Mat frame, gray;
+  while ((context.maxFrames < 0 || (long)cornerSets.size() < context.maxFrames) && context.source->read(frame))
+  {
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    std::vector<cv::Point2f> corners;
+    if (!tracker.find(gray, corners))
+    {
+      corners.clear();
+    }
+    else
+    {
+      found++;
+    }
+    cornerSets.push_back(corners);
+  }
+  printf("%d of %d frames have a chessboard\n", found, (int)cornerSets.size());
+
+  return (found);
+}
+
+int run_benchmark(std::string name, BenchmarkContext &context)
+{
+  if (name == "pose")
+  {
+    return (benchmark_pose(context));
+  }
+  else if (name == "projection")
+  {
+    return (benchmark_projection(context));
+  }
+  else if (name == "raster")
+  {
+    return (benchmark_raster(context));
+  }
+  else if (name == "alloc")
+  {
+    return (benchmark_alloc(context));
+  }
+  else if (name == "obj")
+  {
+    return (benchmark_obj(context));
+  }
+  else if (name == "csv")
+  {
+    return (benchmark_csv(context));
+  }
+  else if (name == "lod")
+  {
+    return (benchmark_lod(context));
+  }
+  else if (name == "bvh")
+  {
+    return (benchmark_bvh(context));
+  }
+  else if (name == "scene")
+  {
+    return (benchmark_scene(context));
+  }
+  else if (name == "undistort")
+  {
+    return (benchmark_undistort(context));
+  }
+  else if (name == "solver")
+  {
+    return (benchmark_solver(context));
+  }
+
+  printf("error: unknown benchmark %s.\n", name.c_str());
+  return (-1);
+}
+
+bool benchmark_needs_frames(std::string name)
+{
+  return (name == "pose" || name == "undistort");
+}
+
+int benchmark_pose(BenchmarkContext &context)
+{
+  std::vector<std::vector<cv::Point2f>> cornerSets;
+  if (collect_corners(context, cornerSets) == 0)
+  {
+    printf("error: no chessboard found.\n");
+    return (-1);
+  }
+
+  // the poses of the reference solver, to compare the others against
+  std::vector<cv::Vec3d> referenceRvecs(cornerSets.size()), referenceTvecs(cornerSets.size());
+
+  PoseSolver solvers[] = {POSE_ITERATIVE, POSE_ITERATIVE_GUESS, POSE_IPPE};
+  printf("%-10s %12s %14s %16s %16s\n", "solver", "us per pose", "rms error px", "rotation diff", "translation diff");
+  for (int s = 0; s < 3; s++)
+  {
+    double seconds = 0;
+    double errorSum = 0;
+    double rotationSum = 0;
+    double translationSum = 0;
+    int poses = 0;
+    for (int r = 0; r < REPETITIONS; r++)
+    {
+      PoseEstimator estimator(context.cameraMatrix, context.distCoeffs, solvers[s]);
+      for (size_t i = 0; i < cornerSets.size(); i++)
+      {
+        // a frame without a chessboard breaks the sequence, like in the ar loop
+        if (cornerSets[i].empty())
+        {
+          estimator.reset();
+          continue;
+        }
+
+        cv::Vec3d rvec, tvec;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool found = estimator.estimate(context.pointSet, cornerSets[i], rvec, tvec);
+        seconds += seconds_since(start);
+        if (!found || r > 0)
+        {
+          continue;
+        }
+
+        // compare the pose with the reference solver in the first repetition
+        if (s == 0)
+        {
+          referenceRvecs[i] = rvec;
+          referenceTvecs[i] = tvec;
+        }
+        cv::Matx33d rotation, reference;
+        cv::Rodrigues(rvec, rotation);
+        cv::Rodrigues(referenceRvecs[i], reference);
+        cv::Vec3d angle;
+        cv::Rodrigues(rotation * reference.t(), angle);
+        rotationSum += cv::norm(angle) * 180 / CV_PI;
+        translationSum += cv::norm(tvec - referenceTvecs[i]);
+        errorSum += estimator.error();
+        poses++;
+      }
+    }
+
+    if (poses == 0)
+    {
+      printf("%-10s found no pose\n", pose_solver_name(solvers[s]).c_str());
+      continue;
+    }
+    printf("%-10s %12.1f %14.4f %12.4f deg %16.5f\n", pose_solver_name(solvers[s]).c_str(),
+           1e6 * seconds / (REPETITIONS * poses), errorSum / poses, rotationSum / poses, translationSum / poses);
+  }
+
+  return (0);
+}
+
+int benchmark_projection(BenchmarkContext &context)
+{
+  const Mesh &mesh = *context.mesh;
+  int count = mesh.vertexCount();
+  if (count == 0)
+  {
+    printf("error: mesh is empty.\n");
+    return (-1);
+  }
+
+  // a few poses around a typical view of the chessboard
+  std::vector<cv::Vec3d> rvecs, tvecs;
+  for (int i = 0; i < 16; i++)
+  {
+    rvecs.push_back(cv::Vec3d(2.6 + 0.02 * i, 0.1 - 0.01 * i, -0.05 + 0.005 * i));
+    tvecs.push_back(cv::Vec3d(-4 + 0.1 * i, 2.5 - 0.05 * i, 18 + 0.3 * i));
+  }
+  int iterations = 200;
+
+  // the vertices packed for cv::projectPoints
+  std::vector<cv::Point3f> objectPoints(count);
+  for (int i = 0; i < count; i++)
+  {
+    objectPoints[i] = cv::Point3f(mesh.x[i], mesh.y[i], mesh.z[i]);
+  }
+  std::vector<cv::Point2f> expected, projected(count);
+
+  // the distortion coefficients reduced to each model
+  cv::Mat full;
+  context.distCoeffs.convertTo(full, CV_64F);
+  full = full.reshape(1, 1).clone();
+  cv::Mat radial = cv::Mat::zeros(1, full.cols, CV_64F);
+  radial.at<double>(0, 0) = full.at<double>(0, 0);
+  radial.at<double>(0, 1) = full.at<double>(0, 1);
+  radial.at<double>(0, 4) = full.at<double>(0, 4);
+  cv::Mat none = cv::Mat::zeros(1, full.cols, CV_64F);
+  cv::Mat coefficients[] = {none, radial, full};
+
+  printf("%d vertices, %d poses, %s kernels\n", count, (int)rvecs.size(), Projector::instructionSet().c_str());
+  printf("%-10s %18s %18s %10s %14s\n", "model", "projectPoints us", "kernel us", "speedup", "max diff px");
+  for (int m = 0; m < 3; m++)
+  {
+    Projector projector(context.cameraMatrix, coefficients[m]);
+
+    // compare the results
+    double maxDiff = 0;
+    for (size_t p = 0; p < rvecs.size(); p++)
+    {
+      cv::projectPoints(objectPoints, rvecs[p], tvecs[p], context.cameraMatrix, coefficients[m], expected);
+      projector.project(rvecs[p], tvecs[p], &mesh.x[0], &mesh.y[0], &mesh.z[0], count, &projected[0]);
+      for (int i = 0; i < count; i++)
+      {
+        maxDiff = std::max(maxDiff, (double)std::max(std::fabs(expected[i].x - projected[i].x),
+                                                     std::fabs(expected[i].y - projected[i].y)));
+      }
+    }
+
+    // time both
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+      size_t p = n % rvecs.size();
+      cv::projectPoints(objectPoints, rvecs[p], tvecs[p], context.cameraMatrix, coefficients[m], expected);
+    }
+    double opencvSeconds = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+      size_t p = n % rvecs.size();
+      projector.project(rvecs[p], tvecs[p], &mesh.x[0], &mesh.y[0], &mesh.z[0], count, &projected[0]);
+    }
+    double kernelSeconds = seconds_since(start);
+
+    printf("%-10s %18.1f %18.1f %9.1fx %14.6f\n", distortion_model_name(projector.model()).c_str(),
+           1e6 * opencvSeconds / iterations, 1e6 * kernelSeconds / iterations, opencvSeconds / kernelSeconds, maxDiff);
+  }
+
+  return (0);
+}
+
+int benchmark_raster(BenchmarkContext &context)
+{
+  const Mesh &mesh = *context.mesh;
+  if (mesh.faceCount() == 0)
+  {
+    printf("error: mesh is empty.\n");
+    return (-1);
+  }
+
+  // a frame the size the camera was calibrated at, with the object close enough to fill a good part of it
+  Projector projector(context.cameraMatrix, context.distCoeffs);
+  cv::Vec4f intrinsics = projector.intrinsics();
+  cv::Size size((int)(2 * intrinsics[2]), (int)(2 * intrinsics[3]));
+  cv::Mat background(size, CV_8UC3, cv::Scalar(40, 40, 40)), frame;
+  cv::Vec3d rvec(2.6, 0.1, -0.05), tvec(-4, 2.5, 12);
+  int iterations = 100;
+
+  RenderBuffers buffers;
+  Rasterizer rasterizer;
+  RenderMode modes[] = {RENDER_WIREFRAME, RENDER_FLAT, RENDER_GOURAUD};
+  printf("%d triangles, %dx%d frame, %d threads\n", mesh.faceCount(), size.width, size.height, cv::getNumThreads());
+  printf("%-10s %12s %12s %18s\n", "mode", "ms per frame", "triangles", "Mtriangles per s");
+  for (int m = 0; m < 3; m++)
+  {
+    double seconds = 0;
+    for (int n = 0; n < iterations; n++)
+    {
+      // the copy stands in for the camera frame and is not timed
+      background.copyTo(frame);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      if (modes[m] == RENDER_WIREFRAME)
+      {
+        draw_object(projector, rvec, tvec, mesh, buffers, frame);
+      }
+      else
+      {
+        rasterizer.render(projector, rvec, tvec, mesh, modes[m], buffers, frame);
+      }
+      seconds += seconds_since(start);
+    }
+
+    // the wireframe counts the triangles submitted, the rasterizer the ones that survived culling
+    int triangles = modes[m] == RENDER_WIREFRAME ? mesh.faceCount() : rasterizer.triangleCount();
+    printf("%-10s %12.3f %12d %18.2f\n", render_mode_name(modes[m]).c_str(), 1000 * seconds / iterations, triangles,
+           1e-6 * triangles * iterations / seconds);
+  }
+
+  return (0);
+}
+
+// draw on a copy of the background for a number of frames after a warm-up, and count the allocations made
+// while drawing, not while copying
+// draw: draws on the frame, given the index of the frame
+// background: the frame drawn on
+// frame: the frame to draw on
+// frames: the number of frames counted
+// count: the number of allocations per frame
+// bytes: the bytes allocated per frame
+static void count_allocations(std::function<void(int, cv::Mat &)> draw, const cv::Mat &background, cv::Mat &frame,
+                              int frames, double &count, double &bytes)
+{
+  // the first frames size the buffers reused by the later ones
+  const int WARM_UP_FRAMES = 10;
+  for (int n = 0; n < WARM_UP_FRAMES; n++)
+  {
+    background.copyTo(frame);
+    draw(n, frame);
+  }
+
+  long totalCount = 0, totalBytes = 0;
+  for (int n = 0; n < frames; n++)
+  {
+    background.copyTo(frame);
+    long startCount = allocationCount.load();
+    long startBytes = allocationBytes.load();
+    draw(WARM_UP_FRAMES + n, frame);
+    totalCount += allocationCount.load() - startCount;
+    totalBytes += allocationBytes.load() - startBytes;
+  }
+  count = (double)totalCount / frames;
+  bytes = (double)totalBytes / frames;
+}
+
+int benchmark_alloc(BenchmarkContext &context)
+{
+  const Mesh &mesh = *context.mesh;
+  if (mesh.faceCount() == 0)
+  {
+    printf("error: mesh is empty.\n");
+    return (-1);
+  }
+
+  // the frame and the pose of the raster benchmark, turned a little every frame so that the culling changes
+  Projector projector(context.cameraMatrix, context.distCoeffs);
+  cv::Vec4f intrinsics = projector.intrinsics();
+  cv::Size size((int)(2 * intrinsics[2]), (int)(2 * intrinsics[3]));
+  cv::Mat background(size, CV_8UC3, cv::Scalar(40, 40, 40)), frame;
+  cv::Vec3d tvec(-4, 2.5, 12);
+  int frames = 100;
+
+  // a 2x2 grid of instances for the scene
+  Scene scene;
+  add_scene_mesh(scene, "object", mesh);
+  for (int i = 0; i < 4; i++)
+  {
+    add_scene_instance(scene, 0, cv::Vec3f((i % 2 - 0.5f) * 8, (i / 2 - 0.5f) * 6, 0), cv::Vec3f(0, 0, 0), 0.5f);
+  }
+
+  RenderBuffers buffers;
+  SceneBuffers sceneBuffers;
+  Rasterizer rasterizer;
+  std::vector<std::string> names;
+  std::vector<std::function<void(int, cv::Mat &)>> draws;
+  names.push_back("draw_corners");
+  draws.push_back([&](int n, cv::Mat &frame)
+  {
+    draw_corners(projector, cv::Vec3d(2.6, 0.1 + 0.002 * n, -0.05), tvec, frame);
+  });
+  names.push_back("draw_object");
+  draws.push_back([&](int n, cv::Mat &frame)
+  {
+    draw_object(projector, cv::Vec3d(2.6, 0.1 + 0.002 * n, -0.05), tvec, mesh, buffers, frame);
+  });
+  RenderMode solidModes[2] = {RENDER_FLAT, RENDER_GOURAUD};
+  for (int m = 0; m < 2; m++)
+  {
+    RenderMode mode = solidModes[m];
+    names.push_back("render " + render_mode_name(mode));
+    draws.push_back([&, mode](int n, cv::Mat &frame)
+    {
+      rasterizer.render(projector, cv::Vec3d(2.6, 0.1 + 0.002 * n, -0.05), tvec, mesh, mode, buffers, frame);
+    });
+  }
+  RenderMode sceneModes[2] = {RENDER_WIREFRAME, RENDER_FLAT};
+  for (int m = 0; m < 2; m++)
+  {
+    RenderMode mode = sceneModes[m];
+    names.push_back("draw_scene " + render_mode_name(mode));
+    draws.push_back([&, mode](int n, cv::Mat &frame)
+    {
+      draw_scene(projector, cv::Vec3d(2.6, 0.1 + 0.002 * n, -0.05), tvec, scene, mode, rasterizer, buffers,
+                 sceneBuffers, frame);
+    });
+  }
+
+  // allocations made inside OpenCV, e.g. by cv::fillPoly or cv::parallel_for_, are counted too,
+  // while cv::Mat data comes from cv::fastMalloc and is not
+  printf("%d triangles, %dx%d frame, %d frames after warm-up\n", mesh.faceCount(), size.width, size.height, frames);
+  printf("%-20s %22s %16s\n", "path", "allocations per frame", "bytes per frame");
+  for (size_t i = 0; i < draws.size(); i++)
+  {
+    double count, bytes;
+    count_allocations(draws[i], background, frame, frames, count, bytes);
+    printf("%-20s %22.2f %16.1f\n", names[i].c_str(), count, bytes);
+  }
+
+  return (0);
+}
+
+// parse an obj file line by line with streams, as the object loader did before the chunked parser,
+// keeping the coordinates as they are in the file
+// filename: the path of the obj file
+// mesh: the mesh to store the vertices and triangles in
+// return: 0 if successful, -1 if error
+static int parse_obj_stream(std::string filename, MeshData &mesh)
+{
+  std::ifstream file(filename);
+  if (!file.is_open())
+  {
+    printf("error: unable to open file.\n");
+    return (-1);
+  }
+
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty())
+    {
+      continue;
+    }
+
+    std::string type;
+    std::stringstream ss(line);
+    ss >> type;
+    if (type == "v")
+    {
+      float x, y, z;
+      ss >> x >> y >> z;
+      if (ss.fail())
+      {
+        printf("error: invalid vertex.\n");
+        return (-1);
+      }
+      mesh.x.push_back(x);
+      mesh.y.push_back(y);
+      mesh.z.push_back(z);
+    }
+    else if (type == "f")
+    {
+      int v1, v2, v3;
+      ss >> v1 >> v2 >> v3;
+      if (ss.fail())
+      {
+        printf("error: invalid face.\n");
+        return (-1);
+      }
+      mesh.indices.push_back(v1 - 1);
+      mesh.indices.push_back(v2 - 1);
+      mesh.indices.push_back(v3 - 1);
+    }
+    else
+    {
+      printf("error: invalid line type.\n");
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+// write a grid of triangles that the stream parser can read too
+// filename: the path of the obj file
+// size: the number of vertices along each side
+// return: 0 if successful, -1 if error
+static int write_grid_obj(std::string filename, int size)
+{
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == NULL)
+  {
+    printf("error: unable to write %s.\n", filename.c_str());
+    return (-1);
+  }
+
+  for (int i = 0; i < size; i++)
+  {
+    for (int j = 0; j < size; j++)
+    {
+      double u = (double)j / (size - 1), v = (double)i / (size - 1);
+      fprintf(file, "v %.6f %.6f %.6f\n", 8 * u - 4, 0.25 * std::sin(20 * u) * std::cos(20 * v), 6 * v - 3);
+    }
+  }
+  for (int i = 0; i + 1 < size; i++)
+  {
+    for (int j = 0; j + 1 < size; j++)
+    {
+      int a = i * size + j + 1;
+      fprintf(file, "f %d %d %d\nf %d %d %d\n", a, a + size, a + 1, a + 1, a + size, a + size + 1);
+    }
+  }
+
+  return (fclose(file) == 0 ? 0 : -1);
+}
+
+int benchmark_obj(BenchmarkContext &context)
+{
+  // a grid of about 100 MB next to the object file
+  std::string gridFile = cv::tempfile(".obj");
+  if (write_grid_obj(gridFile, 1200) != 0)
+  {
+    return (-1);
+  }
+  std::string files[] = {context.objectFile, gridFile};
+
+  printf("%-10s %10s %10s %10s %16s %16s %16s %10s\n", "file", "MB", "vertices", "triangles", "stream MB/s",
+         "1 thread MB/s", "threads MB/s", "match");
+  int result = 0;
+  for (int f = 0; f < 2; f++)
+  {
+    std::ifstream file(files[f], std::ios::binary | std::ios::ate);
+    double megabytes = file.is_open() ? (double)file.tellg() / (1 << 20) : 0;
+    file.close();
+
+    // the stream parser is slow enough to run once
+    MeshData expected;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (parse_obj_stream(files[f], expected) != 0)
+    {
+      result = -1;
+      break;
+    }
+    double streamSeconds = seconds_since(start);
+
+    // the best of a few runs of the chunked parser, on one thread and on all of them
+    double seconds[2] = {1e30, 1e30};
+    int threads[2] = {1, 0};
+    MeshData parsed;
+    for (int t = 0; t < 2; t++)
+    {
+      for (int r = 0; r < REPETITIONS; r++)
+      {
+        start = std::chrono::steady_clock::now();
+        if (parse_obj_file(files[f], parsed, threads[t]) != 0)
+        {
+          result = -1;
+          break;
+        }
+        seconds[t] = std::min(seconds[t], seconds_since(start));
+      }
+    }
+
+    // both parsers have to read the same numbers, to the last bit
+    bool match = parsed.x == expected.x && parsed.y == expected.y && parsed.z == expected.z &&
+                 parsed.indices == expected.indices;
+    printf("%-10s %10.1f %10d %10d %16.1f %16.1f %16.1f %10s\n", f == 0 ? "object" : "grid", megabytes,
+           parsed.vertexCount(), parsed.faceCount(), megabytes / streamSeconds, megabytes / seconds[0],
+           megabytes / seconds[1], match ? "yes" : "no");
+  }
+
+  remove(gridFile.c_str());
+
+  return (result);
+}
+
+// read a csv file a character at a time with fgetc and convert every field with atof,
+// as read_object_data_csv did before the chunked parser, but without its fixed-size buffers
+// filename: the path of the csv file
+// labels: the label of every row
+// values: the numbers of all rows, row by row
+// return: 0 if successful, -1 if error
+static int read_csv_fgetc(std::string filename, std::vector<std::string> &labels, std::vector<double> &values)
+{
+  FILE *file = fopen(filename.c_str(), "r");
+  if (file == NULL)
+  {
+    printf("error: unable to open file.\n");
+    return (-1);
+  }
+
+  std::string field;
+  bool label = true;
+  for (;;)
+  {
+    int ch = fgetc(file);
+    if (ch == ',' || ch == '\n' || ch == EOF)
+    {
+      if (label && !field.empty())
+      {
+        labels.push_back(field);
+      }
+      else if (!label)
+      {
+        values.push_back(atof(field.c_str()));
+      }
+      field.clear();
+      label = ch != ',';
+      if (ch == EOF)
+      {
+        break;
+      }
+      continue;
+    }
+    field += (char)ch;
+  }
+  fclose(file);
+
+  return (0);
+}
+
+int benchmark_csv(BenchmarkContext &)
+{
+  // a million rows of 8 features, like a large feature table written by append_object_data_csv
+  const int ROWS = 1000000;
+  const int COLS = 8;
+  std::string tableFile = cv::tempfile(".csv");
+  FILE *file = fopen(tableFile.c_str(), "w");
+  if (file == NULL)
+  {
+    printf("error: unable to write %s.\n", tableFile.c_str());
+    return (-1);
+  }
+  cv::RNG rng(1);
+  for (int i = 0; i < ROWS; i++)
+  {
+    fprintf(file, "object%d", i % 100);
+    for (int j = 0; j < COLS; j++)
+    {
+      fprintf(file, ",%f", rng.uniform(-1000.0, 1000.0));
+    }
+    fprintf(file, "\n");
+  }
+  if (fclose(file) != 0)
+  {
+    printf("error: unable to write %s.\n", tableFile.c_str());
+    remove(tableFile.c_str());
+    return (-1);
+  }
+  std::ifstream stream(tableFile, std::ios::binary | std::ios::ate);
+  double megabytes = stream.is_open() ? (double)stream.tellg() / (1 << 20) : 0;
+  stream.close();
+
+  // the character reader is slow enough to run once
+  std::vector<std::string> expectedLabels;
+  std::vector<double> expectedValues;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (read_csv_fgetc(tableFile, expectedLabels, expectedValues) != 0)
+  {
+    remove(tableFile.c_str());
+    return (-1);
+  }
+  double fgetcSeconds = seconds_since(start);
+
+  // the best of a few runs of the chunked parser, on one thread and on all of them
+  double seconds[2] = {1e30, 1e30};
+  int threads[2] = {1, 0};
+  CsvTable table;
+  int result = 0;
+  for (int t = 0; t < 2 && result == 0; t++)
+  {
+    for (int r = 0; r < REPETITIONS; r++)
+    {
+      start = std::chrono::steady_clock::now();
+      if (read_csv_table(tableFile, table, threads[t]) != 0)
+      {
+        result = -1;
+        break;
+      }
+      seconds[t] = std::min(seconds[t], seconds_since(start));
+    }
+  }
+  remove(tableFile.c_str());
+  if (result != 0)
+  {
+    return (result);
+  }
+
+  // both readers have to read the same numbers, to the last bit
+  bool match = table.labels == expectedLabels && table.values == expectedValues && table.cols == COLS;
+  printf("%10s %10s %10s %16s %16s %16s %10s\n", "MB", "rows", "columns", "fgetc MB/s", "1 thread MB/s",
+         "threads MB/s", "match");
+  printf("%10.1f %10d %10d %16.1f %16.1f %16.1f %10s\n", megabytes, table.rows(), table.cols,
+         megabytes / fgetcSeconds, megabytes / seconds[0], megabytes / seconds[1], match ? "yes" : "no");
+
+  return (0);
+}
+
+int benchmark_lod(BenchmarkContext &context)
+{
+  const LodChain &lods = *context.lods;
+  if (lods.levels.empty() || lods.levels[0].faceCount() == 0)
+  {
+    printf("error: mesh is empty.\n");
+    return (-1);
+  }
+
+  Projector projector(context.cameraMatrix, context.distCoeffs);
+  cv::Vec4f intrinsics = projector.intrinsics();
+  cv::Size size((int)(2 * intrinsics[2]), (int)(2 * intrinsics[3]));
+  cv::Mat background(size, CV_8UC3, cv::Scalar(40, 40, 40)), frame;
+  RenderBuffers buffers;
+  int iterations = 100;
+  float pixelsPerCell = 3;
+
+  printf("levels:");
+  for (size_t i = 0; i < lods.levels.size(); i++)
+  {
+    printf(" %d", lods.levels[i].faceCount());
+  }
+  printf(" triangles\n");
+  printf("%10s %14s %14s %8s %10s %14s\n", "distance", "diameter px", "full ms", "level", "triangles", "level ms");
+  for (double distance = 10; distance <= 320; distance *= 2)
+  {
+    // the chessboard seen from the front, pushed back along the optical axis
+    cv::Vec3d rvec(2.6, 0.1, -0.05), tvec(-4, 2.5, distance);
+    int level = select_lod(lods, intrinsics[0], rvec, tvec, pixelsPerCell);
+
+    double seconds[2] = {0, 0};
+    const Mesh *meshes[2] = {&lods.levels[0], &lods.levels[level]};
+    for (int m = 0; m < 2; m++)
+    {
+      for (int n = 0; n < iterations; n++)
+      {
+        background.copyTo(frame);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        draw_object(projector, rvec, tvec, *meshes[m], buffers, frame);
+        seconds[m] += seconds_since(start);
+      }
+    }
+
+    printf("%10.0f %14.1f %14.3f %8d %10d %14.3f\n", distance, 2 * lods.radius * intrinsics[0] / distance,
+           1000 * seconds[0] / iterations, level, meshes[1]->faceCount(), 1000 * seconds[1] / iterations);
+  }
+
+  return (0);
+}
+
+int benchmark_bvh(BenchmarkContext &context)
+{
+  const Mesh &mesh = *context.mesh;
+  if (mesh.faceCount() == 0 || mesh.bvh == NULL)
+  {
+    printf("error: mesh is empty or has no hierarchy.\n");
+    return (-1);
+  }
+
+  // the same mesh without the hierarchy
+  Mesh flat = mesh;
+  flat.bvh = NULL;
+  flat.bvhNodes = 0;
+
+  Projector projector(context.cameraMatrix, context.distCoeffs);
+  cv::Vec4f intrinsics = projector.intrinsics();
+  cv::Size size((int)(2 * intrinsics[2]), (int)(2 * intrinsics[3]));
+  cv::Mat background(size, CV_8UC3, cv::Scalar(40, 40, 40)), frame;
+  RenderBuffers buffers;
+  int iterations = 200;
+
+  printf("%d triangles, %d nodes\n", mesh.faceCount(), mesh.bvhNodes);
+  printf("%10s %14s %14s %10s\n", "shift", "flat ms", "bvh ms", "speedup");
+  for (int step = 0; step <= 6; step++)
+  {
+    // slide the chessboard to the right until the object has left the frame
+    double shift = step * 4.0;
+    cv::Vec3d rvec(2.6, 0.1, -0.05), tvec(-4 + shift, 2.5, 18);
+
+    double seconds[2] = {0, 0};
+    const Mesh *meshes[2] = {&flat, &mesh};
+    for (int m = 0; m < 2; m++)
+    {
+      for (int n = 0; n < iterations; n++)
+      {
+        background.copyTo(frame);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        draw_object(projector, rvec, tvec, *meshes[m], buffers, frame);
+        seconds[m] += seconds_since(start);
+      }
+    }
+
+    printf("%10.1f %14.4f %14.4f %9.1fx\n", shift, 1000 * seconds[0] / iterations, 1000 * seconds[1] / iterations,
+           seconds[0] / seconds[1]);
+  }
+
+  return (0);
+}
+
+int benchmark_scene(BenchmarkContext &context)
+{
+  const LodChain &lods = *context.lods;
+  if (lods.levels.empty() || lods.levels.back().faceCount() == 0)
+  {
+    printf("error: mesh is empty.\n");
+    return (-1);
+  }
+
+  // the coarsest level, so that the cost per instance shows next to the cost per triangle
+  const Mesh &mesh = lods.levels.back();
+  Projector projector(context.cameraMatrix, context.distCoeffs);
+  cv::Vec4f intrinsics = projector.intrinsics();
+  cv::Size size((int)(2 * intrinsics[2]), (int)(2 * intrinsics[3]));
+  cv::Mat background(size, CV_8UC3, cv::Scalar(40, 40, 40)), frame;
+  RenderBuffers buffers;
+  SceneBuffers sceneBuffers;
+  Rasterizer rasterizer;
+  int iterations = 50;
+
+  printf("%d triangles per instance\n", mesh.faceCount());
+  printf("%10s %12s %14s %14s %10s %14s\n", "instances", "triangles", "separate ms", "batched ms", "speedup",
+         "flat ms");
+  for (int side = 1; side <= 16; side *= 2)
+  {
+    // a grid of instances, each turned a little more than the one before, seen from far enough to fit in the frame
+    Scene scene;
+    add_scene_mesh(scene, "object", mesh);
+    for (int i = 0; i < side * side; i++)
+    {
+      cv::Vec3f position((i % side - (side - 1) / 2.0f) * 8, -(i / side - (side - 1) / 2.0f) * 6, 0);
+      add_scene_instance(scene, 0, position, cv::Vec3f(0, 0, 10.0f * i), 1);
+    }
+    cv::Vec3d rvec(2.6, 0.1, -0.05), tvec(-4, 2.5, 12.0 * side);
+
+    // every instance drawn on its own, as the ar loop draws the object, with its pose composed every frame
+    double seconds[3] = {0, 0, 0};
+    for (int n = 0; n < iterations; n++)
+    {
+      background.copyTo(frame);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      cv::Matx33d board;
+      cv::Rodrigues(rvec, board);
+      for (size_t i = 0; i < scene.instances.size(); i++)
+      {
+        const MeshInstance &instance = scene.instances[i];
+        cv::Vec3d instanceRvec;
+        cv::Rodrigues(board * cv::Matx33d(instance.rotation), instanceRvec);
+        cv::Vec3d instanceTvec = board * cv::Vec3d(instance.translation) + tvec;
+        draw_object(projector, instanceRvec, instanceTvec, mesh, buffers, frame);
+      }
+      seconds[0] += seconds_since(start);
+    }
+
+    // all of them at once
+    RenderMode modes[2] = {RENDER_WIREFRAME, RENDER_FLAT};
+    for (int m = 0; m < 2; m++)
+    {
+      for (int n = 0; n < iterations; n++)
+      {
+        background.copyTo(frame);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        draw_scene(projector, rvec, tvec, scene, modes[m], rasterizer, buffers, sceneBuffers, frame);
+        seconds[m + 1] += seconds_since(start);
+      }
+    }
+
+    printf("%10d %12d %14.3f %14.3f %9.1fx %14.3f\n", side * side, side * side * mesh.faceCount(),
+           1000 * seconds[0] / iterations, 1000 * seconds[1] / iterations, seconds[0] / seconds[1],
+           1000 * seconds[2] / iterations);
+  }
+
+  return (0);
+}
+
+int benchmark_undistort(BenchmarkContext &context)
+{
+  const Mesh &mesh = *context.mesh;
+  if (mesh.faceCount() == 0)
+  {
+    printf("error: mesh is empty.\n");
+    return (-1);
+  }
+
+  // the current path on the frames from the camera, and the pinhole path on the undistorted frames
+  Undistorter undistorter(context.cameraMatrix, context.distCoeffs);
+  cv::Mat distCoeffs[2] = {context.distCoeffs, undistorter.distCoeffs()};
+  Projector projectors[2] = {Projector(context.cameraMatrix, distCoeffs[0]),
+                             Projector(context.cameraMatrix, distCoeffs[1])};
+  RenderBuffers buffers;
+
+  // the time spent in each stage by each path, as remap, detection, pose and rendering
+  double seconds[2][4] = {{0, 0, 0, 0}, {0, 0, 0, 0}};
+  double errorSums[2] = {0, 0};
+  double rotationSum = 0, translationSum = 0, cornerSum = 0;
+  int frames = 0, poses = 0;
+  cv::Mat frame, undistorted, gray;
+  while ((context.maxFrames < 0 || frames < context.maxFrames) && context.source->read(frame))
+  {
+    frames++;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    undistorter.apply(frame, undistorted);
+    seconds[1][0] += seconds_since(start);
+
+    // run a full detection and a pose from scratch on every frame, so that the paths do not depend on tracking,
+    // on a copy of the undistorted frame, which is the frame itself without distortion
+    cv::Mat images[2] = {frame, undistorted.clone()};
+    std::vector<cv::Point2f> corners[2];
+    cv::Vec3d rvecs[2], tvecs[2];
+    bool found[2] = {false, false};
+    for (int p = 0; p < 2; p++)
+    {
+      BoardTracker tracker(context.patternSize, 0);
+      start = std::chrono::steady_clock::now();
+      cv::cvtColor(images[p], gray, cv::COLOR_BGR2GRAY);
+      found[p] = tracker.find(gray, corners[p]);
+      seconds[p][1] += seconds_since(start);
+      if (!found[p])
+      {
+        continue;
+      }
+
+      PoseEstimator estimator(context.cameraMatrix, distCoeffs[p], POSE_ITERATIVE);
+      start = std::chrono::steady_clock::now();
+      found[p] = estimator.estimate(context.pointSet, corners[p], rvecs[p], tvecs[p]);
+      seconds[p][2] += seconds_since(start);
+      if (!found[p])
+      {
+        continue;
+      }
+      errorSums[p] += estimator.error();
+
+      start = std::chrono::steady_clock::now();
+      draw_object(projectors[p], rvecs[p], tvecs[p], mesh, buffers, images[p]);
+      seconds[p][3] += seconds_since(start);
+    }
+    if (!found[0] || !found[1])
+    {
+      continue;
+    }
+
+    // compare the poses, and the corners of the frame from the camera undistorted as points with the corners
+    // found in the undistorted frame
+    cv::Matx33d rotation, reference;
+    cv::Rodrigues(rvecs[1], rotation);
+    cv::Rodrigues(rvecs[0], reference);
+    cv::Vec3d angle;
+    cv::Rodrigues(rotation * reference.t(), angle);
+    rotationSum += cv::norm(angle) * 180 / CV_PI;
+    translationSum += cv::norm(tvecs[1] - tvecs[0]);
+    std::vector<cv::Point2f> expected;
+    cv::undistortPoints(corners[0], expected, context.cameraMatrix, context.distCoeffs, cv::noArray(),
+                        context.cameraMatrix);
+    double distance = 0;
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+      distance += cv::norm(expected[i] - corners[1][i]);
+    }
+    cornerSum += distance / expected.size();
+    poses++;
+  }
+
+  if (poses == 0)
+  {
+    printf("error: no chessboard found by both paths.\n");
+    return (-1);
+  }
+
+  // the stages are averaged over all frames, the accuracy over the frames where both paths found a pose
+  printf("%d frames, %d poses found by both, %s and %s kernels\n", frames, poses,
+         distortion_model_name(projectors[0].model()).c_str(), distortion_model_name(projectors[1].model()).c_str());
+  const char *stages[4] = {"remap", "detection", "pose", "render"};
+  printf("%-10s %14s %14s\n", "stage", "distorted ms", "undistorted ms");
+  double totals[2] = {0, 0};
+  for (int s = 0; s < 4; s++)
+  {
+    printf("%-10s %14.3f %14.3f\n", stages[s], 1000 * seconds[0][s] / frames, 1000 * seconds[1][s] / frames);
+    totals[0] += seconds[0][s];
+    totals[1] += seconds[1][s];
+  }
+  printf("%-10s %14.3f %14.3f\n", "total", 1000 * totals[0] / frames, 1000 * totals[1] / frames);
+  printf("rms error px: %.4f distorted, %.4f undistorted\n", errorSums[0] / poses, errorSums[1] / poses);
+  printf("difference: %.4f deg rotation, %.5f translation, %.4f px corners\n", rotationSum / poses,
+         translationSum / poses, cornerSum / poses);
+
+  return (0);
+}
+
+int benchmark_solver(BenchmarkContext &context)
+{
+  if (context.pointSet.empty())
+  {
+    printf("error: chessboard is empty.\n");
+    return (-1);
+  }
+
+  // the calibrated camera is the ground truth the chessboards are seen with
+  cv::Mat cameraMatrix, distCoeffs;
+  context.cameraMatrix.convertTo(cameraMatrix, CV_64F);
+  context.distCoeffs.convertTo(distCoeffs, CV_64F);
+  double focal = cameraMatrix.at<double>(0, 0);
+  cv::Size size((int)(2 * cameraMatrix.at<double>(0, 2)), (int)(2 * cameraMatrix.at<double>(1, 2)));
+
+  // the center and the width of the chessboard
+  cv::Vec3f center(0, 0, 0);
+  float width = 0;
+  for (size_t i = 0; i < context.pointSet.size(); i++)
+  {
+    center += context.pointSet[i];
+    width = std::max(width, context.pointSet[i][0]);
+  }
+  center *= 1.0f / context.pointSet.size();
+
+  // chessboards facing the camera, tilted by up to about 40 degrees, filling a third to two thirds of the width of
+  // the frame, and moved around it, whose corners are projected and blurred with 0.2 px of noise.
+  // the views with a corner outside the frame are skipped
+  const int VIEW_COUNTS[3] = {50, 200, 500};
+  const double NOISE_PX = 0.2;
+  cv::RNG rng(1);
+  cv::Matx33d facing(1, 0, 0, 0, -1, 0, 0, 0, -1);
+  CalibrationViews views;
+  views.imageSize = size;
+  std::vector<cv::Point2f> corners;
+  for (int attempt = 0; (int)views.corners.size() < VIEW_COUNTS[2] && attempt < 100 * VIEW_COUNTS[2]; attempt++)
+  {
+    cv::Vec3d tilt(rng.gaussian(0.35), rng.gaussian(0.35), rng.gaussian(0.35));
+    cv::Matx33d r;
+    cv::Rodrigues(tilt, r);
+    r = r * facing;
+    double depth = focal * width / (size.width * rng.uniform(0.33, 0.67));
+    cv::Vec3d offset(rng.gaussian(0.15 * size.width * depth / focal), rng.gaussian(0.15 * size.height * depth / focal),
+                     depth);
+    cv::Vec3d rvec, tvec = offset - r * cv::Vec3d(center);
+    cv::Rodrigues(r, rvec);
+
+    cv::projectPoints(context.pointSet, rvec, tvec, cameraMatrix, distCoeffs, corners);
+    bool inside = true;
+    for (size_t i = 0; i < corners.size() && inside; i++)
+    {
+      corners[i] += cv::Point2f((float)rng.gaussian(NOISE_PX), (float)rng.gaussian(NOISE_PX));
+      inside = corners[i].x >= 0 && corners[i].y >= 0 && corners[i].x < size.width && corners[i].y < size.height;
+    }
+    if (inside)
+    {
+      views.corners.push_back(corners);
+      views.points.push_back(context.pointSet);
+      views.frames.push_back(attempt);
+      views.sharpness.push_back(1);
+    }
+  }
+  if ((int)views.corners.size() < VIEW_COUNTS[2])
+  {
+    printf("error: only %d chessboards fit in the frame.\n", (int)views.corners.size());
+    return (-1);
+  }
+
+  // both solvers from scratch on the first views, as calibrate --compare runs them
+  printf("%dx%d frame, %d corners per view, %.1f px of noise\n", size.width, size.height,
+         (int)context.pointSet.size(), NOISE_PX);
+  printf("%6s %10s %10s %12s %12s %14s %14s %14s\n", "views", "opencv s", "schur s", "opencv rms", "schur rms",
+         "camera diff px", "dist diff", "schur ms/view");
+  for (int n = 0; n < 3; n++)
+  {
+    CalibrationViews subset;
+    subset.imageSize = size;
+    subset.corners.assign(views.corners.begin(), views.corners.begin() + VIEW_COUNTS[n]);
+    subset.points.assign(views.points.begin(), views.points.begin() + VIEW_COUNTS[n]);
+
+    cv::Mat opencvCamera, opencvDist, schurCamera, schurDist;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double opencvError = calibrate_views(subset, opencvCamera, opencvDist, false, CALIBRATION_OPENCV);
+    double opencvSeconds = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    double schurError = calibrate_views(subset, schurCamera, schurDist, false, CALIBRATION_SCHUR);
+    double schurSeconds = seconds_since(start);
+    if (opencvError < 0 || schurError < 0)
+    {
+      printf("error: calibration of %d views failed.\n", VIEW_COUNTS[n]);
+      return (-1);
+    }
+
+    printf("%6d %10.3f %10.3f %12.6f %12.6f %14.3g %14.3g %14.3f\n", VIEW_COUNTS[n], opencvSeconds, schurSeconds,
+           opencvError, schurError, cv::norm(opencvCamera, schurCamera, cv::NORM_INF),
+           cv::norm(opencvDist, schurDist, cv::NORM_INF), 1000 * schurSeconds / VIEW_COUNTS[n]);
+  }
+
+  return (0);
+}
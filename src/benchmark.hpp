@@ -0,0 +1,120 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "frame_source.hpp"
+#include "lod.hpp"
+#include "mesh.hpp"
+
+// everything a benchmark of the ar loop may need
+struct BenchmarkContext
+{
+  BenchmarkContext() : source(NULL), maxFrames(-1), mesh(NULL), lods(NULL) {}
+
+  FrameSource *source; // the recorded frames to run on, NULL if the benchmark needs none
+  long maxFrames;      // the number of frames to use, -1 for all
+  cv::Mat cameraMatrix;
+  cv::Mat distCoeffs;
+  cv::Size patternSize;
+  std::vector<cv::Vec3f> pointSet;
+  const Mesh *mesh;       // the object rendered by the ar loop
+  const LodChain *lods;   // the levels of detail of the object
+  std::string objectFile; // the obj file the object was read from
+};
+
+// run a benchmark by name and print its results
+// name: the name of the benchmark
+//   pose: compare the pose solvers on the chessboards found in the frames
+//   projection: compare the projection kernels with cv::projectPoints on the mesh
+//   raster: time the wireframe and the solid render modes on the mesh
+//   alloc: count the heap allocations per frame of every drawing path on the mesh
+//   obj: compare the obj parser with a line-by-line stream parser
+//   csv: compare the csv parser with a character-by-character reader on a million rows
+//   lod: time the wireframe at increasing distances with and without levels of detail
+//   bvh: time the wireframe moving out of the frame with and without the bounding volume hierarchy
+//   undistort: compare the ar loop on the frames with the ar loop on undistorted frames, in speed and accuracy
+//   scene: time growing grids of instances drawn one by one and as one batched scene
+//   solver: compare the calibration solvers on 50, 200 and 500 generated views of the calibrated camera
+// context: the frames, the calibration and the chessboard
+// return: 0 if successful, -1 if error
+int run_benchmark(std::string name, BenchmarkContext &context);
+
+// check whether a benchmark reads frames from the frame source
+// name: the name of the benchmark
+// return: true if the benchmark needs frames
+bool benchmark_needs_frames(std::string name);
+
+// compare the pose solvers on the chessboards found in the frames
+// context: the frames, the calibration and the chessboard
+// return: 0 if successful, -1 if error
+int benchmark_pose(BenchmarkContext &context);
+
+// compare the projection kernel of each distortion model with cv::projectPoints, in speed and accuracy
+// context: the calibration and the mesh
+// return: 0 if successful, -1 if error
+int benchmark_projection(BenchmarkContext &context);
+
+// time drawing the mesh in every render mode, in frames and triangles per second
+// context: the calibration and the mesh
+// return: 0 if successful, -1 if error
+int benchmark_raster(BenchmarkContext &context);
+
+// count the allocations made with operator new per frame by draw_corners, draw_object, the rasterizer and
+// draw_scene, after a warm-up that sizes the buffers they reuse
+// context: the calibration and the mesh
+// return: 0 if successful, -1 if error
+int benchmark_alloc(BenchmarkContext &context);
+
+// compare the chunked obj parser with the line-by-line stream parser it replaced, in speed and results,
+// on the obj file of the object and on a generated grid of about 100 MB
+// context: the obj file
+// return: 0 if successful, -1 if error
+int benchmark_obj(BenchmarkContext &context);
+
+// compare the chunked csv parser with the character-by-character reader it replaced, in speed and results,
+// on a generated table of a million rows of 8 numbers
+// context: unused
+// return: 0 if successful, -1 if error
+int benchmark_csv(BenchmarkContext &context);
+
+// time drawing the wireframe with the chessboard at increasing distances, with the full mesh
+// and with the level of detail picked for each distance
+// context: the calibration and the levels of detail
+// return: 0 if successful, -1 if error
+int benchmark_lod(BenchmarkContext &context);
+
+// time drawing the wireframe as the object moves out of the side of the frame,
+// with and without culling by the bounding volume hierarchy
+// context: the calibration and the mesh
+// return: 0 if successful, -1 if error
+int benchmark_bvh(BenchmarkContext &context);
+
+// time drawing growing grids of instances of the coarsest level of detail, one draw_object call per instance
+// against one draw_scene call for all of them
+// context: the calibration and the levels of detail
+// return: 0 if successful, -1 if error
+int benchmark_scene(BenchmarkContext &context);
+
+// compare detection, pose and rendering on the frames from the camera, with the distortion model,
+// against remapping them with the undistortion maps first and working with a pinhole camera,
+// in time per stage, rms reprojection error, pose and corner differences
+// context: the frames, the calibration, the chessboard and the mesh
+// return: 0 if successful, -1 if error
+int benchmark_undistort(BenchmarkContext &context);
+
+// compare the Schur-complement calibration solver with cv::calibrateCamera, with the same model and from the same
+// start, on 50, 200 and 500 views of the chessboard generated with the calibrated camera, in time, time per view,
+// rms error and the largest difference between their camera matrices and distortion coefficients
+// context: the calibration and the chessboard
+// return: 0 if successful, -1 if error
+int benchmark_solver(BenchmarkContext &context);
+
+#endif
@@ -0,0 +1,392 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include "board_tracker.hpp"
+#include "profiler.hpp"
+
+// the largest distance in pixels between a corner and its forward-backward tracked position
+static const float MAX_FLOW_ERROR = 1.0f;
+
+// the largest rms distance in pixels between the corners and a homography fitted to the board
+static const double MAX_HOMOGRAPHY_ERROR = 2.0;
+
+// the number of frames without the board after which its last position is no longer a useful prediction
+static const int MAX_FRAMES_UNSEEN = 5;
+
+// the padding of the region of interest, as a fraction of the size of the last board
+static const float ROI_MARGIN = 0.25f;
+
+// the region of interest is skipped when it covers more than this fraction of the frame
+static const double MAX_ROI_FRACTION = 0.6;
+
+// the pyramid level searched is the first one that is at most this many pixels wide
+static const int PYRAMID_WIDTH = 1000;
+
+// the default flags of cv::findChessboardCorners
+static const int FIND_FLAGS = cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE;
+
+// get the seconds elapsed since a time point
+// start: the time point
+// return: the seconds elapsed
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+// get the centroid of a set of points
+// points: the points
+// return: the centroid
+static cv::Point2f centroid(const std::vector<cv::Point2f> &points)
+{
+  cv::Point2f sum(0, 0);
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    sum += points[i];
+  }
+
+  return (sum * (1.0 / points.size()));
+}
+
+BoardTracker::BoardTracker(cv::Size patternSize, int redetectInterval)
+{
+  this->patternSize = patternSize;
+  this->redetectInterval = redetectInterval;
+  winSize = cv::Size(21, 21);
+  maxLevel = 3;
+  termCrit = cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01);
+  flowCrit = cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 20, 0.03);
+  detected = 0;
+  tracked = 0;
+  lost = 0;
+  missed = 0;
+  accelerated = true;
+  reset();
+}
+
+void BoardTracker::reset()
+{
+  hasPrevious = false;
+  framesSinceDetection = 0;
+  prevPyramid.clear();
+  prevCorners.clear();
+  framesSinceSeen = 0;
+  lastCorners.clear();
+  velocity = cv::Point2f(0, 0);
+}
+
+void BoardTracker::setAcceleratedSearch(bool accelerated)
+{
+  this->accelerated = accelerated;
+}
+
+bool BoardTracker::find(const cv::Mat &gray, std::vector<cv::Point2f> &corners)
+{
+  // without tracking, every frame is a full detection
+  if (redetectInterval <= 0)
+  {
+    return (detect(gray, corners));
+  }
+
+  // build the pyramid of this frame, it is used for tracking now and as the previous frame next time
+  std::vector<cv::Mat> pyramid;
+  {
+    ScopedTimer timer(PROFILE_TRACK);
+    cv::buildOpticalFlowPyramid(gray, pyramid, winSize, maxLevel);
+  }
+
+  bool found = false;
+  if (hasPrevious && framesSinceDetection < redetectInterval)
+  {
+    // propagate the corners of the previous frame
+    found = track(gray, pyramid, corners);
+    if (found)
+    {
+      tracked++;
+      framesSinceDetection++;
+      updateMotion(true, corners);
+    }
+    else
+    {
+      lost++;
+    }
+  }
+
+  // fall back to a full detection
+  if (!found)
+  {
+    found = detect(gray, corners);
+    framesSinceDetection = 0;
+  }
+
+  // remember this frame for the next one
+  hasPrevious = found;
+  if (found)
+  {
+    prevPyramid.swap(pyramid);
+    prevCorners = corners;
+  }
+
+  return (found);
+}
+
+// run a full chessboard detection
+// gray: the grayscale frame
+// corners: the corners found
+// return: true if the chessboard was found
+bool BoardTracker::detect(const cv::Mat &gray, std::vector<cv::Point2f> &corners)
+{
+  // find the chessboard corners, cheapest search first
+  bool found;
+  if (accelerated)
+  {
+    found = searchRoi(gray, corners) || searchPyramid(gray, corners) ||
+            search(gray, corners, FIND_FLAGS | cv::CALIB_CB_FAST_CHECK, fullStats);
+  }
+  else
+  {
+    found = search(gray, corners, FIND_FLAGS, fullStats);
+  }
+
+  // if the corners are found
+  if (found)
+  {
+    // refine the corner locations at full resolution
+    ScopedTimer timer(PROFILE_SUBPIX);
+    cv::cornerSubPix(gray, corners, cv::Size(5, 5), cv::Size(-1, -1), termCrit);
+    detected++;
+  }
+  else
+  {
+    missed++;
+  }
+  updateMotion(found, corners);
+
+  return (found);
+}
+
+// update where the board was last seen and how fast it moves
+// found: whether the board was found in this frame
+// corners: the corners found
+void BoardTracker::updateMotion(bool found, const std::vector<cv::Point2f> &corners)
+{
+  if (!found)
+  {
+    framesSinceSeen++;
+    return;
+  }
+
+  // spread the motion over the frames the board was not seen
+  if (!lastCorners.empty())
+  {
+    velocity = (centroid(corners) - centroid(lastCorners)) * (1.0 / (framesSinceSeen + 1));
+  }
+  lastCorners = corners;
+  framesSinceSeen = 0;
+}
+
+// run cv::findChessboardCorners on an image and time it
+// image: the image to search
+// corners: the corners found, in the coordinates of the image
+// flags: the flags of cv::findChessboardCorners
+// stats: the stats of the search level
+// return: true if the chessboard was found
+bool BoardTracker::search(const cv::Mat &image, std::vector<cv::Point2f> &corners, int flags, SearchStats &stats)
+{
+  ScopedTimer timer(PROFILE_DETECT);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bool found = cv::findChessboardCorners(image, patternSize, corners, flags);
+
+  stats.attempts++;
+  stats.found += found;
+  stats.seconds += seconds_since(start);
+
+  return (found);
+}
+
+// search the region of interest predicted from where the board was last seen
+// gray: the grayscale frame
+// corners: the corners found, in frame coordinates
+// return: true if the chessboard was found
+bool BoardTracker::searchRoi(const cv::Mat &gray, std::vector<cv::Point2f> &corners)
+{
+  // a board that has not been seen for a while can be anywhere
+  if (lastCorners.empty() || framesSinceSeen > MAX_FRAMES_UNSEEN)
+  {
+    return (false);
+  }
+
+  // move the last board by its velocity, and pad it by the motion and a margin for the outer squares
+  cv::Rect box = cv::boundingRect(lastCorners);
+  cv::Point2f shift = velocity * (framesSinceSeen + 1);
+  int pad = (int)(ROI_MARGIN * std::max(box.width, box.height) + std::sqrt(shift.dot(shift)));
+  cv::Rect roi(box.x + (int)shift.x - pad, box.y + (int)shift.y - pad, box.width + 2 * pad, box.height + 2 * pad);
+  roi &= cv::Rect(0, 0, gray.cols, gray.rows);
+
+  // a region that is nearly the whole frame saves nothing
+  if (roi.area() == 0 || roi.area() > MAX_ROI_FRACTION * gray.cols * gray.rows)
+  {
+    return (false);
+  }
+
+  if (!search(gray(roi), corners, FIND_FLAGS | cv::CALIB_CB_FAST_CHECK, roiStats))
+  {
+    return (false);
+  }
+
+  // move the corners back to frame coordinates
+  for (size_t i = 0; i < corners.size(); i++)
+  {
+    corners[i].x += roi.x;
+    corners[i].y += roi.y;
+  }
+
+  return (true);
+}
+
+// search a downscaled level of the frame
+// gray: the grayscale frame
+// corners: the corners found, upscaled to frame coordinates
+// return: true if the chessboard was found
+bool BoardTracker::searchPyramid(const cv::Mat &gray, std::vector<cv::Point2f> &corners)
+{
+  // a small frame is searched at full resolution right away
+  if (gray.cols <= PYRAMID_WIDTH)
+  {
+    return (false);
+  }
+
+  // halve the frame until it is small enough, the downscaling counts towards the pyramid level
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int scale = 1;
+  cv::Mat level = gray;
+  while (level.cols > PYRAMID_WIDTH)
+  {
+    cv::Mat next;
+    cv::pyrDown(level, next);
+    level = next;
+    scale *= 2;
+  }
+  pyramidStats.seconds += seconds_since(start);
+
+  if (!search(level, corners, FIND_FLAGS | cv::CALIB_CB_FAST_CHECK, pyramidStats))
+  {
+    return (false);
+  }
+
+  // upscale the corners, pixel centers of the level map to the centers of scale x scale blocks
+  for (size_t i = 0; i < corners.size(); i++)
+  {
+    corners[i].x = (corners[i].x + 0.5f) * scale - 0.5f;
+    corners[i].y = (corners[i].y + 0.5f) * scale - 0.5f;
+  }
+
+  return (true);
+}
+
+// track the corners of the previous frame into this frame
+// gray: the grayscale frame
+// pyramid: the optical flow pyramid of the frame
+// corners: the tracked corners
+// return: true if all corners were tracked reliably
+bool BoardTracker::track(const cv::Mat &gray, std::vector<cv::Mat> &pyramid, std::vector<cv::Point2f> &corners)
+{
+  // track the corners forward, then track the result back to the previous frame
+  std::vector<cv::Point2f> backCorners;
+  std::vector<uchar> status, backStatus;
+  std::vector<float> error;
+  {
+    ScopedTimer timer(PROFILE_TRACK);
+    cv::calcOpticalFlowPyrLK(prevPyramid, pyramid, prevCorners, corners, status, error, winSize, maxLevel, flowCrit);
+    cv::calcOpticalFlowPyrLK(pyramid, prevPyramid, corners, backCorners, backStatus, error, winSize, maxLevel,
+                             flowCrit);
+  }
+
+  // every corner has to be tracked both ways and return to where it started
+  for (size_t i = 0; i < corners.size(); i++)
+  {
+    cv::Point2f diff = backCorners[i] - prevCorners[i];
+    if (!status[i] || !backStatus[i] || diff.x * diff.x + diff.y * diff.y > MAX_FLOW_ERROR * MAX_FLOW_ERROR)
+    {
+      return (false);
+    }
+
+    // the corner also has to stay in the frame
+    if (corners[i].x < 0 || corners[i].y < 0 || corners[i].x >= gray.cols || corners[i].y >= gray.rows)
+    {
+      return (false);
+    }
+  }
+
+  // refine the corner locations
+  {
+    ScopedTimer timer(PROFILE_SUBPIX);
+    cv::cornerSubPix(gray, corners, cv::Size(5, 5), cv::Size(-1, -1), termCrit);
+  }
+
+  // the refined corners still have to form a flat board
+  return (plausible(corners));
+}
+
+// check that the corners are consistent with a planar chessboard
+// corners: the corners
+// return: true if a homography from the board to the corners fits them closely
+bool BoardTracker::plausible(const std::vector<cv::Point2f> &corners)
+{
+  // the corner positions on the board plane
+  std::vector<cv::Point2f> boardPoints;
+  for (int i = 0; i < patternSize.height; i++)
+  {
+    for (int j = 0; j < patternSize.width; j++)
+    {
+      boardPoints.push_back(cv::Point2f((float)j, (float)i));
+    }
+  }
+
+  // fit a homography with least squares and measure how far the corners are from it
+  cv::Mat homography = cv::findHomography(boardPoints, corners, 0);
+  if (homography.empty())
+  {
+    return (false);
+  }
+  std::vector<cv::Point2f> fitted;
+  cv::perspectiveTransform(boardPoints, fitted, homography);
+
+  double sum = 0;
+  for (size_t i = 0; i < corners.size(); i++)
+  {
+    cv::Point2f diff = fitted[i] - corners[i];
+    sum += diff.x * diff.x + diff.y * diff.y;
+  }
+
+  return (std::sqrt(sum / corners.size()) < MAX_HOMOGRAPHY_ERROR);
+}
+
+// print the stats of a search level
+// name: the name of the level
+// stats: the stats of the level
+static void print_search_stats(const char *name, const SearchStats &stats)
+{
+  if (stats.attempts == 0)
+  {
+    return;
+  }
+
+  printf("  %-8s %6ld searches, %6ld found, %8.2f ms per search, %8.2f ms total\n", name, stats.attempts, stats.found,
+         1000.0 * stats.seconds / stats.attempts, 1000.0 * stats.seconds);
+}
+
+void BoardTracker::report()
+{
+  printf("board tracker: %ld detected, %ld tracked, %ld lost, %ld without a board\n", detected, tracked, lost, missed);
+  print_search_stats("roi", roiStats);
+  print_search_stats("pyramid", pyramidStats);
+  print_search_stats("full", fullStats);
+}
@@ -0,0 +1,90 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef BOARD_TRACKER_HPP
+#define BOARD_TRACKER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// the time spent in one level of the chessboard search
+struct SearchStats
+{
+  SearchStats() : attempts(0), found(0), seconds(0) {}
+
+  long attempts;
+  long found;
+  double seconds;
+};
+
+// finds the chessboard corners in a stream of frames
+// a full cv::findChessboardCorners search only runs when there is nothing to track, when tracking fails or
+// every redetectInterval frames. in between, the corners of the previous frame are propagated with pyramidal
+// Lucas-Kanade optical flow and refined with cv::cornerSubPix
+// the accelerated search tries a region of interest around where the board was last seen, padded by its
+// motion, then a downscaled pyramid level, and only then the full frame, all with CALIB_CB_FAST_CHECK
+class BoardTracker
+{
+public:
+  // patternSize: the number of inner corners per row and column
+  // redetectInterval: the number of frames after which a full detection runs anyway, 0 disables tracking
+  BoardTracker(cv::Size patternSize, int redetectInterval);
+
+  // find the refined chessboard corners in the next frame
+  // gray: the grayscale frame
+  // corners: the corners found, in the order of cv::findChessboardCorners
+  // return: true if the chessboard was found
+  bool find(const cv::Mat &gray, std::vector<cv::Point2f> &corners);
+
+  // choose between the accelerated search and a plain full-frame cv::findChessboardCorners
+  // accelerated: true to search a region of interest and a pyramid level before the full frame
+  void setAcceleratedSearch(bool accelerated);
+
+  // forget the previous frame, so that the next call runs a full detection
+  void reset();
+
+  // print how many frames were detected, tracked and lost, and the time spent in each search level
+  void report();
+
+private:
+  bool detect(const cv::Mat &gray, std::vector<cv::Point2f> &corners);
+  bool search(const cv::Mat &image, std::vector<cv::Point2f> &corners, int flags, SearchStats &stats);
+  bool searchRoi(const cv::Mat &gray, std::vector<cv::Point2f> &corners);
+  bool searchPyramid(const cv::Mat &gray, std::vector<cv::Point2f> &corners);
+  void updateMotion(bool found, const std::vector<cv::Point2f> &corners);
+  bool track(const cv::Mat &gray, std::vector<cv::Mat> &pyramid, std::vector<cv::Point2f> &corners);
+  bool plausible(const std::vector<cv::Point2f> &corners);
+
+  cv::Size patternSize;
+  int redetectInterval;
+  cv::Size winSize;
+  int maxLevel;
+  cv::TermCriteria termCrit;
+  cv::TermCriteria flowCrit;
+
+  // the state of the previous frame
+  bool hasPrevious;
+  int framesSinceDetection;
+  std::vector<cv::Mat> prevPyramid;
+  std::vector<cv::Point2f> prevCorners;
+
+  // where the board was last seen and how fast it moved, to predict the region of interest
+  bool accelerated;
+  int framesSinceSeen;
+  std::vector<cv::Point2f> lastCorners;
+  cv::Point2f velocity;
+
+  // counters
+  long detected;
+  long tracked;
+  long lost;
+  long missed;
+  SearchStats roiStats;
+  SearchStats pyramidStats;
+  SearchStats fullStats;
+};
+
+#endif
@@ -4,31 +4,123 @@
   CS 5330
 */
 
+#include <chrono>
+#include <climits>
+#include <ctime>
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include "util.hpp"
-#include "csv_util.h"
+#include "calibration.hpp"
+#include "calibration_store.hpp"
+#include "frame_source.hpp"
+#include "frame_writer.hpp"
+#include "profiler.hpp"
+
+// save a calibration to the store under the camera and the resolution, to the csv file, and its report
+// cameraId: the camera
+// imageSize: the resolution the camera was calibrated at
+// cameraMatrix: the camera matrix
+// distCoeffs: the distortion coefficients
+// error: the reprojection error
+// report: the errors of the views
+static void save_result(std::string cameraId, cv::Size imageSize, const cv::Mat &cameraMatrix,
+                        const cv::Mat &distCoeffs, double error, const CalibrationReport &report)
+{
+  save_calibration("../resources/data.csv", cameraMatrix, distCoeffs, error);
+  write_calibration_report("../resources/calibration_report.csv", report);
+
+  CalibrationRecord record;
+  record.cameraId = cameraId;
+  record.imageSize = imageSize;
+  record.cameraMatrix = cameraMatrix;
+  record.distCoeffs = distCoeffs;
+  record.error = error;
+  record.time = (int64_t)time(NULL);
+  if (save_calibration_record("../resources/calibration.bin", record) == 0)
+  {
+    printf("saved the calibration of camera %s at %dx%d to ../resources/calibration.bin\n", cameraId.c_str(),
+           imageSize.width, imageSize.height);
+  }
+}
 
 int main(int argc, char *argv[])
 {
-  // open the video device
-  cv::VideoCapture *vidCap;
-  vidCap = new cv::VideoCapture(0);
+  // read the frame options from the command line
+  FrameOptions options;
+  std::vector<std::string> args;
+  if (parse_frame_options(argc, argv, options, args) != 0)
+  {
+    return (-1);
+  }
+
+  // read the calibrate options, a plain argument is the frame source
+  //   --batch           calibrate once from all frames of the source, e.g. a directory of images or a video,
+  //                     instead of from the frames saved with 's'
+  //   --auto            save the frames that add a new pose or cover new parts of the image by themselves
+  //   --max-views <n>   calibrate from at most n views, picked to cover the poses and the image best, 0 for all
+  //   --solver <s>      the calibration solver, "opencv" or "schur"
+  //   --compare         in batch mode, calibrate with both solvers and compare their time and results
+  //   --camera-id <id>  the camera the calibration is stored under, with the resolution of the frames
+  bool batch = false;
+  bool compare = false;
+  CalibrationSolver solver = CALIBRATION_OPENCV;
+  bool autoCapture = false;
+  int maxViews = 40;
+  std::string cameraId = "default";
+  for (size_t i = 0; i < args.size(); i++)
+  {
+    if (args[i] == "--batch")
+    {
+      batch = true;
+    }
+    else if (args[i] == "--auto")
+    {
+      autoCapture = true;
+    }
+    else if (args[i] == "--max-views" && i + 1 < args.size())
+    {
+      maxViews = atoi(args[++i].c_str());
+    }
+    else if (args[i] == "--solver" && i + 1 < args.size())
+    {
+      if (parse_calibration_solver(args[++i], solver) != 0)
+      {
+        printf("error: unknown calibration solver %s.\n", args[i].c_str());
+        return (-1);
+      }
+    }
+    else if (args[i] == "--compare")
+    {
+      compare = true;
+    }
+    else if (args[i] == "--camera-id" && i + 1 < args.size())
+    {
+      cameraId = args[++i];
+    }
+    else if (args[i].compare(0, 2, "--") == 0)
+    {
+      printf("error: unknown option %s.\n", args[i].c_str());
+      return (-1);
+    }
+    else
+    {
+      options.source = args[i];
+    }
+  }
+
+  // open the frame source
+  FrameSource *source = open_frame_source(options.source);
 
   // error checking
-  if (!vidCap->isOpened())
+  if (source == NULL)
   {
-    std::cerr << "error: unable to open video device" << std::endl;
     return (-2);
   }
 
-  // get the width and height of frames in the video stream
-  cv::Size refS((int)vidCap->get(cv::CAP_PROP_FRAME_WIDTH),
-                (int)vidCap->get(cv::CAP_PROP_FRAME_HEIGHT));
-
   // the number of corners in the chessboard
   int cornersPerRow = 9;
   int cornersPerCol = 6;
+  cv::Size pattern_size = cv::Size(cornersPerRow, cornersPerCol);
 
   // create a vector of 3D points
   std::vector<cv::Vec3f> pointSet;
@@ -40,119 +132,196 @@ int main(int argc, char *argv[])
     }
   }
 
-  // the list of corner locations and 3D points
-  std::vector<std::vector<cv::Point2f>> cornerList;
-  std::vector<std::vector<cv::Vec3f>> pointList;
+  cv::Mat cameraMatrix;
+  cv::Mat distCoeffs;
+
+  // find the chessboard in all frames at once and calibrate from them
+  if (batch)
+  {
+    CalibrationViews views;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long frames = collect_calibration_views(source, pattern_size, pointSet, options.maxFrames, views);
+    delete source;
+    if (frames < 0)
+    {
+      return (-1);
+    }
+    printf("found the chessboard in %d of %ld frames in %.2f s\n", (int)views.corners.size(), frames,
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    // calibrate from the views that cover the poses and the image best
+    CalibrationViews selected;
+    select_views(views, maxViews, selected);
+
+    // calibrate with the other solver too, to compare with
+    CalibrationSolver other = solver == CALIBRATION_OPENCV ? CALIBRATION_SCHUR : CALIBRATION_OPENCV;
+    cv::Mat otherCamera, otherDist;
+    CalibrationReport otherReport;
+    double otherError = -1, otherSeconds = 0;
+    if (compare)
+    {
+      start = std::chrono::steady_clock::now();
+      otherError = calibrate_robust(selected, otherCamera, otherDist, false, other, otherReport);
+      otherSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // calibrate, then drop the outlier views and calibrate again
+    CalibrationReport report;
+    start = std::chrono::steady_clock::now();
+    double error = calibrate_robust(selected, cameraMatrix, distCoeffs, false, solver, report);
+    if (error < 0)
+    {
+      return (-1);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("calibrated from %d of %d images in %.2f s\n", (int)selected.corners.size(), (int)views.corners.size(),
+           seconds);
+
+    // print how far apart the solvers are
+    if (otherError >= 0)
+    {
+      printf("%-8s %10s %14s\n", "solver", "seconds", "rms error px");
+      printf("%-8s %10.3f %14.6f\n", solver == CALIBRATION_OPENCV ? "opencv" : "schur", seconds, error);
+      printf("%-8s %10.3f %14.6f\n", other == CALIBRATION_OPENCV ? "opencv" : "schur", otherSeconds, otherError);
+      printf("largest difference: %g px in the camera matrix, %g in the distortion coefficients\n",
+             cv::norm(cameraMatrix, otherCamera, cv::NORM_INF), cv::norm(distCoeffs, otherDist, cv::NORM_INF));
+    }
+    save_result(cameraId, views.imageSize, cameraMatrix, distCoeffs, error, report);
+
+    // print where the time went
+    print_profile();
+    if (profiling() && !options.traceFile.empty())
+    {
+      write_profile_trace(options.traceFile);
+    }
+
+    return (0);
+  }
+
+  // show the frames in a window, or process them as fast as possible when headless
+  FrameSink sink(options);
+
+  // the saved images are encoded on a background thread
+  FrameWriter writer;
+
+  // the corner locations and 3D points of the saved frames that are kept for the calibration
+  ViewSelector selector(source->size(), maxViews > 0 ? maxViews : INT_MAX);
+
+  // the frame of the last automatic capture, to leave the user time to move the chessboard
+  const long AUTO_INTERVAL = 15;
+  long lastCapture = -AUTO_INTERVAL;
+
+  // recalibrates in the background every time a frame is saved, so the preview never waits for it
+  CalibrationWorker worker(solver);
+  CalibrationResult result;
 
   // for all frames
   cv::Mat frame;
-  while (true)
+  cv::Mat display;
+  while (options.maxFrames < 0 || sink.frames() < options.maxFrames)
   {
-    // read a frame from the video stream
-    *vidCap >> frame;
-
-    // error checking
-    if (frame.empty())
+    // read a frame from the frame source
+    bool read;
+    {
+      ScopedTimer timer(PROFILE_CAPTURE);
+      read = source->read(frame);
+    }
+    if (!read)
     {
-      std::cerr << "error: frame is empty" << std::endl;
       break;
     }
 
+    // print and save the newest calibration the worker has finished
+    if (worker.poll(result) && result.error >= 0)
+    {
+      printf("calibrated from %d images in %.2f s%s\n", result.views, result.seconds,
+             result.warmStarted ? ", warm-started" : "");
+      save_result(cameraId, source->size(), result.cameraMatrix, result.distCoeffs, result.error, result.report);
+    }
+
     // convert the frame to grayscale
     cv::Mat gray;
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    {
+      ScopedTimer timer(PROFILE_GRAY);
+      cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
 
-    // find the chessboard corners
-    cv::Size pattern_size = cv::Size(cornersPerRow, cornersPerCol);
+    // find the refined chessboard corners
     std::vector<cv::Point2f> cornerSet;
-    cv::TermCriteria termCrit(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01);
-    bool found = cv::findChessboardCorners(gray, pattern_size, cornerSet);
+    bool found = find_calibration_corners(gray, pattern_size, cornerSet);
 
-    // if the corners are found
+    // if the corners are found, draw them on a copy of the frame, so the saved image stays clean for batch mode
+    frame.copyTo(display);
     if (found)
     {
-      // refine the corner locations
-      cv::cornerSubPix(gray, cornerSet, cv::Size(5, 5), cv::Size(-1, -1), termCrit);
-
-      // draw the corners on the frame
-      cv::drawChessboardCorners(frame, pattern_size, cornerSet, found);
+      cv::drawChessboardCorners(display, pattern_size, cornerSet, found);
     }
 
-    // display the frame
-    cv::imshow("Calibrate", frame);
-
-    // wait for a keypress
-    int key = cv::waitKey(1);
+    // display the frame and wait for a keypress
+    int key = sink.show("Calibrate", display);
     // if key is 'q', exit the loop and quit the program
     if (key == 'q')
     {
       break;
     }
+
     // if key is 's', store the corner locations and 3D points, and save the image
-    else if (key == 's')
+    // in auto mode, do the same for the frames the selector keeps on its own
+    bool save = key == 's';
+    bool autoSave = autoCapture && found && sink.frames() - lastCapture >= AUTO_INTERVAL;
+    if (!save && !autoSave)
     {
-      // error checking
-      if (!found)
-      {
-        std::cerr << "error: corners not found" << std::endl;
-        continue;
-      }
+      continue;
+    }
 
-      // store the corner locations and 3D points
-      cornerList.push_back(cornerSet);
-      pointList.push_back(pointSet);
+    // error checking
+    if (!found)
+    {
+      std::cerr << "error: corners not found" << std::endl;
+      continue;
+    }
 
-      // get filename and save the image
-      std::string filename = get_image_name("../resources/", "calibrate");
-      cv::imwrite(filename, frame);
+    // store the corner locations and 3D points, unless the selector finds them blurry or a near-duplicate
+    if (!selector.offer(cornerSet, pointSet, board_sharpness(gray, cornerSet), sink.frames(), save))
+    {
+      continue;
+    }
+    lastCapture = sink.frames();
+    const CalibrationViews &views = selector.views();
+    printf("kept %d images, covering %.0f%% of the frame\n", (int)views.corners.size(), 100 * selector.coverage());
 
-      // if the number of images is no less than 5, calibrate the camera
-      if (cornerList.size() >= 5)
-      {
-        // init the matrices
-        cv::Mat cameraMatrix = cv::Mat::eye(3, 3, CV_64FC1);
-        cameraMatrix.at<double>(0, 2) = refS.width / 2;
-        cameraMatrix.at<double>(1, 2) = refS.height / 2;
-        cv::Mat distCoeffs = cv::Mat::zeros(1, 14, CV_64FC1);
-
-        // print the number of images
-        printf("number of images used: %d\n", (int)cornerList.size());
-
-        // print the initial matrices
-        printf("initial camera matrix:\n");
-        print_mat(cameraMatrix);
-        printf("initial distortion coefficients:\n");
-        print_mat(distCoeffs);
-
-        // calibrate the camera assuming the pixel aspect ratio is 1 and radial distortion exists
-        std::vector<cv::Mat> rvecs, tvecs;
-        double reProjectionError = cv::calibrateCamera(pointList, cornerList, refS, cameraMatrix, distCoeffs, rvecs, tvecs, cv::CALIB_FIX_ASPECT_RATIO | cv::CALIB_RATIONAL_MODEL, termCrit);
-
-        // print the calibrated matrices
-        printf("calibrated camera matrix:\n");
-        print_mat(cameraMatrix);
-        printf("calibrated distortion coefficients:\n");
-        print_mat(distCoeffs);
-
-        // print the reprojection error
-        printf("reprojection error: %f\n\n", reProjectionError);
-
-        // store them in a vector
-        std::vector<double> calibration;
-        mat_to_vector(cameraMatrix, distCoeffs, calibration);
-
-        // save the calibration result to a csv file
-        append_object_data_csv("../resources/data.csv", "calibration", calibration, true);
-      }
-      else
-      {
-        printf("need at least 5 images for calibration. currently %d.\n", (int)cornerList.size());
-      }
+    // get filename and save the image
+    writer.snapshot(get_image_name("../resources/", "calibrate"), frame);
+
+    // if the number of images is no less than 5, calibrate the camera in the background
+    if (views.corners.size() >= 5)
+    {
+      worker.submit(views);
+    }
+    else
+    {
+      printf("need at least 5 images for calibration. currently %d.\n", (int)views.corners.size());
     }
   }
 
-  // free the video capture object
-  delete vidCap;
+  // save the calibration of all the saved frames before quitting
+  worker.wait();
+  if (worker.poll(result) && result.error >= 0)
+  {
+    printf("calibrated from %d images in %.2f s%s\n", result.views, result.seconds,
+           result.warmStarted ? ", warm-started" : "");
+    save_result(cameraId, source->size(), result.cameraMatrix, result.distCoeffs, result.error, result.report);
+  }
+  if (worker.merged() > 0)
+  {
+    printf("%ld calibrations were replaced by a newer one before they ran\n", worker.merged());
+  }
+
+  // print the frame rate
+  sink.report();
+
+  // free the frame source
+  delete source;
 
   return (0);
 }
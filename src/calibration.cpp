@@ -0,0 +1,776 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include "calibration.hpp"
+#include "calibration_solver.hpp"
+#include "csv_util.h"
+#include "profiler.hpp"
+#include "util.hpp"
+
+// the number of frames decoded per thread before their chessboards are searched for
+static const int FRAMES_PER_THREAD = 4;
+
+// the number of columns and rows of the grid over the image that measures how well the corners cover it
+static const int GRID_COLUMNS = 8;
+static const int GRID_ROWS = 6;
+
+// views less sharp than this fraction of the median, or of the sharpest live candidate, are too blurry to keep
+static const double SHARPNESS_RATIO = 0.5;
+
+// views closer than this to a kept view in pose, in units of the image diagonal, are near-duplicates
+static const double MIN_DIVERSITY = 0.05;
+
+// the weight of the coverage of rarely covered cells against the distance in pose
+static const double COVERAGE_WEIGHT = 0.5;
+
+// views with an rms error above this many times the median, and above the floor in pixels, are outliers
+static const double OUTLIER_RATIO = 3;
+static const double OUTLIER_FLOOR = 0.5;
+
+// the most times the outliers are dropped and the camera calibrated again
+static const int OUTLIER_ROUNDS = 3;
+
+// the termination criteria of the corner refinement and the calibration
+static const cv::TermCriteria TERM_CRITERIA(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01);
+
+int parse_calibration_solver(std::string name, CalibrationSolver &solver)
+{
+  if (name == "opencv")
+  {
+    solver = CALIBRATION_OPENCV;
+  }
+  else if (name == "schur")
+  {
+    solver = CALIBRATION_SCHUR;
+  }
+  else
+  {
+    return (-1);
+  }
+
+  return (0);
+}
+
+bool find_calibration_corners(const cv::Mat &gray, cv::Size patternSize, std::vector<cv::Point2f> &corners)
+{
+  {
+    ScopedTimer timer(PROFILE_DETECT);
+    if (!cv::findChessboardCorners(gray, patternSize, corners))
+    {
+      return (false);
+    }
+  }
+
+  // refine the corner locations
+  ScopedTimer timer(PROFILE_SUBPIX);
+  cv::cornerSubPix(gray, corners, cv::Size(5, 5), cv::Size(-1, -1), TERM_CRITERIA);
+
+  return (true);
+}
+
+double board_sharpness(const cv::Mat &gray, const std::vector<cv::Point2f> &corners)
+{
+  cv::Rect box = cv::boundingRect(corners) & cv::Rect(0, 0, gray.cols, gray.rows);
+  if (box.width < 3 || box.height < 3)
+  {
+    return (0);
+  }
+
+  cv::Mat laplacian;
+  cv::Laplacian(gray(box), laplacian, CV_32F);
+  cv::Scalar mean, deviation;
+  cv::meanStdDev(laplacian, mean, deviation);
+
+  return (deviation[0] * deviation[0]);
+}
+
+long collect_calibration_views(FrameSource *source, cv::Size patternSize, const std::vector<cv::Vec3f> &pointSet,
+                               long maxFrames, CalibrationViews &views)
+{
+  views = CalibrationViews();
+  int batchSize = std::max(1, cv::getNumThreads()) * FRAMES_PER_THREAD;
+  std::vector<cv::Mat> batch(batchSize);
+  std::vector<std::vector<cv::Point2f>> cornerSets(batchSize);
+  std::vector<char> found(batchSize);
+  std::vector<double> sharpness(batchSize);
+  long frames = 0;
+  bool more = true;
+  while (more)
+  {
+    // decode a batch of frames in order, the sources cannot be read from several threads
+    int count = 0;
+    while (count < batchSize && (maxFrames < 0 || frames + count < maxFrames))
+    {
+      bool read;
+      {
+        ScopedTimer timer(PROFILE_CAPTURE);
+        read = source->read(batch[count]);
+      }
+      if (!read)
+      {
+        more = false;
+        break;
+      }
+
+      // error checking, all views of a calibration have the same size
+      if (views.imageSize == cv::Size())
+      {
+        views.imageSize = batch[count].size();
+      }
+      if (batch[count].size() != views.imageSize)
+      {
+        printf("error: frame %ld is %dx%d instead of %dx%d.\n", frames + count, batch[count].cols, batch[count].rows,
+               views.imageSize.width, views.imageSize.height);
+        return (-1);
+      }
+      count++;
+    }
+    if (count < batchSize)
+    {
+      more = false;
+    }
+
+    // search for the chessboards of the batch in parallel, each frame by one thread
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+    {
+      cv::Mat gray;
+      for (int i = range.start; i < range.end; i++)
+      {
+        if (batch[i].channels() == 1)
+        {
+          gray = batch[i];
+        }
+        else
+        {
+          ScopedTimer timer(PROFILE_GRAY);
+          cv::cvtColor(batch[i], gray, cv::COLOR_BGR2GRAY);
+        }
+        found[i] = find_calibration_corners(gray, patternSize, cornerSets[i]);
+        sharpness[i] = found[i] ? board_sharpness(gray, cornerSets[i]) : 0;
+      }
+    });
+
+    // keep the views in the order of the frames
+    for (int i = 0; i < count; i++)
+    {
+      if (found[i])
+      {
+        views.corners.push_back(cornerSets[i]);
+        views.points.push_back(pointSet);
+        views.frames.push_back(frames + i);
+        views.sharpness.push_back(sharpness[i]);
+      }
+    }
+    frames += count;
+  }
+
+  return (frames);
+}
+
+// describe the pose of a view by the outer corners of the chessboard, relative to the center of the image
+// and in units of its diagonal, so that views of similar poses have close descriptors
+// corners: the corners of the chessboard
+// points: the 3D points of the corners
+// imageSize: the size of the image
+// descriptor: the 8 coordinates of the outer corners
+static void pose_descriptor(const std::vector<cv::Point2f> &corners, const std::vector<cv::Vec3f> &points,
+                            cv::Size imageSize, std::vector<float> &descriptor)
+{
+  // the outer corners are the ones with the smallest and largest x and y on the chessboard
+  int outer[4] = {0, 0, 0, 0};
+  for (size_t i = 1; i < points.size(); i++)
+  {
+    const cv::Vec3f &p = points[i];
+    const cv::Vec3f *q[4] = {&points[outer[0]], &points[outer[1]], &points[outer[2]], &points[outer[3]]};
+    if (p[0] - p[1] < (*q[0])[0] - (*q[0])[1])
+    {
+      outer[0] = (int)i;
+    }
+    if (p[0] + p[1] > (*q[1])[0] + (*q[1])[1])
+    {
+      outer[1] = (int)i;
+    }
+    if (p[0] - p[1] > (*q[2])[0] - (*q[2])[1])
+    {
+      outer[2] = (int)i;
+    }
+    if (p[0] + p[1] < (*q[3])[0] + (*q[3])[1])
+    {
+      outer[3] = (int)i;
+    }
+  }
+
+  float diagonal = (float)std::sqrt((double)imageSize.width * imageSize.width + (double)imageSize.height * imageSize.height);
+  descriptor.resize(8);
+  for (int k = 0; k < 4; k++)
+  {
+    descriptor[k * 2] = (corners[outer[k]].x - imageSize.width / 2.0f) / diagonal;
+    descriptor[k * 2 + 1] = (corners[outer[k]].y - imageSize.height / 2.0f) / diagonal;
+  }
+}
+
+// the distance between two pose descriptors
+static double descriptor_distance(const std::vector<float> &a, const std::vector<float> &b)
+{
+  double sum = 0;
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    sum += (a[i] - b[i]) * (a[i] - b[i]);
+  }
+
+  return (std::sqrt(sum));
+}
+
+// find the cell of the coverage grid a point is in
+static int grid_cell(const cv::Point2f &point, cv::Size imageSize)
+{
+  int column = std::min(GRID_COLUMNS - 1, std::max(0, (int)(point.x * GRID_COLUMNS / imageSize.width)));
+  int row = std::min(GRID_ROWS - 1, std::max(0, (int)(point.y * GRID_ROWS / imageSize.height)));
+
+  return (row * GRID_COLUMNS + column);
+}
+
+// append a view of a set to another set
+static void append_view(const CalibrationViews &from, size_t i, CalibrationViews &to)
+{
+  to.corners.push_back(from.corners[i]);
+  to.points.push_back(from.points[i]);
+  to.frames.push_back(i < from.frames.size() ? from.frames[i] : (long)i);
+  to.sharpness.push_back(i < from.sharpness.size() ? from.sharpness[i] : 0);
+}
+
+void select_views(const CalibrationViews &views, int maxViews, CalibrationViews &selected)
+{
+  size_t count = views.corners.size();
+  selected = CalibrationViews();
+  selected.imageSize = views.imageSize;
+  if (maxViews <= 0 || count <= (size_t)maxViews)
+  {
+    selected = views;
+    return;
+  }
+
+  // skip the views much blurrier than the median
+  std::vector<char> eligible(count, 1);
+  if (views.sharpness.size() == count)
+  {
+    std::vector<double> sorted = views.sharpness;
+    std::nth_element(sorted.begin(), sorted.begin() + count / 2, sorted.end());
+    double threshold = SHARPNESS_RATIO * sorted[count / 2];
+    for (size_t i = 0; i < count; i++)
+    {
+      eligible[i] = views.sharpness[i] >= threshold;
+    }
+  }
+
+  std::vector<std::vector<float>> descriptors(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    pose_descriptor(views.corners[i], views.points[i], views.imageSize, descriptors[i]);
+  }
+
+  // start from the sharpest view, and keep the distance of every view to the closest picked one
+  std::vector<double> nearest(count, 1e30);
+  std::vector<int> cells(GRID_COLUMNS * GRID_ROWS, 0);
+  int next = -1;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (eligible[i] && (next < 0 || (views.sharpness.size() == count && views.sharpness[i] > views.sharpness[next])))
+    {
+      next = (int)i;
+    }
+  }
+  while (next >= 0 && (int)selected.corners.size() < maxViews)
+  {
+    append_view(views, next, selected);
+    eligible[next] = 0;
+    for (size_t j = 0; j < views.corners[next].size(); j++)
+    {
+      cells[grid_cell(views.corners[next][j], views.imageSize)]++;
+    }
+
+    // pick the view that adds the most, until only near-duplicates are left
+    double best = -1;
+    int picked = next;
+    next = -1;
+    for (size_t i = 0; i < count; i++)
+    {
+      if (!eligible[i])
+      {
+        continue;
+      }
+      nearest[i] = std::min(nearest[i], descriptor_distance(descriptors[i], descriptors[picked]));
+      if (nearest[i] < MIN_DIVERSITY)
+      {
+        continue;
+      }
+
+      double gain = 0;
+      for (size_t j = 0; j < views.corners[i].size(); j++)
+      {
+        gain += 1.0 / (1 + cells[grid_cell(views.corners[i][j], views.imageSize)]);
+      }
+      double score = nearest[i] + COVERAGE_WEIGHT * gain / views.corners[i].size();
+      if (score > best)
+      {
+        best = score;
+        next = (int)i;
+      }
+    }
+  }
+}
+
+ViewSelector::ViewSelector(cv::Size imageSize, int maxViews)
+{
+  this->maxViews = std::max(1, maxViews);
+  maxSharpness = 0;
+  kept.imageSize = imageSize;
+  cells.assign(GRID_COLUMNS * GRID_ROWS, 0);
+}
+
+bool ViewSelector::offer(const std::vector<cv::Point2f> &corners, const std::vector<cv::Vec3f> &pointSet,
+                         double sharpness, long frame, bool force)
+{
+  // skip blurry views
+  maxSharpness = std::max(maxSharpness, sharpness);
+  if (!force && sharpness < SHARPNESS_RATIO * maxSharpness)
+  {
+    return (false);
+  }
+
+  std::vector<float> descriptor;
+  pose_descriptor(corners, pointSet, kept.imageSize, descriptor);
+
+  // the slot the view goes to, the end while there is room, or else the kept view that adds the least
+  int slot = (int)kept.corners.size();
+  if (slot >= maxViews)
+  {
+    double least = 1e30;
+    for (int i = 0; i < (int)kept.corners.size(); i++)
+    {
+      double score = nearest(descriptors[i], i) + COVERAGE_WEIGHT * coverageGain(kept.corners[i], i);
+      if (score < least)
+      {
+        least = score;
+        slot = i;
+      }
+    }
+
+    double distance = nearest(descriptor, slot);
+    if (!force && (distance < MIN_DIVERSITY || distance + COVERAGE_WEIGHT * coverageGain(corners, -1) <= least))
+    {
+      return (false);
+    }
+    countCells(kept.corners[slot], -1);
+  }
+  else if (!force && nearest(descriptor, -1) < MIN_DIVERSITY)
+  {
+    return (false);
+  }
+
+  // keep the view
+  if (slot == (int)kept.corners.size())
+  {
+    kept.corners.push_back(corners);
+    kept.points.push_back(pointSet);
+    kept.frames.push_back(frame);
+    kept.sharpness.push_back(sharpness);
+    descriptors.push_back(descriptor);
+  }
+  else
+  {
+    kept.corners[slot] = corners;
+    kept.points[slot] = pointSet;
+    kept.frames[slot] = frame;
+    kept.sharpness[slot] = sharpness;
+    descriptors[slot] = descriptor;
+  }
+  countCells(corners, 1);
+
+  return (true);
+}
+
+const CalibrationViews &ViewSelector::views() const
+{
+  return (kept);
+}
+
+double ViewSelector::coverage() const
+{
+  int covered = 0;
+  for (size_t i = 0; i < cells.size(); i++)
+  {
+    covered += cells[i] > 0;
+  }
+
+  return ((double)covered / cells.size());
+}
+
+// the distance in pose to the closest kept view
+// descriptor: the pose descriptor
+// skip: a kept view to leave out, -1 for none
+// return: the distance, large if there is no other view
+double ViewSelector::nearest(const std::vector<float> &descriptor, int skip) const
+{
+  double distance = 1e30;
+  for (int i = 0; i < (int)descriptors.size(); i++)
+  {
+    if (i != skip)
+    {
+      distance = std::min(distance, descriptor_distance(descriptor, descriptors[i]));
+    }
+  }
+
+  return (std::min(distance, 1.0));
+}
+
+// the average of how rare the cells of the corners are, 1 for cells no other kept view covers
+// corners: the corners
+// self: the kept view the corners belong to, -1 for a candidate
+// return: the gain
+double ViewSelector::coverageGain(const std::vector<cv::Point2f> &corners, int self) const
+{
+  double gain = 0;
+  for (size_t j = 0; j < corners.size(); j++)
+  {
+    gain += 1.0 / (1 + cells[grid_cell(corners[j], kept.imageSize)] - (self >= 0 ? 1 : 0));
+  }
+
+  return (corners.empty() ? 0 : gain / corners.size());
+}
+
+// add or remove the corners of a view from the grid
+void ViewSelector::countCells(const std::vector<cv::Point2f> &corners, int delta)
+{
+  for (size_t j = 0; j < corners.size(); j++)
+  {
+    cells[grid_cell(corners[j], kept.imageSize)] += delta;
+  }
+}
+
+double calibrate_views(const CalibrationViews &views, cv::Mat &cameraMatrix, cv::Mat &distCoeffs, bool warmStart,
+                       CalibrationSolver solver, std::vector<cv::Vec3d> *rvecs, std::vector<cv::Vec3d> *tvecs)
+{
+  // error checking
+  if (views.corners.size() < 5)
+  {
+    printf("need at least 5 images for calibration. currently %d.\n", (int)views.corners.size());
+    return (-1);
+  }
+
+  // init the matrices, unless starting from the previous calibration
+  int flags = cv::CALIB_FIX_ASPECT_RATIO | cv::CALIB_RATIONAL_MODEL;
+  if (warmStart && !cameraMatrix.empty() && !distCoeffs.empty())
+  {
+    flags |= cv::CALIB_USE_INTRINSIC_GUESS;
+  }
+  else
+  {
+    cameraMatrix = cv::Mat::eye(3, 3, CV_64FC1);
+    cameraMatrix.at<double>(0, 2) = views.imageSize.width / 2;
+    cameraMatrix.at<double>(1, 2) = views.imageSize.height / 2;
+    distCoeffs = cv::Mat::zeros(1, 14, CV_64FC1);
+  }
+
+  // the same model with the solver that scales to many views
+  std::vector<cv::Vec3d> rotations, translations;
+  double error;
+  if (solver == CALIBRATION_SCHUR)
+  {
+    error = solve_calibration(views.points, views.corners, views.imageSize, cameraMatrix, distCoeffs, rotations,
+                              translations, (flags & cv::CALIB_USE_INTRINSIC_GUESS) != 0, TERM_CRITERIA);
+  }
+  else
+  {
+    // calibrate the camera assuming the pixel aspect ratio is 1 and radial distortion exists
+    std::vector<cv::Mat> rotationMats, translationMats;
+    error = cv::calibrateCamera(views.points, views.corners, views.imageSize, cameraMatrix, distCoeffs, rotationMats,
+                                translationMats, flags, TERM_CRITERIA);
+    for (size_t i = 0; i < rotationMats.size(); i++)
+    {
+      rotations.push_back(rotationMats[i]);
+      translations.push_back(translationMats[i]);
+    }
+  }
+
+  if (rvecs != NULL)
+  {
+    rvecs->swap(rotations);
+  }
+  if (tvecs != NULL)
+  {
+    tvecs->swap(translations);
+  }
+
+  return (error);
+}
+
+void reprojection_errors(const CalibrationViews &views, const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs,
+                         const std::vector<cv::Vec3d> &rvecs, const std::vector<cv::Vec3d> &tvecs,
+                         std::vector<double> &viewErrors, std::vector<std::vector<float>> &cornerErrors)
+{
+  // every view is projected into its own slots, one view per task
+  int count = (int)std::min(views.corners.size(), rvecs.size());
+  viewErrors.assign(count, 0);
+  cornerErrors.resize(count);
+  cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+  {
+    std::vector<cv::Point2f> projected;
+    for (int i = range.start; i < range.end; i++)
+    {
+      const std::vector<cv::Point2f> &corners = views.corners[i];
+      cv::projectPoints(views.points[i], rvecs[i], tvecs[i], cameraMatrix, distCoeffs, projected);
+      std::vector<float> &errors = cornerErrors[i];
+      errors.resize(corners.size());
+      double sum = 0;
+      for (size_t j = 0; j < corners.size(); j++)
+      {
+        cv::Point2f d = projected[j] - corners[j];
+        errors[j] = std::sqrt(d.x * d.x + d.y * d.y);
+        sum += (double)d.x * d.x + (double)d.y * d.y;
+      }
+      viewErrors[i] = corners.empty() ? 0 : std::sqrt(sum / corners.size());
+    }
+  });
+}
+
+double calibrate_robust(const CalibrationViews &views, cv::Mat &cameraMatrix, cv::Mat &distCoeffs, bool warmStart,
+                        CalibrationSolver solver, CalibrationReport &report)
+{
+  ScopedTimer timer(PROFILE_CALIBRATE);
+  size_t count = views.corners.size();
+  report = CalibrationReport();
+  report.viewErrors.assign(count, 0);
+  report.maxErrors.assign(count, 0);
+  report.worstCorners.assign(count, -1);
+  report.rejected.assign(count, 0);
+  for (size_t i = 0; i < count; i++)
+  {
+    report.frames.push_back(i < views.frames.size() ? views.frames[i] : (long)i);
+  }
+
+  // the views still kept, and their indices in the views
+  CalibrationViews kept = views;
+  std::vector<size_t> indices(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    indices[i] = i;
+  }
+
+  std::vector<cv::Vec3d> rvecs, tvecs;
+  double error = calibrate_views(kept, cameraMatrix, distCoeffs, warmStart, solver, &rvecs, &tvecs);
+  report.rounds = 1;
+  while (error >= 0)
+  {
+    // record the errors of the kept views
+    std::vector<double> viewErrors;
+    std::vector<std::vector<float>> cornerErrors;
+    reprojection_errors(kept, cameraMatrix, distCoeffs, rvecs, tvecs, viewErrors, cornerErrors);
+    for (size_t i = 0; i < viewErrors.size(); i++)
+    {
+      const std::vector<float> &errors = cornerErrors[i];
+      int worst = errors.empty() ? -1 : (int)(std::max_element(errors.begin(), errors.end()) - errors.begin());
+      report.viewErrors[indices[i]] = viewErrors[i];
+      report.maxErrors[indices[i]] = worst < 0 ? 0 : errors[worst];
+      report.worstCorners[indices[i]] = worst;
+    }
+    if (report.rounds > OUTLIER_ROUNDS)
+    {
+      break;
+    }
+
+    // the views far above the median are outliers, as long as enough views are left to calibrate from
+    std::vector<double> sorted = viewErrors;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    double threshold = std::max(OUTLIER_RATIO * sorted[sorted.size() / 2], OUTLIER_FLOOR);
+    CalibrationViews inliers;
+    inliers.imageSize = kept.imageSize;
+    std::vector<size_t> inlierIndices;
+    for (size_t i = 0; i < viewErrors.size(); i++)
+    {
+      if (viewErrors[i] <= threshold)
+      {
+        append_view(kept, i, inliers);
+        inlierIndices.push_back(indices[i]);
+      }
+    }
+    if (inliers.corners.size() == kept.corners.size() || inliers.corners.size() < 5)
+    {
+      break;
+    }
+    for (size_t i = 0; i < viewErrors.size(); i++)
+    {
+      if (viewErrors[i] > threshold)
+      {
+        report.rejected[indices[i]] = 1;
+      }
+    }
+
+    // calibrate again from the inliers, starting from where the last calibration ended
+    std::swap(kept, inliers);
+    std::swap(indices, inlierIndices);
+    error = calibrate_views(kept, cameraMatrix, distCoeffs, true, solver, &rvecs, &tvecs);
+    report.rounds++;
+  }
+
+  return (error);
+}
+
+int write_calibration_report(std::string filename, const CalibrationReport &report)
+{
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == NULL)
+  {
+    printf("error: could not open %s.\n", filename.c_str());
+    return (-1);
+  }
+
+  // one line per view, with the errors in pixels
+  int rejected = 0;
+  fprintf(file, "frame,rms,max,worst corner,kept\n");
+  for (size_t i = 0; i < report.frames.size(); i++)
+  {
+    fprintf(file, "%ld,%.4f,%.4f,%d,%d\n", report.frames[i], report.viewErrors[i], report.maxErrors[i],
+            report.worstCorners[i], report.rejected[i] ? 0 : 1);
+    rejected += report.rejected[i] ? 1 : 0;
+  }
+  fclose(file);
+
+  printf("dropped %d of %d views as outliers in %d rounds, errors saved to %s\n", rejected, (int)report.frames.size(),
+         report.rounds, filename.c_str());
+
+  return (0);
+}
+
+void save_calibration(std::string filename, const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, double error)
+{
+  // print the calibrated matrices
+  printf("calibrated camera matrix:\n");
+  print_mat(cameraMatrix);
+  printf("calibrated distortion coefficients:\n");
+  print_mat(distCoeffs);
+
+  // print the reprojection error
+  printf("reprojection error: %f\n\n", error);
+
+  // store them in a vector
+  std::vector<double> calibration;
+  mat_to_vector(cameraMatrix, distCoeffs, calibration);
+
+  // save the calibration result to a csv file
+  append_object_data_csv(filename, "calibration", calibration, true);
+}
+
+CalibrationWorker::CalibrationWorker(CalibrationSolver solver)
+{
+  this->solver = solver;
+  stopping = false;
+  busy = false;
+  hasRequest = false;
+  hasResult = false;
+  mergedCount = 0;
+  thread = std::thread(&CalibrationWorker::run, this);
+}
+
+CalibrationWorker::~CalibrationWorker()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+void CalibrationWorker::submit(const CalibrationViews &views)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hasRequest)
+    {
+      mergedCount++;
+    }
+    request = views;
+    hasRequest = true;
+  }
+  wake.notify_one();
+}
+
+bool CalibrationWorker::poll(CalibrationResult &calibration)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!hasResult)
+  {
+    return (false);
+  }
+  calibration = result;
+  hasResult = false;
+
+  return (true);
+}
+
+void CalibrationWorker::wait()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  idle.wait(lock, [this]() { return (!hasRequest && !busy); });
+}
+
+long CalibrationWorker::merged()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return (mergedCount);
+}
+
+// take the requests one at a time, always the newest one, until stopped
+void CalibrationWorker::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;)
+  {
+    wake.wait(lock, [this]() { return (stopping || hasRequest); });
+    if (stopping)
+    {
+      break;
+    }
+
+    // take the request out, so that a newer one can replace nothing but itself while this one runs
+    CalibrationViews views;
+    std::swap(views, request);
+    hasRequest = false;
+    busy = true;
+    lock.unlock();
+
+    // warm-start from the last good calibration, the matrices are copied so a failed run does not spoil them
+    CalibrationResult calibration;
+    calibration.views = (int)views.corners.size();
+    calibration.warmStarted = !guessCamera.empty();
+    calibration.cameraMatrix = guessCamera.clone();
+    calibration.distCoeffs = guessDist.clone();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    calibration.error = calibrate_robust(views, calibration.cameraMatrix, calibration.distCoeffs,
+                                         calibration.warmStarted, solver, calibration.report);
+    calibration.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (calibration.error >= 0)
+    {
+      guessCamera = calibration.cameraMatrix.clone();
+      guessDist = calibration.distCoeffs.clone();
+    }
+
+    lock.lock();
+    result = calibration;
+    hasResult = true;
+    busy = false;
+    if (!hasRequest)
+    {
+      idle.notify_all();
+    }
+  }
+}
@@ -0,0 +1,250 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef CALIBRATION_HPP
+#define CALIBRATION_HPP
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_source.hpp"
+
+// the solver that calibrates the camera
+enum CalibrationSolver
+{
+  CALIBRATION_OPENCV, // cv::calibrateCamera, a dense Levenberg-Marquardt solver
+  CALIBRATION_SCHUR,  // solve_calibration, which eliminates the extrinsics with the Schur complement
+};
+
+// parse a calibration solver from its name
+// name: "opencv" or "schur"
+// solver: the parsed solver
+// return: 0 if successful, -1 if the name is unknown
+int parse_calibration_solver(std::string name, CalibrationSolver &solver);
+
+// the chessboard corners found in a set of calibration images, and the 3D points they belong to
+struct CalibrationViews
+{
+  std::vector<std::vector<cv::Point2f>> corners;
+  std::vector<std::vector<cv::Vec3f>> points;
+
+  // the index of the frame of the source each view was found in
+  std::vector<long> frames;
+
+  // the sharpness of the chessboard in each view, see board_sharpness
+  std::vector<double> sharpness;
+
+  // the size of the images
+  cv::Size imageSize;
+};
+
+// find the chessboard corners in a grayscale image and refine them to subpixel accuracy
+// gray: the grayscale image
+// patternSize: the number of inner corners per row and column
+// corners: the refined corners
+// return: true if the chessboard was found
+bool find_calibration_corners(const cv::Mat &gray, cv::Size patternSize, std::vector<cv::Point2f> &corners);
+
+// measure how sharp the chessboard is in an image, as the variance of the Laplacian over its bounding box,
+// which drops with motion blur and defocus
+// gray: the grayscale image
+// corners: the corners of the chessboard
+// return: the sharpness
+double board_sharpness(const cv::Mat &gray, const std::vector<cv::Point2f> &corners);
+
+// read every frame of a source, e.g. a directory of images or a video, and find the chessboard in them
+// the frames are decoded in order into batches of a few per thread, and the chessboards of a batch are searched
+// for in parallel, so that memory stays bounded however many frames the source has
+// source: the frame source
+// patternSize: the number of inner corners per row and column
+// pointSet: the 3D points of the corners
+// maxFrames: the number of frames to read, -1 for all
+// views: the views with a chessboard
+// return: the number of frames read, or -1 if error
+long collect_calibration_views(FrameSource *source, cv::Size patternSize, const std::vector<cv::Vec3f> &pointSet,
+                               long maxFrames, CalibrationViews &views);
+
+// pick a bounded subset of views that covers the poses and the image best
+// the blurry views, less than half as sharp as the median, are skipped. starting from the sharpest view, the view
+// that is farthest from the picked ones in pose, plus a bonus for corners in rarely covered parts of the image,
+// is picked next, until the bound is reached or only near-duplicates of picked views are left
+// views: all the views
+// maxViews: the largest number of views to pick, 0 for all
+// selected: the picked views, in the order they were picked
+void select_views(const CalibrationViews &views, int maxViews, CalibrationViews &selected);
+
+// keeps a bounded set of the most informative views from a stream of candidates, for the live calibration
+// a candidate is scored by how far its pose is from the kept views, measured on the outer corners of the chessboard
+// in normalized image coordinates, by how many of its corners fall into rarely covered cells of a grid over the
+// image, and by its sharpness against the sharpest candidate so far. once the set is full, a candidate replaces
+// the kept view that adds the least, if it adds more than that view
+class ViewSelector
+{
+public:
+  // imageSize: the size of the images
+  // maxViews: the largest number of views to keep
+  ViewSelector(cv::Size imageSize, int maxViews);
+
+  // offer a candidate view
+  // corners: the corners of the chessboard
+  // pointSet: the 3D points of the corners
+  // sharpness: the sharpness of the chessboard, see board_sharpness
+  // frame: the index of the frame
+  // force: keep the view even if it is blurry or a near-duplicate, replacing the view that adds the least if full
+  // return: true if the view was kept
+  bool offer(const std::vector<cv::Point2f> &corners, const std::vector<cv::Vec3f> &pointSet, double sharpness,
+             long frame, bool force = false);
+
+  // return: the kept views
+  const CalibrationViews &views() const;
+
+  // return: the fraction of the cells of the grid over the image that have a corner of a kept view
+  double coverage() const;
+
+private:
+  double nearest(const std::vector<float> &descriptor, int skip) const;
+  double coverageGain(const std::vector<cv::Point2f> &corners, int self) const;
+  void countCells(const std::vector<cv::Point2f> &corners, int delta);
+
+  int maxViews;
+  double maxSharpness;
+  CalibrationViews kept;
+  std::vector<std::vector<float>> descriptors;
+
+  // the number of kept corners in each cell of the grid
+  std::vector<int> cells;
+};
+
+// calibrate the camera from the views, assuming the pixel aspect ratio is 1 and the rational distortion model
+// views: the views with a chessboard, at least 5
+// cameraMatrix: the calibrated camera matrix, and the initial guess when warm-starting
+// distCoeffs: the calibrated distortion coefficients, and the initial guess when warm-starting
+// warmStart: whether to start from the given camera matrix and distortion coefficients instead of from scratch
+// solver: the solver to use
+// rvecs, tvecs: if not NULL, the poses of the views
+// return: the reprojection error, or -1 if error
+double calibrate_views(const CalibrationViews &views, cv::Mat &cameraMatrix, cv::Mat &distCoeffs, bool warmStart = false,
+                       CalibrationSolver solver = CALIBRATION_OPENCV, std::vector<cv::Vec3d> *rvecs = NULL,
+                       std::vector<cv::Vec3d> *tvecs = NULL);
+
+// find the reprojection error of every corner of every view, the views in parallel
+// views: the views
+// cameraMatrix: the camera matrix
+// distCoeffs: the distortion coefficients
+// rvecs, tvecs: the poses of the views
+// viewErrors: the rms error of every view in pixels
+// cornerErrors: the error of every corner of every view in pixels
+void reprojection_errors(const CalibrationViews &views, const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs,
+                         const std::vector<cv::Vec3d> &rvecs, const std::vector<cv::Vec3d> &tvecs,
+                         std::vector<double> &viewErrors, std::vector<std::vector<float>> &cornerErrors);
+
+// the reprojection errors of the views of a calibration, and which views were dropped as outliers
+struct CalibrationReport
+{
+  CalibrationReport() : rounds(0) {}
+
+  std::vector<long> frames;       // the frame each view was found in
+  std::vector<double> viewErrors; // the rms error of every view in pixels
+  std::vector<double> maxErrors;  // the largest error of a corner of every view in pixels
+  std::vector<int> worstCorners;  // the index of that corner
+  std::vector<char> rejected;     // whether the view was dropped as an outlier
+  int rounds;                     // the number of times the solver ran
+};
+
+// calibrate the camera, then drop the views whose rms error is far above the median and calibrate again,
+// warm-started, until no view is an outlier, so that a few bad views neither slow the solver down nor skew the result
+// views: the views with a chessboard, at least 5
+// cameraMatrix: the calibrated camera matrix, and the initial guess when warm-starting
+// distCoeffs: the calibrated distortion coefficients, and the initial guess when warm-starting
+// warmStart: whether to start from the given camera matrix and distortion coefficients instead of from scratch
+// solver: the solver to use
+// report: the errors of every view, from the last calibration the view was part of
+// return: the reprojection error of the kept views, or -1 if error
+double calibrate_robust(const CalibrationViews &views, cv::Mat &cameraMatrix, cv::Mat &distCoeffs, bool warmStart,
+                        CalibrationSolver solver, CalibrationReport &report);
+
+// write the errors of every view to a csv file, one line per view, and print a summary
+// filename: the csv file
+// report: the errors
+// return: 0 if successful, -1 if error
+int write_calibration_report(std::string filename, const CalibrationReport &report);
+
+// print a calibration and save it to a csv file
+// filename: the csv file to save the calibration to
+// cameraMatrix: the camera matrix
+// distCoeffs: the distortion coefficients
+// error: the reprojection error
+void save_calibration(std::string filename, const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, double error);
+
+// the result of a calibration run by a CalibrationWorker
+struct CalibrationResult
+{
+  CalibrationResult() : error(-1), views(0), seconds(0), warmStarted(false) {}
+
+  cv::Mat cameraMatrix;
+  cv::Mat distCoeffs;
+  double error;     // the reprojection error, or -1 if the calibration failed
+  int views;        // the number of views calibrated from
+  double seconds;   // the time the calibration took
+  bool warmStarted; // whether it started from the previous result
+  CalibrationReport report;
+};
+
+// calibrates the camera on a background thread, so that the thread showing the frames never waits for it
+// a request submitted while another is waiting replaces it, since the views only grow and the newer request
+// has all of them. a request submitted while one is running waits for it, and is then warm-started from its
+// result with CALIB_USE_INTRINSIC_GUESS, which takes fewer iterations than starting from scratch
+class CalibrationWorker
+{
+public:
+  // solver: the solver to use
+  CalibrationWorker(CalibrationSolver solver = CALIBRATION_OPENCV);
+
+  // stop the thread, dropping a waiting request
+  ~CalibrationWorker();
+
+  // request a calibration from a copy of the views
+  // views: the views with a chessboard
+  void submit(const CalibrationViews &views);
+
+  // take the newest finished calibration, if there is one not taken yet
+  // result: the calibration
+  // return: true if there was a calibration
+  bool poll(CalibrationResult &result);
+
+  // wait until the submitted requests are done
+  void wait();
+
+  // return: the number of requests replaced by a newer one before they ran
+  long merged();
+
+private:
+  void run();
+
+  CalibrationSolver solver;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  bool stopping;
+  bool busy;
+
+  // the waiting request, and the newest finished result
+  bool hasRequest;
+  CalibrationViews request;
+  bool hasResult;
+  CalibrationResult result;
+  long mergedCount;
+
+  // the last good calibration to warm-start from, only used by the thread
+  cv::Mat guessCamera;
+  cv::Mat guessDist;
+};
+
+#endif
@@ -0,0 +1,396 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include "calibration_solver.hpp"
+
+// the number of intrinsics solved for: the focal length, the principal point and 8 distortion coefficients
+static const int INTRINSICS = 11;
+
+// the number of extrinsics of a view: the rotation vector and the translation vector
+static const int EXTRINSICS = 6;
+
+// the number of parameters a corner depends on
+static const int PARAMETERS = INTRINSICS + EXTRINSICS;
+
+// the number of distortion coefficients of the rational model, and of the coefficients returned
+static const int RATIONAL_COEFFICIENTS = 8;
+static const int DISTORTION_COEFFICIENTS = 14;
+
+// the normal equations of one view, J^T J and J^T r over its corners with the intrinsics first,
+// and the sum of its squared residuals
+struct ViewSystem
+{
+  cv::Matx<double, PARAMETERS, PARAMETERS> hessian;
+  cv::Matx<double, PARAMETERS, 1> gradient;
+  double error;
+
+  // the inverse of the damped extrinsics block, and the product of the intrinsics-extrinsics block with it
+  cv::Matx<double, EXTRINSICS, EXTRINSICS> inverse;
+  cv::Matx<double, INTRINSICS, EXTRINSICS> product;
+};
+
+// the parameters being solved for
+struct CalibrationParameters
+{
+  // fx, cx, cy, k1, k2, p1, p2, k3, k4, k5, k6
+  double intrinsics[INTRINSICS];
+  double aspect;
+  std::vector<cv::Vec3d> rvecs, tvecs;
+};
+
+// project the corners of a view and find the normal equations of its residuals
+// objectPoints: the 3D points of the corners
+// imagePoints: the corners found in the view
+// parameters: the parameters
+// view: the index of the view
+// system: the normal equations
+static void evaluate_view(const std::vector<cv::Vec3f> &objectPoints, const std::vector<cv::Point2f> &imagePoints,
+                          const CalibrationParameters &parameters, int view, ViewSystem &system)
+{
+  const double *k = parameters.intrinsics;
+  cv::Matx33d camera(k[0], 0, k[1], 0, k[0] * parameters.aspect, k[2], 0, 0, 1);
+  cv::Mat distortion(1, RATIONAL_COEFFICIENTS, CV_64F);
+  for (int i = 0; i < RATIONAL_COEFFICIENTS; i++)
+  {
+    distortion.at<double>(0, i) = k[3 + i];
+  }
+
+  // the jacobian has the columns rvec, tvec, fx, fy, cx, cy and the distortion coefficients
+  std::vector<cv::Point2f> projected;
+  cv::Mat jacobian;
+  cv::projectPoints(objectPoints, parameters.rvecs[view], parameters.tvecs[view], camera, distortion, projected,
+                    jacobian);
+
+  system.hessian = cv::Matx<double, PARAMETERS, PARAMETERS>::zeros();
+  system.gradient = cv::Matx<double, PARAMETERS, 1>::zeros();
+  system.error = 0;
+  for (size_t i = 0; i < projected.size(); i++)
+  {
+    double residual[2] = {(double)projected[i].x - imagePoints[i].x, (double)projected[i].y - imagePoints[i].y};
+    for (int c = 0; c < 2; c++)
+    {
+      // the row of the jacobian reordered to the parameters, with fy tied to fx by the aspect ratio
+      const double *row = jacobian.ptr<double>((int)i * 2 + c);
+      double g[PARAMETERS];
+      g[0] = row[6] + parameters.aspect * row[7];
+      g[1] = row[8];
+      g[2] = row[9];
+      for (int j = 0; j < RATIONAL_COEFFICIENTS; j++)
+      {
+        g[3 + j] = row[10 + j];
+      }
+      for (int j = 0; j < EXTRINSICS; j++)
+      {
+        g[INTRINSICS + j] = row[j];
+      }
+
+      for (int a = 0; a < PARAMETERS; a++)
+      {
+        system.gradient(a) += g[a] * residual[c];
+        for (int b = a; b < PARAMETERS; b++)
+        {
+          system.hessian(a, b) += g[a] * g[b];
+        }
+      }
+      system.error += residual[c] * residual[c];
+    }
+  }
+
+  // fill in the lower triangle
+  for (int a = 0; a < PARAMETERS; a++)
+  {
+    for (int b = 0; b < a; b++)
+    {
+      system.hessian(a, b) = system.hessian(b, a);
+    }
+  }
+}
+
+// evaluate all views in parallel
+// return: the sum of the squared residuals
+static double evaluate_views(const std::vector<std::vector<cv::Vec3f>> &objectPoints,
+                             const std::vector<std::vector<cv::Point2f>> &imagePoints,
+                             const CalibrationParameters &parameters, std::vector<ViewSystem> &systems)
+{
+  cv::parallel_for_(cv::Range(0, (int)systems.size()), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      evaluate_view(objectPoints[i], imagePoints[i], parameters, i, systems[i]);
+    }
+  });
+
+  double error = 0;
+  for (size_t i = 0; i < systems.size(); i++)
+  {
+    error += systems[i].error;
+  }
+
+  return (error);
+}
+
+// solve the damped normal equations for the step of every parameter with the Schur complement
+// systems: the normal equations of the views
+// damping: the Levenberg-Marquardt damping, which scales up the diagonal
+// intrinsics: the step of the intrinsics
+// extrinsics: the step of the extrinsics of every view
+// return: true if the reduced system could be solved
+static bool solve_step(std::vector<ViewSystem> &systems, double damping, cv::Matx<double, INTRINSICS, 1> &intrinsics,
+                       std::vector<cv::Matx<double, EXTRINSICS, 1>> &extrinsics)
+{
+  // eliminate the extrinsics of every view, each independent of the others
+  cv::parallel_for_(cv::Range(0, (int)systems.size()), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      ViewSystem &s = systems[i];
+      cv::Matx<double, EXTRINSICS, EXTRINSICS> v;
+      for (int a = 0; a < EXTRINSICS; a++)
+      {
+        for (int b = 0; b < EXTRINSICS; b++)
+        {
+          v(a, b) = s.hessian(INTRINSICS + a, INTRINSICS + b);
+        }
+        v(a, a) += damping * std::max(v(a, a), 1e-12);
+      }
+      s.inverse = v.inv(cv::DECOMP_CHOLESKY);
+      for (int a = 0; a < INTRINSICS; a++)
+      {
+        for (int b = 0; b < EXTRINSICS; b++)
+        {
+          double sum = 0;
+          for (int c = 0; c < EXTRINSICS; c++)
+          {
+            sum += s.hessian(a, INTRINSICS + c) * s.inverse(c, b);
+          }
+          s.product(a, b) = sum;
+        }
+      }
+    }
+  });
+
+  // the reduced system S da = -g_a + sum W V^-1 g_b, with S = U - sum W V^-1 W^T
+  cv::Mat reduced = cv::Mat::zeros(INTRINSICS, INTRINSICS, CV_64F);
+  cv::Mat rhs = cv::Mat::zeros(INTRINSICS, 1, CV_64F);
+  for (size_t i = 0; i < systems.size(); i++)
+  {
+    const ViewSystem &s = systems[i];
+    for (int a = 0; a < INTRINSICS; a++)
+    {
+      double sum = -s.gradient(a);
+      for (int c = 0; c < EXTRINSICS; c++)
+      {
+        sum += s.product(a, c) * s.gradient(INTRINSICS + c);
+      }
+      rhs.at<double>(a) += sum;
+      for (int b = 0; b < INTRINSICS; b++)
+      {
+        double product = 0;
+        for (int c = 0; c < EXTRINSICS; c++)
+        {
+          product += s.product(a, c) * s.hessian(b, INTRINSICS + c);
+        }
+        reduced.at<double>(a, b) += s.hessian(a, b) - product;
+      }
+    }
+  }
+
+  // the damping of the intrinsics, the reduced system keeps the diagonal of U
+  double diagonal[INTRINSICS];
+  for (int a = 0; a < INTRINSICS; a++)
+  {
+    double u = 0;
+    for (size_t i = 0; i < systems.size(); i++)
+    {
+      u += systems[i].hessian(a, a);
+    }
+    diagonal[a] = u;
+  }
+  for (int a = 0; a < INTRINSICS; a++)
+  {
+    reduced.at<double>(a, a) += damping * std::max(diagonal[a], 1e-12);
+  }
+
+  cv::Mat delta;
+  if (!cv::solve(reduced, rhs, delta, cv::DECOMP_CHOLESKY))
+  {
+    return (false);
+  }
+  for (int a = 0; a < INTRINSICS; a++)
+  {
+    intrinsics(a) = delta.at<double>(a);
+  }
+
+  // back-substitute the extrinsics, db = V^-1 (-g_b - W^T da)
+  extrinsics.resize(systems.size());
+  cv::parallel_for_(cv::Range(0, (int)systems.size()), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      const ViewSystem &s = systems[i];
+      cv::Matx<double, EXTRINSICS, 1> b;
+      for (int c = 0; c < EXTRINSICS; c++)
+      {
+        double sum = -s.gradient(INTRINSICS + c);
+        for (int a = 0; a < INTRINSICS; a++)
+        {
+          sum -= s.hessian(a, INTRINSICS + c) * intrinsics(a);
+        }
+        b(c) = sum;
+      }
+      extrinsics[i] = s.inverse * b;
+    }
+  });
+
+  return (true);
+}
+
+double solve_calibration(const std::vector<std::vector<cv::Vec3f>> &objectPoints,
+                         const std::vector<std::vector<cv::Point2f>> &imagePoints, cv::Size imageSize,
+                         cv::Mat &cameraMatrix, cv::Mat &distCoeffs, std::vector<cv::Vec3d> &rvecs,
+                         std::vector<cv::Vec3d> &tvecs, bool useGuess, cv::TermCriteria criteria)
+{
+  // error checking
+  int views = (int)objectPoints.size();
+  if (views == 0 || imagePoints.size() != objectPoints.size())
+  {
+    printf("error: no views or mismatched points.\n");
+    return (-1);
+  }
+  long total = 0;
+  for (int i = 0; i < views; i++)
+  {
+    if (objectPoints[i].size() < 4 || objectPoints[i].size() != imagePoints[i].size())
+    {
+      printf("error: view %d has too few or mismatched points.\n", i);
+      return (-1);
+    }
+    total += (long)objectPoints[i].size();
+  }
+
+  // the initial intrinsics, from the guess or from the homographies of the views like cv::calibrateCamera
+  CalibrationParameters parameters;
+  cv::Mat camera;
+  cv::Mat distortion = cv::Mat::zeros(1, RATIONAL_COEFFICIENTS, CV_64F);
+  if (useGuess && !cameraMatrix.empty())
+  {
+    cameraMatrix.convertTo(camera, CV_64F);
+    if (!distCoeffs.empty())
+    {
+      cv::Mat guess;
+      distCoeffs.convertTo(guess, CV_64F);
+      guess = guess.reshape(1, 1);
+      for (int i = 0; i < std::min(guess.cols, RATIONAL_COEFFICIENTS); i++)
+      {
+        distortion.at<double>(0, i) = guess.at<double>(0, i);
+      }
+    }
+  }
+  else
+  {
+    camera = cv::initCameraMatrix2D(objectPoints, imagePoints, imageSize, 1.0);
+    camera.convertTo(camera, CV_64F);
+  }
+  parameters.intrinsics[0] = camera.at<double>(0, 0);
+  parameters.intrinsics[1] = camera.at<double>(0, 2);
+  parameters.intrinsics[2] = camera.at<double>(1, 2);
+  parameters.aspect = camera.at<double>(1, 1) / camera.at<double>(0, 0);
+  for (int i = 0; i < RATIONAL_COEFFICIENTS; i++)
+  {
+    parameters.intrinsics[3 + i] = distortion.at<double>(0, i);
+  }
+
+  // the initial extrinsics of every view from the initial intrinsics
+  parameters.rvecs.resize(views);
+  parameters.tvecs.resize(views);
+  cv::parallel_for_(cv::Range(0, views), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      cv::solvePnP(objectPoints[i], imagePoints[i], camera, distortion, parameters.rvecs[i], parameters.tvecs[i]);
+    }
+  });
+
+  // Levenberg-Marquardt, with the damping as a power of ten like cv::calibrateCamera
+  int maxIterations = (criteria.type & cv::TermCriteria::COUNT) ? criteria.maxCount : 30;
+  double epsilon = (criteria.type & cv::TermCriteria::EPS) ? criteria.epsilon : DBL_EPSILON;
+  std::vector<ViewSystem> systems(views), trialSystems(views);
+  double error = evaluate_views(objectPoints, imagePoints, parameters, systems);
+  int dampingLg10 = -3;
+  cv::Matx<double, INTRINSICS, 1> intrinsicStep;
+  std::vector<cv::Matx<double, EXTRINSICS, 1>> extrinsicSteps;
+  for (int iteration = 0; iteration < maxIterations;)
+  {
+    if (!solve_step(systems, std::pow(10.0, dampingLg10), intrinsicStep, extrinsicSteps))
+    {
+      if (++dampingLg10 > 16)
+      {
+        break;
+      }
+      continue;
+    }
+
+    // the parameters after the step, and how much they change relative to their size
+    CalibrationParameters trial = parameters;
+    double change = 0, size = 0;
+    for (int a = 0; a < INTRINSICS; a++)
+    {
+      trial.intrinsics[a] += intrinsicStep(a);
+      change += intrinsicStep(a) * intrinsicStep(a);
+      size += parameters.intrinsics[a] * parameters.intrinsics[a];
+    }
+    for (int i = 0; i < views; i++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        trial.rvecs[i][c] += extrinsicSteps[i](c);
+        trial.tvecs[i][c] += extrinsicSteps[i](3 + c);
+        change += extrinsicSteps[i](c) * extrinsicSteps[i](c) + extrinsicSteps[i](3 + c) * extrinsicSteps[i](3 + c);
+        size += parameters.rvecs[i][c] * parameters.rvecs[i][c] + parameters.tvecs[i][c] * parameters.tvecs[i][c];
+      }
+    }
+
+    // keep the step if it lowers the error and trust the linearization more, or else trust it less
+    double trialError = evaluate_views(objectPoints, imagePoints, trial, trialSystems);
+    if (trialError < error)
+    {
+      parameters = trial;
+      systems.swap(trialSystems);
+      error = trialError;
+      dampingLg10 = std::max(dampingLg10 - 1, -16);
+      iteration++;
+      if (std::sqrt(change) < epsilon * std::sqrt(size))
+      {
+        break;
+      }
+    }
+    else if (++dampingLg10 > 16)
+    {
+      break;
+    }
+  }
+
+  // write the results in the layout of cv::calibrateCamera
+  cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
+  cameraMatrix.at<double>(0, 0) = parameters.intrinsics[0];
+  cameraMatrix.at<double>(1, 1) = parameters.intrinsics[0] * parameters.aspect;
+  cameraMatrix.at<double>(0, 2) = parameters.intrinsics[1];
+  cameraMatrix.at<double>(1, 2) = parameters.intrinsics[2];
+  distCoeffs = cv::Mat::zeros(1, DISTORTION_COEFFICIENTS, CV_64F);
+  for (int i = 0; i < RATIONAL_COEFFICIENTS; i++)
+  {
+    distCoeffs.at<double>(0, i) = parameters.intrinsics[3 + i];
+  }
+  rvecs = parameters.rvecs;
+  tvecs = parameters.tvecs;
+
+  return (std::sqrt(error / total));
+}
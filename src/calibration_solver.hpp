@@ -0,0 +1,35 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef CALIBRATION_SOLVER_HPP
+#define CALIBRATION_SOLVER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// calibrate a camera like cv::calibrateCamera with CALIB_FIX_ASPECT_RATIO | CALIB_RATIONAL_MODEL,
+// with a Levenberg-Marquardt solver that exploits the structure of the problem
+// the 11 intrinsics (the focal length, the principal point and k1, k2, p1, p2, k3-k6) are shared by all views,
+// and the 6 extrinsics of a view only affect its own corners, so the normal equations are an arrowhead of
+// 6x6 blocks. each step eliminates the extrinsics with the Schur complement, solves the 11x11 reduced system
+// for the intrinsics, and solves every view for its extrinsics on its own, so the cost of a step grows
+// linearly with the number of views instead of with its cube. the views are evaluated in parallel
+// objectPoints: the 3D points of the corners of every view
+// imagePoints: the corners found in every view
+// imageSize: the size of the images
+// cameraMatrix: the calibrated camera matrix, and the initial guess if useGuess is set, whose aspect ratio is kept
+// distCoeffs: the calibrated distortion coefficients, 14 of them, and the initial guess if useGuess is set
+// rvecs: the rotation vectors of the views
+// tvecs: the translation vectors of the views
+// useGuess: whether to start from the given camera matrix and distortion coefficients
+// criteria: the largest number of iterations, and the relative change of the parameters to stop at
+// return: the rms reprojection error, or -1 if error
+double solve_calibration(const std::vector<std::vector<cv::Vec3f>> &objectPoints,
+                         const std::vector<std::vector<cv::Point2f>> &imagePoints, cv::Size imageSize,
+                         cv::Mat &cameraMatrix, cv::Mat &distCoeffs, std::vector<cv::Vec3d> &rvecs,
+                         std::vector<cv::Vec3d> &tvecs, bool useGuess, cv::TermCriteria criteria);
+
+#endif
@@ -0,0 +1,261 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include <opencv2/opencv.hpp>
+#include "calibration_store.hpp"
+#include "mesh_cache.hpp"
+
+// the first bytes of a store file
+static const char STORE_MAGIC[8] = {'A', 'R', 'C', 'A', 'L', 'I', 'B', 0};
+
+// the version of the format, increased whenever the layout of the header or the records changes
+static const uint32_t STORE_VERSION = 1;
+
+// written as is, so that a store written on a machine of the other byte order is rejected
+static const uint32_t STORE_BYTE_ORDER = 0x01020304;
+
+// the longest camera id, without the terminating zero
+static const size_t MAX_CAMERA_ID = 63;
+
+// the header at the start of a store file, followed by the records
+struct StoreHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t recordSize;
+  uint32_t recordCount;
+};
+
+// a calibration as stored, with the matrices at full precision
+struct StoreRecord
+{
+  char cameraId[MAX_CAMERA_ID + 1]; // zero-padded
+  int32_t width;
+  int32_t height;
+  double cameraMatrix[9]; // row by row
+  double distCoeffs[14];
+  double error;
+  int64_t time;
+};
+
+// order the records by camera, then by width and height
+static bool record_less(const StoreRecord &a, const StoreRecord &b)
+{
+  int order = strcmp(a.cameraId, b.cameraId);
+  if (order != 0)
+  {
+    return (order < 0);
+  }
+  if (a.width != b.width)
+  {
+    return (a.width < b.width);
+  }
+
+  return (a.height < b.height);
+}
+
+// map a store file and check its header
+// file: the mapped file
+// filename: the path of the store file
+// count: the number of records
+// return: the first record, or NULL if the file does not exist or is not a store file of this version
+static const StoreRecord *map_store(MappedFile &file, std::string filename, uint32_t &count)
+{
+  if (file.open(filename) != 0 || file.size() < sizeof(StoreHeader))
+  {
+    return (NULL);
+  }
+
+  StoreHeader header;
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0 || header.version != STORE_VERSION ||
+      header.byteOrder != STORE_BYTE_ORDER || header.recordSize != sizeof(StoreRecord) ||
+      header.recordCount > (file.size() - sizeof(StoreHeader)) / sizeof(StoreRecord))
+  {
+    return (NULL);
+  }
+  count = header.recordCount;
+
+  // the header is a multiple of 8 bytes long, so the records are aligned in the mapping
+  return ((const StoreRecord *)((const char *)file.data() + sizeof(StoreHeader)));
+}
+
+// copy a stored calibration out of the mapped file
+static void from_store_record(const StoreRecord &stored, CalibrationRecord &record)
+{
+  record.cameraId = std::string(stored.cameraId, strnlen(stored.cameraId, sizeof(stored.cameraId)));
+  record.imageSize = cv::Size(stored.width, stored.height);
+  record.cameraMatrix = cv::Mat(3, 3, CV_64F, (void *)stored.cameraMatrix).clone();
+  record.distCoeffs = cv::Mat(1, 14, CV_64F, (void *)stored.distCoeffs).clone();
+  record.error = stored.error;
+  record.time = stored.time;
+}
+
+int load_calibration_record(std::string filename, std::string cameraId, cv::Size imageSize, CalibrationRecord &record)
+{
+  MappedFile file;
+  uint32_t count = 0;
+  const StoreRecord *records = map_store(file, filename, count);
+  if (records == NULL || cameraId.size() > MAX_CAMERA_ID)
+  {
+    return (-1);
+  }
+
+  // the first record not before the key, which is the first resolution of the camera for an empty size
+  StoreRecord key;
+  memset(&key, 0, sizeof(key));
+  memcpy(key.cameraId, cameraId.c_str(), cameraId.size());
+  key.width = imageSize.width;
+  key.height = imageSize.height;
+  const StoreRecord *found = std::lower_bound(records, records + count, key, record_less);
+  if (found == records + count || strcmp(found->cameraId, key.cameraId) != 0 ||
+      (!imageSize.empty() && (found->width != key.width || found->height != key.height)))
+  {
+    return (-1);
+  }
+  from_store_record(*found, record);
+
+  return (0);
+}
+
+int read_calibration_records(std::string filename, std::vector<CalibrationRecord> &records)
+{
+  MappedFile file;
+  uint32_t count = 0;
+  const StoreRecord *stored = map_store(file, filename, count);
+  if (stored == NULL)
+  {
+    return (-1);
+  }
+
+  records.resize(count);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    from_store_record(stored[i], records[i]);
+  }
+
+  return (0);
+}
+
+int save_calibration_record(std::string filename, const CalibrationRecord &record)
+{
+  // error checking
+  if (record.cameraId.empty() || record.cameraId.size() > MAX_CAMERA_ID)
+  {
+    printf("error: camera id must have 1 to %d characters.\n", (int)MAX_CAMERA_ID);
+    return (-1);
+  }
+
+  // error checking
+  if (record.cameraMatrix.rows != 3 || record.cameraMatrix.cols != 3 || record.cameraMatrix.type() != CV_64F ||
+      record.distCoeffs.total() > 14 || record.distCoeffs.type() != CV_64F)
+  {
+    printf("error: expected a 3x3 camera matrix and at most 14 distortion coefficients, all double.\n");
+    return (-1);
+  }
+
+  StoreRecord added;
+  memset(&added, 0, sizeof(added));
+  memcpy(added.cameraId, record.cameraId.c_str(), record.cameraId.size());
+  added.width = record.imageSize.width;
+  added.height = record.imageSize.height;
+  for (int i = 0; i < 9; i++)
+  {
+    added.cameraMatrix[i] = record.cameraMatrix.at<double>(i / 3, i % 3);
+  }
+  cv::Mat distCoeffs = record.distCoeffs.reshape(1, 1);
+  for (int i = 0; i < (int)distCoeffs.total(); i++)
+  {
+    added.distCoeffs[i] = distCoeffs.at<double>(0, i);
+  }
+  added.error = record.error;
+  added.time = record.time;
+
+  // copy the records of the other cameras and resolutions, but do not overwrite a file that is not a store
+  std::vector<StoreRecord> records;
+  {
+    MappedFile file;
+    uint32_t count = 0;
+    const StoreRecord *stored = map_store(file, filename, count);
+    struct stat info;
+    if (stored == NULL && stat(filename.c_str(), &info) == 0 && info.st_size > 0)
+    {
+      printf("error: %s is not a calibration store of this version.\n", filename.c_str());
+      return (-1);
+    }
+    if (stored != NULL)
+    {
+      records.assign(stored, stored + count);
+    }
+  }
+
+  // insert the record in order, or replace the one with the same key
+  std::vector<StoreRecord>::iterator found = std::lower_bound(records.begin(), records.end(), added, record_less);
+  if (found != records.end() && !record_less(added, *found))
+  {
+    *found = added;
+  }
+  else
+  {
+    records.insert(found, added);
+  }
+
+  StoreHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+  header.version = STORE_VERSION;
+  header.byteOrder = STORE_BYTE_ORDER;
+  header.recordSize = sizeof(StoreRecord);
+  header.recordCount = (uint32_t)records.size();
+
+  // write under a name of this process, then move it in place
+#ifdef _WIN32
+  std::string temporary = filename + ".tmp" + std::to_string(_getpid());
+#else
+  std::string temporary = filename + ".tmp" + std::to_string(getpid());
+#endif
+  std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    printf("error: unable to write %s.\n", temporary.c_str());
+    return (-1);
+  }
+  file.write((const char *)&header, sizeof(header));
+  file.write((const char *)&records[0], (std::streamsize)(records.size() * sizeof(StoreRecord)));
+  file.close();
+  if (file.fail())
+  {
+    printf("error: unable to write %s.\n", temporary.c_str());
+    remove(temporary.c_str());
+    return (-1);
+  }
+
+#ifdef _WIN32
+  // rename does not replace an existing file on windows
+  remove(filename.c_str());
+#endif
+  if (rename(temporary.c_str(), filename.c_str()) != 0)
+  {
+    printf("error: unable to write %s.\n", filename.c_str());
+    remove(temporary.c_str());
+    return (-1);
+  }
+
+  return (0);
+}
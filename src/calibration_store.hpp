@@ -0,0 +1,51 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef CALIBRATION_STORE_HPP
+#define CALIBRATION_STORE_HPP
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// a calibration of one camera at one resolution
+struct CalibrationRecord
+{
+  CalibrationRecord() : error(0), time(0) {}
+
+  std::string cameraId;
+  cv::Size imageSize;
+  cv::Mat cameraMatrix; // 3x3
+  cv::Mat distCoeffs;   // 1x14
+  double error;         // the reprojection error in pixels
+  int64_t time;         // when it was saved, in seconds since the epoch
+};
+
+// find the calibration of a camera in a store file
+// the file is mapped into memory and the records, kept sorted by camera and resolution, are binary searched,
+// so loading takes the same time however many cameras the file holds, and processes share the pages of the file
+// filename: the path of the store file
+// cameraId: the camera
+// imageSize: the resolution, or an empty size for the first resolution of the camera
+// record: the calibration found
+// return: 0 if successful, -1 if the file or the calibration does not exist
+int load_calibration_record(std::string filename, std::string cameraId, cv::Size imageSize, CalibrationRecord &record);
+
+// read all calibrations of a store file
+// filename: the path of the store file
+// records: the calibrations, sorted by camera and resolution
+// return: 0 if successful, -1 if the file does not exist or is not a store file
+int read_calibration_records(std::string filename, std::vector<CalibrationRecord> &records);
+
+// add a calibration to a store file, replacing the one of the same camera and resolution
+// the file is written under a temporary name and renamed, so that another process never maps a partial file
+// filename: the path of the store file, created if it does not exist
+// record: the calibration, with a camera id of at most 63 characters
+// return: 0 if successful, -1 if error
+int save_calibration_record(std::string filename, const CalibrationRecord &record);
+
+#endif
@@ -11,109 +11,355 @@ cpp functions for reading CSV files with a specific format
 - first column is a string containing a object label
 - every other column is a number
 
-The function returns a std::vector of char* for the object labels and a 2D std::vector of doubles for the data
+The function returns a std::vector of std::string for the object labels and a 2D std::vector of doubles for the data,
+or a table with the data of all rows in one array, parsed from the mapped file in chunks in parallel
 */
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string>
+#include <sys/stat.h>
 #include "opencv2/opencv.hpp"
 #include "csv_util.h"
+#include "mesh_cache.hpp"
 
-// reads a string from a CSV file. the 0-terminated string is returned in the char array os.
-//
-// The function returns false if it is successfully read. It returns true if it reaches the end of the line or the file.
-int getstring(FILE *fp, char os[])
+// a chunk is never smaller than this, so that small files are parsed on one thread
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+// the powers of ten that a double holds exactly
+static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// the largest integer a double holds exactly
+static const uint64_t MAX_EXACT_MANTISSA = (uint64_t)1 << 53;
+
+// the labels and numbers of one chunk of the file
+struct CsvChunk
 {
-  int p = 0;
-  int eol = 0;
+  CsvChunk() : begin(NULL), end(NULL), cols(-1), lines(0), firstRowLine(0), error(NULL), errorLine(0) {}
+
+  const char *begin;
+  const char *end;
 
-  for (;;)
+  std::vector<std::string> labels;
+  std::vector<double> values;
+  int cols; // the numbers per row, -1 before the first row
+
+  long lines;
+  long firstRowLine; // the line of the chunk the first row is on
+
+  // the first error in the chunk and the line of the chunk it is on
+  const char *error;
+  long errorLine;
+};
+
+// skip spaces and tabs
+// p: the current position
+// end: the end of the line
+// return: the first other character
+static inline const char *skip_blanks(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+  {
+    p++;
+  }
+
+  return (p);
+}
+
+// parse a decimal number like strtod
+// numbers of up to 15 significant digits and a power of ten of at most 22 are scaled with one rounding,
+// which rounds exactly like strtod, any other number is handed to strtod
+// p: the current position
+// end: the end of the field
+// value: the number
+// return: the position after the number, NULL if there is no number
+static inline const char *parse_double(const char *p, const char *end, double &value)
+{
+  const char *start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
   {
-    char ch = fgetc(fp);
-    if (ch == ',')
+    negative = *p == '-';
+    p++;
+  }
+
+  // collect the digits, and the power of ten they are scaled by
+  uint64_t mantissa = 0;
+  bool exact = true;
+  int exponent = 0;
+  bool any = false;
+  while (p < end && (unsigned)(*p - '0') < 10)
+  {
+    exact = exact && mantissa <= (MAX_EXACT_MANTISSA - 9) / 10;
+    mantissa = mantissa * 10 + (*p - '0');
+    any = true;
+    p++;
+  }
+  if (p < end && *p == '.')
+  {
+    p++;
+    while (p < end && (unsigned)(*p - '0') < 10)
     {
-      break;
+      exact = exact && mantissa <= (MAX_EXACT_MANTISSA - 9) / 10;
+      mantissa = mantissa * 10 + (*p - '0');
+      exponent--;
+      any = true;
+      p++;
     }
-    else if (ch == '\n' || ch == EOF)
+  }
+  if (!any)
+  {
+    return (NULL);
+  }
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char *q = p + 1;
+    bool negativeExponent = false;
+    if (q < end && (*q == '-' || *q == '+'))
     {
-      eol = 1;
-      break;
+      negativeExponent = *q == '-';
+      q++;
     }
-    // printf("%c", ch ); // uncomment for debugging
-    os[p] = ch;
-    p++;
+    if (q < end && (unsigned)(*q - '0') < 10)
+    {
+      int e = 0;
+      while (q < end && (unsigned)(*q - '0') < 10)
+      {
+        e = std::min(e * 10 + (*q - '0'), 10000);
+        q++;
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  // too many digits, or too large a power of ten, to round once
+  // strtod gets a copy of the whole number, however long, since the field is not terminated
+  if (!exact || exponent < -22 || exponent > 22)
+  {
+    std::string number(start, p);
+    value = strtod(number.c_str(), NULL);
+    return (p);
   }
-  // printf("\n"); // uncomment for debugging
-  os[p] = '\0';
 
-  return (eol); // return true if eol
+  double result = (double)mantissa;
+  result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+  value = negative ? -result : result;
+
+  return (p);
 }
 
-int getint(FILE *fp, int *v)
+// parse the rows of a chunk
+// chunk: the chunk, whose begin and end are set
+static void parse_csv_chunk(CsvChunk &chunk)
 {
-  char s[256];
-  int p = 0;
-  int eol = 0;
-
-  for (;;)
+  const char *p = chunk.begin;
+  while (p < chunk.end)
   {
-    char ch = fgetc(fp);
-    if (ch == ',')
+    const char *lineEnd = (const char *)memchr(p, '\n', chunk.end - p);
+    const char *next = lineEnd == NULL ? chunk.end : lineEnd + 1;
+    if (lineEnd == NULL)
     {
-      break;
+      lineEnd = chunk.end;
     }
-    else if (ch == '\n' || ch == EOF)
+    if (lineEnd > p && lineEnd[-1] == '\r')
     {
-      eol = 1;
-      break;
+      lineEnd--;
     }
+    chunk.lines++;
 
-    s[p] = ch;
-    p++;
+    // blank lines are skipped
+    if (skip_blanks(p, lineEnd) == lineEnd)
+    {
+      p = next;
+      continue;
+    }
+
+    // the label is everything up to the first comma
+    const char *comma = (const char *)memchr(p, ',', lineEnd - p);
+    if (comma == NULL)
+    {
+      comma = lineEnd;
+    }
+    chunk.labels.push_back(std::string(p, comma));
+
+    // the numbers are separated by commas, with blanks allowed around them
+    // an empty field, such as the one after a trailing comma, reads as 0 like the atof of the old reader did
+    int count = 0;
+    p = comma;
+    while (p < lineEnd)
+    {
+      const char *number = skip_blanks(p + 1, lineEnd);
+      double value = 0;
+      if (number == lineEnd || *number == ',')
+      {
+        p = number;
+      }
+      else
+      {
+        p = parse_double(number, lineEnd, value);
+      }
+      if (p == NULL)
+      {
+        chunk.error = "invalid number";
+        chunk.errorLine = chunk.lines;
+        return;
+      }
+      p = skip_blanks(p, lineEnd);
+      if (p < lineEnd && *p != ',')
+      {
+        chunk.error = "invalid number";
+        chunk.errorLine = chunk.lines;
+        return;
+      }
+      chunk.values.push_back(value);
+      count++;
+    }
+
+    // every row of the file has the same number of numbers
+    if (chunk.cols < 0)
+    {
+      chunk.cols = count;
+      chunk.firstRowLine = chunk.lines;
+    }
+    else if (count != chunk.cols)
+    {
+      chunk.error = "row has a different number of columns than the rows before it";
+      chunk.errorLine = chunk.lines;
+      return;
+    }
+
+    p = next;
   }
-  s[p] = '\0'; // terminator
-  *v = atoi(s);
+}
 
-  return (eol); // return true if eol
+int CsvTable::rows() const
+{
+  return ((int)labels.size());
 }
 
-// utility function for reading one double value from a csv file
-//
-// fp: the file pointer
-// v: the value
-//
-// returns true if it reaches the end of a line or the file
-int getdouble(FILE *fp, double *v)
+const double *CsvTable::row(int i) const
 {
-  char s[256];
-  int p = 0;
-  int eol = 0;
+  return (values.data() + (size_t)i * cols);
+}
 
-  for (;;)
+int parse_csv_table(const char *data, size_t size, CsvTable &table, int threads)
+{
+  // split the text into chunks that start at the beginning of a line
+  if (threads <= 0)
+  {
+    threads = std::max(1, cv::getNumThreads());
+  }
+  size_t chunkCount = std::max((size_t)1, std::min((size_t)threads, size / MIN_CHUNK_SIZE));
+  std::vector<CsvChunk> chunks(chunkCount);
+  const char *end = data + size;
+  const char *p = data;
+  for (size_t i = 0; i < chunkCount; i++)
   {
-    char ch = fgetc(fp);
-    if (ch == ',')
+    chunks[i].begin = p;
+    if (i + 1 == chunkCount)
     {
-      break;
+      p = end;
     }
-    else if (ch == '\n' || ch == EOF)
+    else
     {
-      eol = 1;
-      break;
+      p = std::max(p, data + size / chunkCount * (i + 1));
+      const char *newline = (const char *)memchr(p, '\n', end - p);
+      p = newline == NULL ? end : newline + 1;
     }
+    chunks[i].end = p;
+  }
 
-    s[p] = ch;
-    p++;
+  cv::parallel_for_(cv::Range(0, (int)chunkCount), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      parse_csv_chunk(chunks[i]);
+    }
+  });
+
+  // report the first error with its line in the file, including chunks whose rows differ from the first row
+  long line = 0;
+  int cols = -1;
+  for (size_t i = 0; i < chunkCount; i++)
+  {
+    if (chunks[i].error != NULL)
+    {
+      printf("error: %s on line %ld.\n", chunks[i].error, line + chunks[i].errorLine);
+      return (-1);
+    }
+    if (cols >= 0 && chunks[i].cols >= 0 && chunks[i].cols != cols)
+    {
+      printf("error: row has a different number of columns than the rows before it on line %ld.\n",
+             line + chunks[i].firstRowLine);
+      return (-1);
+    }
+    if (cols < 0)
+    {
+      cols = chunks[i].cols;
+    }
+    line += chunks[i].lines;
+  }
+
+  // find where each chunk goes in the table
+  std::vector<size_t> rowBase(chunkCount + 1, 0), valueBase(chunkCount + 1, 0);
+  for (size_t i = 0; i < chunkCount; i++)
+  {
+    rowBase[i + 1] = rowBase[i] + chunks[i].labels.size();
+    valueBase[i + 1] = valueBase[i] + chunks[i].values.size();
+  }
+  if (rowBase[chunkCount] > (size_t)INT32_MAX)
+  {
+    printf("error: too many rows.\n");
+    return (-1);
+  }
+
+  // move the chunks into the table in parallel
+  table.cols = std::max(cols, 0);
+  table.labels.resize(rowBase[chunkCount]);
+  table.values.resize(valueBase[chunkCount]);
+  cv::parallel_for_(cv::Range(0, (int)chunkCount), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      CsvChunk &chunk = chunks[i];
+      for (size_t j = 0; j < chunk.labels.size(); j++)
+      {
+        table.labels[rowBase[i] + j].swap(chunk.labels[j]);
+      }
+      std::copy(chunk.values.begin(), chunk.values.end(), table.values.begin() + valueBase[i]);
+    }
+  });
+
+  return (0);
+}
+
+int read_csv_table(std::string filename, CsvTable &table, int threads)
+{
+  table = CsvTable();
+
+  // map the file, it is read once front to back, an empty file cannot be mapped and has no rows
+  MappedFile file;
+  if (file.open(filename) != 0)
+  {
+    struct stat info;
+    if (stat(filename.c_str(), &info) == 0 && info.st_size == 0)
+    {
+      return (0);
+    }
+    printf("error: unable to open csv file %s\n", filename.c_str());
+    return (-1);
   }
-  s[p] = '\0'; // terminator
-  *v = atof(s);
 
-  return (eol); // return true if eol
+  return (parse_csv_table((const char *)file.data(), file.size(), table, threads));
 }
 
 int append_object_data_csv(std::string filename, std::string object_label, std::vector<double> &object_feature, int reset_file)
 {
-  char buffer[256];
   char mode[8];
   FILE *fp;
 
@@ -132,9 +378,8 @@ int append_object_data_csv(std::string filename, std::string object_label, std::
   }
 
   // write the object label and the feature vector to the csv file
-  strcpy(buffer, object_label.c_str());
-  std::fwrite(buffer, sizeof(char), strlen(buffer), fp);
-  for (int i = 0; i < object_feature.size(); i++)
+  std::fwrite(object_label.c_str(), sizeof(char), object_label.size(), fp);
+  for (size_t i = 0; i < object_feature.size(); i++)
   {
     char tmp[256];
     snprintf(tmp, 256, ",%f", object_feature[i]);
@@ -150,53 +395,27 @@ int append_object_data_csv(std::string filename, std::string object_label, std::
 
 int read_object_data_csv(std::string filename, std::vector<std::string> &object_labels, std::vector<std::vector<double>> &object_features, int echo_file)
 {
-  FILE *fp;
-  double fval;
-  char object_label[256];
-
-  fp = fopen(filename.c_str(), "r");
-  if (!fp)
+  printf("reading %s\n", filename.c_str());
+  CsvTable table;
+  if (read_csv_table(filename, table) != 0)
   {
-    printf("error: unable to open object feature file\n");
     return (-1);
   }
 
-  printf("reading %s\n", filename.c_str());
-  for (;;)
+  // copy the rows of the table out
+  for (int i = 0; i < table.rows(); i++)
   {
-    std::vector<double> dvec;
-
-    // read the object label
-    if (getstring(fp, object_label))
-    {
-      break;
-    }
-
-    // read the whole feature file into memory
-    for (;;)
-    {
-      // get next feature
-      double eol = getdouble(fp, &fval);
-      dvec.push_back(fval);
-      if (eol)
-        break;
-    }
-
-    object_features.push_back(dvec);
-
-    char *fname = new char[strlen(object_label) + 1];
-    strcpy(fname, object_label);
-    object_labels.push_back(fname);
+    object_labels.push_back(table.labels[i]);
+    object_features.push_back(std::vector<double>(table.row(i), table.row(i) + table.cols));
   }
-  fclose(fp);
   printf("finished reading csv file\n");
 
   if (echo_file)
   {
-    for (int i = 0; i < object_features.size(); i++)
+    for (size_t i = 0; i < object_features.size(); i++)
     {
       printf("%s:  ", object_labels[i].c_str());
-      for (int j = 0; j < object_features[i].size(); j++)
+      for (size_t j = 0; j < object_features[i].size(); j++)
       {
         printf("%f  ", object_features[i][j]);
       }
@@ -8,6 +8,7 @@
  */
 
 #ifndef CVS_UTIL_H
+#include <cstddef>
 #include <string>
 #include <vector>
 #define CVS_UTIL_H
@@ -35,4 +36,40 @@ int append_object_data_csv(std::string filename, std::string object_label, std::
 // returns a non-zero value if something goes wrong
 int read_object_data_csv(std::string filename, std::vector<std::string> &object_labels, std::vector<std::vector<double>> &object_features, int echo_file = 0);
 
+// the labels and numbers of a csv format file, with the numbers of all rows in one row-major array
+struct CsvTable
+{
+  CsvTable() : cols(0) {}
+
+  std::vector<std::string> labels;
+  std::vector<double> values; // rows() * cols numbers, row by row
+  int cols;                   // the numbers per row
+
+  // return: the number of rows
+  int rows() const;
+
+  // i: the index of the row
+  // return: the first number of the row
+  const double *row(int i) const;
+};
+
+// parse csv text whose first column is the object label and the remaining columns are numbers
+// the text is split into chunks at line boundaries and the chunks are parsed in parallel, without streams,
+// into one array; blank lines are skipped, and a row with another number of columns than the others is an error
+//
+// data: the text of the file
+// size: the size of the text in bytes
+// table: the labels and numbers
+// threads: the number of chunks to parse in parallel, 0 for the number of threads of OpenCV
+// returns a non-zero value if something goes wrong
+int parse_csv_table(const char *data, size_t size, CsvTable &table, int threads = 0);
+
+// read a csv format file into a table, the file is mapped into memory instead of read
+//
+// filename: the name of the file to read from
+// table: the labels and numbers
+// threads: the number of chunks to parse in parallel, 0 for the number of threads of OpenCV
+// returns a non-zero value if something goes wrong
+int read_csv_table(std::string filename, CsvTable &table, int threads = 0);
+
 #endif
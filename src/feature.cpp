@@ -8,42 +8,75 @@
 #include <opencv2/xfeatures2d.hpp>
 #include <vector>
 #include "util.hpp"
+#include "frame_source.hpp"
+#include "frame_writer.hpp"
+#include "profiler.hpp"
 
 int main(int argc, char *argv[])
 {
-  // open the video device
-  cv::VideoCapture *vidCap;
-  vidCap = new cv::VideoCapture(0);
+  // read the frame options from the command line
+  FrameOptions options;
+  std::vector<std::string> args;
+  if (parse_frame_options(argc, argv, options, args) != 0)
+  {
+    return (-1);
+  }
+
+  // open the frame source
+  FrameSource *source = open_frame_source(options.source);
 
   // error checking
-  if (!vidCap->isOpened())
+  if (source == NULL)
   {
-    std::cerr << "error: unable to open video device" << std::endl;
     return (-2);
   }
 
+  // show the frames in a window, or process them as fast as possible when headless
+  FrameSink sink(options);
+
+  // the saved frames are encoded on a background thread
+  FrameWriter writer;
+
   // get the width and height of frames in the video stream
-  cv::Size refS((int)vidCap->get(cv::CAP_PROP_FRAME_WIDTH),
-                (int)vidCap->get(cv::CAP_PROP_FRAME_HEIGHT));
+  cv::Size refS = source->size();
 
   // for all frames
   cv::Mat frame;
   std::string featureType = "surf";
-  while (true)
-  {
-    // read a frame from the video stream
-    *vidCap >> frame;
 
-    // error checking
-    if (frame.empty())
+  // the initial feature type can be given on the command line, e.g. for headless profiling
+  if (!args.empty())
+  {
+    featureType = args[0];
+    if (featureType != "harris" && featureType != "shi-tomasi" && featureType != "sift" && featureType != "surf")
+    {
+      printf("error: unknown feature type %s.\n", featureType.c_str());
+      delete source;
+      return (-1);
+    }
+  }
+  while (options.maxFrames < 0 || sink.frames() < options.maxFrames)
+  {
+    // read a frame from the frame source
+    bool read;
+    {
+      ScopedTimer timer(PROFILE_CAPTURE);
+      read = source->read(frame);
+    }
+    if (!read)
     {
-      std::cerr << "error: frame is empty" << std::endl;
       break;
     }
 
     // convert the frame to grayscale
     cv::Mat gray;
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    {
+      ScopedTimer timer(PROFILE_GRAY);
+      cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
+
+    // find and draw the features
+    ScopedTimer featureTimer(PROFILE_FEATURES);
 
     if (featureType == "harris")
     {
@@ -75,7 +108,7 @@ int main(int argc, char *argv[])
       cv::goodFeaturesToTrack(gray, cornerSet, 100, 0.01, 10);
 
       // draw the corners
-      for (int i = 0; i < cornerSet.size(); i++)
+      for (size_t i = 0; i < cornerSet.size(); i++)
       {
         cv::circle(frame, cornerSet[i], 3, cv::Scalar(255, 0, 0), 2);
       }
@@ -101,11 +134,10 @@ int main(int argc, char *argv[])
       cv::drawKeypoints(frame, keypoints, frame, cv::Scalar(0, 0, 255));
     }
 
-    // display the frame
-    cv::imshow("Feature", frame);
+    featureTimer.stop();
 
-    // wait for a keypress
-    int key = cv::waitKey(1);
+    // display the frame and wait for a keypress
+    int key = sink.show("Feature", frame);
     // if key is 'q', exit the loop and quit the program
     if (key == 'q')
     {
@@ -114,8 +146,7 @@ int main(int argc, char *argv[])
     // if key is 's', save the frame
     else if (key == 's')
     {
-      std::string filename = get_image_name("../resources/", featureType);
-      cv::imwrite(filename, frame);
+      writer.snapshot(get_image_name("../resources/", featureType), frame);
     }
     // if key is 'h', use harris corners
     else if (key == 'h')
@@ -139,8 +170,11 @@ int main(int argc, char *argv[])
     }
   }
 
-  // free the video capture object
-  delete vidCap;
+  // print the frame rate
+  sink.report();
+
+  // free the frame source
+  delete source;
 
   return (0);
 }
@@ -0,0 +1,472 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <opencv2/opencv.hpp>
+#include "frame_source.hpp"
+#include "profiler.hpp"
+
+// get the lowercase extension of a filename, without the dot
+// filename: the filename
+// return: the extension, or an empty string if there is none
+static std::string get_extension(std::string filename)
+{
+  size_t dot = filename.find_last_of('.');
+  size_t slash = filename.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+  {
+    return ("");
+  }
+
+  std::string extension = filename.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+  return (extension);
+}
+
+// check whether a filename has the extension of an image
+// filename: the filename
+// return: true if the file is an image
+static bool is_image_file(std::string filename)
+{
+  std::string extension = get_extension(filename);
+  return (extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "bmp" ||
+          extension == "tif" || extension == "tiff");
+}
+
+// check whether a path is a directory
+// path: the path
+// return: true if the path is a directory
+static bool is_directory(std::string path)
+{
+  struct stat info;
+  return (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode));
+}
+
+// check whether a string is a non-negative integer
+// str: the string
+// return: true if the string only contains digits
+static bool is_number(std::string str)
+{
+  return (!str.empty() && str.find_first_not_of("0123456789") == std::string::npos);
+}
+
+CaptureSource::CaptureSource(int device)
+{
+  // open the video device
+  vidCap = new cv::VideoCapture(device);
+  isCamera = true;
+}
+
+CaptureSource::CaptureSource(std::string filename)
+{
+  // open the video file
+  vidCap = new cv::VideoCapture(filename);
+  isCamera = false;
+}
+
+CaptureSource::~CaptureSource()
+{
+  // free the video capture object
+  delete vidCap;
+}
+
+bool CaptureSource::isOpened()
+{
+  return (vidCap->isOpened());
+}
+
+bool CaptureSource::read(cv::Mat &frame)
+{
+  // read a frame from the video stream
+  *vidCap >> frame;
+
+  // an empty frame from a camera is an error, from a video file it is the end of the file
+  if (frame.empty())
+  {
+    if (isCamera)
+    {
+      std::cerr << "error: frame is empty" << std::endl;
+    }
+    return (false);
+  }
+
+  return (true);
+}
+
+cv::Size CaptureSource::size()
+{
+  // get the width and height of frames in the video stream
+  return (cv::Size((int)vidCap->get(cv::CAP_PROP_FRAME_WIDTH),
+                   (int)vidCap->get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
+
+bool CaptureSource::live()
+{
+  return (isCamera);
+}
+
+StillImageSource::StillImageSource(std::string filename)
+{
+  // read the image
+  image = cv::imread(filename);
+}
+
+bool StillImageSource::isOpened()
+{
+  return (!image.empty());
+}
+
+bool StillImageSource::read(cv::Mat &frame)
+{
+  // copy the image to the frame, since the caller draws on it
+  image.copyTo(frame);
+
+  return (!frame.empty());
+}
+
+cv::Size StillImageSource::size()
+{
+  return (image.size());
+}
+
+ImageSequenceSource::ImageSequenceSource(std::string pattern)
+{
+  next = 0;
+
+  // a directory means all images in it
+  std::vector<cv::String> candidates;
+  if (is_directory(pattern))
+  {
+    cv::glob(pattern + "/*", candidates, false);
+  }
+  else
+  {
+    cv::glob(pattern, candidates, false);
+  }
+
+  // keep the images only, cv::glob returns them sorted
+  for (size_t i = 0; i < candidates.size(); i++)
+  {
+    if (is_image_file(candidates[i]))
+    {
+      filenames.push_back(candidates[i]);
+    }
+  }
+
+  // get the frame size from the first image
+  if (!filenames.empty())
+  {
+    frameSize = cv::imread(filenames[0]).size();
+  }
+}
+
+bool ImageSequenceSource::isOpened()
+{
+  return (!filenames.empty());
+}
+
+bool ImageSequenceSource::read(cv::Mat &frame)
+{
+  // read the next readable image
+  while (next < filenames.size())
+  {
+    frame = cv::imread(filenames[next++]);
+    if (!frame.empty())
+    {
+      return (true);
+    }
+    printf("error: unable to read %s\n", filenames[next - 1].c_str());
+  }
+
+  return (false);
+}
+
+cv::Size ImageSequenceSource::size()
+{
+  return (frameSize);
+}
+
+SyntheticSource::SyntheticSource(cv::Size frameSize, long frameCount)
+{
+  this->frameSize = frameSize;
+  this->frameCount = frameCount;
+  frameIndex = 0;
+
+  // draw a chessboard with 10x7 squares, so it has 9x6 inner corners, and a white margin of one square
+  int square = 40;
+  board = cv::Mat(9 * square, 12 * square, CV_8UC3, cv::Scalar(255, 255, 255));
+  for (int i = 0; i < 7; i++)
+  {
+    for (int j = 0; j < 10; j++)
+    {
+      if ((i + j) % 2 == 0)
+      {
+        cv::rectangle(board, cv::Rect((j + 1) * square, (i + 1) * square, square, square), cv::Scalar(0, 0, 0), -1);
+      }
+    }
+  }
+}
+
+bool SyntheticSource::read(cv::Mat &frame)
+{
+  // stop after the requested number of frames, a negative count never stops
+  if (frameCount >= 0 && frameIndex >= frameCount)
+  {
+    return (false);
+  }
+
+  // move the board on a smooth path, tilting it so that the pose changes in all directions
+  double t = frameIndex * 0.05;
+  float width = (float)frameSize.width;
+  float height = (float)frameSize.height;
+  float cx = width * (0.5f + 0.15f * (float)std::sin(t));
+  float cy = height * (0.5f + 0.1f * (float)std::cos(0.7 * t));
+  float halfW = 0.3f * width * (1.0f + 0.15f * (float)std::sin(0.3 * t));
+  float halfH = halfW * board.rows / board.cols;
+  float tilt = 0.15f * (float)std::sin(0.9 * t);
+  float angle = 0.25f * (float)std::sin(0.4 * t);
+
+  // the corners of the board before rotation, with the perspective tilt shrinking one side
+  cv::Point2f quad[4] = {cv::Point2f(-halfW * (1 - tilt), -halfH),
+                         cv::Point2f(halfW * (1 - tilt), -halfH),
+                         cv::Point2f(halfW * (1 + tilt), halfH),
+                         cv::Point2f(-halfW * (1 + tilt), halfH)};
+
+  // rotate and translate the corners into the frame
+  cv::Point2f dst[4];
+  for (int i = 0; i < 4; i++)
+  {
+    dst[i] = cv::Point2f(cx + quad[i].x * (float)std::cos(angle) - quad[i].y * (float)std::sin(angle),
+                         cy + quad[i].x * (float)std::sin(angle) + quad[i].y * (float)std::cos(angle));
+  }
+  cv::Point2f src[4] = {cv::Point2f(0, 0),
+                        cv::Point2f((float)board.cols, 0),
+                        cv::Point2f((float)board.cols, (float)board.rows),
+                        cv::Point2f(0, (float)board.rows)};
+
+  // warp the board onto a gray background
+  cv::Mat homography = cv::getPerspectiveTransform(src, dst);
+  cv::warpPerspective(board, frame, homography, frameSize, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(90, 90, 90));
+
+  frameIndex++;
+
+  return (true);
+}
+
+cv::Size SyntheticSource::size()
+{
+  return (frameSize);
+}
+
+FrameSource *open_frame_source(std::string spec)
+{
+  // split the prefix from the argument
+  std::string kind;
+  std::string arg;
+  size_t colon = spec.find(':');
+  if (colon != std::string::npos)
+  {
+    kind = spec.substr(0, colon);
+    arg = spec.substr(colon + 1);
+  }
+  else
+  {
+    kind = spec;
+  }
+
+  // guess the kind of a plain path or device number
+  if (kind != "camera" && kind != "video" && kind != "images" && kind != "image" && kind != "synthetic")
+  {
+    arg = spec;
+    if (is_number(spec))
+    {
+      kind = "camera";
+    }
+    else if (is_directory(spec) || spec.find('*') != std::string::npos)
+    {
+      kind = "images";
+    }
+    else if (is_image_file(spec))
+    {
+      kind = "image";
+    }
+    else
+    {
+      kind = "video";
+    }
+  }
+
+  if (kind == "camera")
+  {
+    CaptureSource *source = new CaptureSource(arg.empty() ? 0 : atoi(arg.c_str()));
+    if (!source->isOpened())
+    {
+      std::cerr << "error: unable to open video device" << std::endl;
+      delete source;
+      return (NULL);
+    }
+    return (source);
+  }
+  else if (kind == "video")
+  {
+    CaptureSource *source = new CaptureSource(arg);
+    if (!source->isOpened())
+    {
+      printf("error: unable to open video file %s\n", arg.c_str());
+      delete source;
+      return (NULL);
+    }
+    return (source);
+  }
+  else if (kind == "images")
+  {
+    ImageSequenceSource *source = new ImageSequenceSource(arg);
+    if (!source->isOpened())
+    {
+      printf("error: no images found in %s\n", arg.c_str());
+      delete source;
+      return (NULL);
+    }
+    return (source);
+  }
+  else if (kind == "image")
+  {
+    StillImageSource *source = new StillImageSource(arg);
+    if (!source->isOpened())
+    {
+      printf("error: unable to read image %s\n", arg.c_str());
+      delete source;
+      return (NULL);
+    }
+    return (source);
+  }
+
+  // synthetic[:<width>x<height>[:<frames>]], 1080p and endless by default
+  int width = 1920;
+  int height = 1080;
+  long frames = -1;
+  if (!arg.empty() && sscanf(arg.c_str(), "%dx%d:%ld", &width, &height, &frames) < 2)
+  {
+    printf("error: invalid synthetic source %s\n", spec.c_str());
+    return (NULL);
+  }
+
+  return (new SyntheticSource(cv::Size(width, height), frames));
+}
+
+FrameSink::FrameSink(const FrameOptions &options)
+{
+  headless = options.headless;
+  hud = options.hud;
+  traceFile = options.traceFile;
+  frameCount = 0;
+  start = std::chrono::steady_clock::now();
+}
+
+int FrameSink::show(std::string window, const cv::Mat &frame)
+{
+  frameCount++;
+
+  // in headless mode nothing is displayed and there is no keyboard
+  if (headless)
+  {
+    return (-1);
+  }
+
+  // display the frame, with the latency of the stages on a copy of it
+  ScopedTimer timer(PROFILE_DISPLAY);
+  if (hud)
+  {
+    cv::Mat shown = frame.clone();
+    draw_profile_hud(shown);
+    cv::imshow(window, shown);
+  }
+  else
+  {
+    cv::imshow(window, frame);
+  }
+
+  // wait for a keypress
+  return (cv::waitKey(1));
+}
+
+long FrameSink::frames()
+{
+  return (frameCount);
+}
+
+void FrameSink::report()
+{
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("processed %ld frames in %.2f s (%.1f fps)\n", frameCount, seconds, seconds > 0 ? frameCount / seconds : 0.0);
+
+  print_profile();
+  if (profiling() && !traceFile.empty())
+  {
+    write_profile_trace(traceFile);
+  }
+}
+
+int parse_frame_options(int argc, char *argv[], FrameOptions &options, std::vector<std::string> &rest)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--source" || arg == "--frames" || arg == "--trace")
+    {
+      // error checking
+      if (i + 1 >= argc)
+      {
+        printf("error: %s needs a value.\n", arg.c_str());
+        return (-1);
+      }
+
+      if (arg == "--source")
+      {
+        options.source = argv[++i];
+      }
+      else if (arg == "--trace")
+      {
+        options.traceFile = argv[++i];
+        options.profile = true;
+      }
+      else
+      {
+        options.maxFrames = atol(argv[++i]);
+      }
+    }
+    else if (arg == "--headless")
+    {
+      options.headless = true;
+    }
+    else if (arg == "--profile")
+    {
+      options.profile = true;
+    }
+    else if (arg == "--profile-hud")
+    {
+      options.profile = true;
+      options.hud = true;
+    }
+    else
+    {
+      rest.push_back(arg);
+    }
+  }
+
+  // the timers record from here on
+  if (options.profile)
+  {
+    start_profiling(!options.traceFile.empty());
+  }
+
+  return (0);
+}
@@ -0,0 +1,165 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// a source of frames, e.g. a camera, a video file, a directory of images or a synthetic generator
+class FrameSource
+{
+public:
+  virtual ~FrameSource() {}
+
+  // read the next frame
+  // frame: the frame to read into
+  // return: true if a frame was read, false if the source is exhausted or broken
+  virtual bool read(cv::Mat &frame) = 0;
+
+  // return: the size of the frames produced by the source
+  virtual cv::Size size() = 0;
+
+  // return: true if the source produces frames in real time, e.g. a camera
+  virtual bool live() { return false; }
+};
+
+// a camera or a video file read through cv::VideoCapture
+class CaptureSource : public FrameSource
+{
+public:
+  CaptureSource(int device);
+  CaptureSource(std::string filename);
+  ~CaptureSource();
+
+  bool isOpened();
+  bool read(cv::Mat &frame);
+  cv::Size size();
+  bool live();
+
+private:
+  cv::VideoCapture *vidCap;
+  bool isCamera;
+};
+
+// a single image that is returned again and again
+class StillImageSource : public FrameSource
+{
+public:
+  StillImageSource(std::string filename);
+
+  bool isOpened();
+  bool read(cv::Mat &frame);
+  cv::Size size();
+
+private:
+  cv::Mat image;
+};
+
+// the images in a directory (or matching a glob pattern), read in sorted order
+class ImageSequenceSource : public FrameSource
+{
+public:
+  ImageSequenceSource(std::string pattern);
+
+  bool isOpened();
+  bool read(cv::Mat &frame);
+  cv::Size size();
+
+private:
+  std::vector<cv::String> filenames;
+  size_t next;
+  cv::Size frameSize;
+};
+
+// a generated 9x6 chessboard moving in front of a virtual camera,
+// used to profile the programs without a camera or any recorded footage
+class SyntheticSource : public FrameSource
+{
+public:
+  SyntheticSource(cv::Size frameSize, long frameCount);
+
+  bool read(cv::Mat &frame);
+  cv::Size size();
+
+private:
+  cv::Size frameSize;
+  long frameCount;
+  long frameIndex;
+  cv::Mat board;
+};
+
+// open a frame source from a specification string
+// spec: one of
+//   camera[:<device>] or <device>   a camera, e.g. camera:0
+//   video:<path>                    a video file
+//   images:<directory or pattern>   a sequence of images, e.g. images:../resources/*.jpg
+//   image:<path>                    a single image that is repeated
+//   synthetic[:<width>x<height>[:<frames>]]   a generated chessboard sequence
+// a path without a prefix is opened as a directory of images, an image or a video file by its extension
+// return: the frame source, or NULL if it cannot be opened
+FrameSource *open_frame_source(std::string spec);
+
+// command line options shared by all programs for choosing the frame source and sink
+struct FrameOptions
+{
+  FrameOptions() : source("camera:0"), headless(false), maxFrames(-1), profile(false), hud(false) {}
+
+  std::string source;
+  bool headless;
+  long maxFrames;
+
+  // the stage timings, see profiler.hpp
+  bool profile;          // record the latency of every stage and print its percentiles at the end
+  bool hud;              // draw the percentiles on the shown frames
+  std::string traceFile; // write every timed interval to this file as a Chrome trace
+};
+
+// shows frames in a window, or swallows them in headless mode, and measures the frame rate
+class FrameSink
+{
+public:
+  // options: whether to show the frames, with the profile on them, and where to write the trace to
+  FrameSink(const FrameOptions &options);
+
+  // show a frame and poll the keyboard
+  // window: the name of the window
+  // frame: the frame to show
+  // return: the key pressed, or -1 if no key was pressed or in headless mode
+  int show(std::string window, const cv::Mat &frame);
+
+  // return: the number of frames shown so far
+  long frames();
+
+  // print the number of frames processed and the frame rate, and the profile and its trace if recorded
+  void report();
+
+private:
+  bool headless;
+  bool hud;
+  std::string traceFile;
+  long frameCount;
+  std::chrono::steady_clock::time_point start;
+};
+
+// parse the frame options from the command line
+//   --source <spec>   the frame source, see open_frame_source
+//   --headless        process frames as fast as possible without displaying them
+//   --frames <n>      stop after n frames
+//   --profile         time the stages of the frame loop and print their latency percentiles at the end
+//   --profile-hud     also draw the percentiles on the shown frames
+//   --trace <file>    also write every timed interval to a Chrome trace json file
+// argc: the number of arguments
+// argv: the arguments
+// options: the options to fill in
+// rest: the arguments that are not frame options, in order
+// return: 0 if successful, -1 if error
+int parse_frame_options(int argc, char *argv[], FrameOptions &options, std::vector<std::string> &rest);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "frame_writer.hpp"
+
+// how long the writer sleeps when there is nothing to write, short compared to a frame
+static const std::chrono::milliseconds WRITER_IDLE(2);
+
+FrameWriter::FrameWriter(size_t buffers) : freeBuffers(buffers), jobs(buffers)
+{
+  // the pool starts with empty buffers, which are allocated by the first frames copied into them
+  for (size_t i = 0; i < buffers; i++)
+  {
+    cv::Mat buffer;
+    freeBuffers.try_push(buffer);
+  }
+
+  stopping = false;
+  closed = false;
+  videoFps = 0;
+  videoFailed = false;
+  snapshotCount = 0;
+  recordedCount = 0;
+  droppedCount = 0;
+  thread = std::thread(&FrameWriter::run, this);
+}
+
+FrameWriter::~FrameWriter()
+{
+  close();
+}
+
+int FrameWriter::snapshot(std::string filename, const cv::Mat &frame)
+{
+  if (closed)
+  {
+    return (-1);
+  }
+
+  // a snapshot was asked for, so wait for the writer to free a buffer rather than lose it
+  Job job;
+  while (!freeBuffers.try_pop(job.frame))
+  {
+    std::this_thread::yield();
+  }
+  frame.copyTo(job.frame);
+  job.filename = filename;
+  jobs.try_push(job);
+
+  return (0);
+}
+
+void FrameWriter::startRecording(std::string filename, double fps)
+{
+  videoFile = filename;
+  videoFps = fps;
+}
+
+bool FrameWriter::recording() const
+{
+  return (!videoFile.empty() && !closed);
+}
+
+bool FrameWriter::record(const cv::Mat &frame)
+{
+  if (!recording())
+  {
+    return (false);
+  }
+
+  // the video keeps going without a frame the writer has no room for
+  Job job;
+  if (!freeBuffers.try_pop(job.frame))
+  {
+    droppedCount++;
+    return (false);
+  }
+  frame.copyTo(job.frame);
+  job.video = true;
+
+  // there are as many places in the queue as buffers, so the push always succeeds
+  jobs.try_push(job);
+
+  return (true);
+}
+
+void FrameWriter::close()
+{
+  if (closed)
+  {
+    return;
+  }
+
+  // the writer drains the queue before it stops
+  closed = true;
+  stopping = true;
+  thread.join();
+  video.release();
+}
+
+void FrameWriter::report()
+{
+  if (videoFile.empty())
+  {
+    return;
+  }
+
+  printf("recording: wrote %ld frames to %s, dropped %ld\n", recordedCount.load(), videoFile.c_str(),
+         droppedCount.load());
+}
+
+// write the queued frames until stopped
+void FrameWriter::run()
+{
+  Job job;
+  for (;;)
+  {
+    // read the flag before draining, so that a frame queued before the stop is still written
+    bool stop = stopping.load();
+    while (jobs.try_pop(job))
+    {
+      write(job);
+
+      // give the buffer back to the pool, with its memory
+      freeBuffers.try_push(job.frame);
+    }
+    if (stop)
+    {
+      break;
+    }
+
+    std::this_thread::sleep_for(WRITER_IDLE);
+  }
+}
+
+// encode a frame as a snapshot or as the next frame of the video
+void FrameWriter::write(Job &job)
+{
+  if (!job.video)
+  {
+    if (!cv::imwrite(job.filename, job.frame))
+    {
+      printf("error: unable to write %s.\n", job.filename.c_str());
+      return;
+    }
+    snapshotCount++;
+    return;
+  }
+
+  // open the video with the size of its first frame
+  if (!video.isOpened() && !videoFailed)
+  {
+    bool avi = videoFile.size() >= 4 && videoFile.compare(videoFile.size() - 4, 4, ".avi") == 0;
+    int fourcc = avi ? cv::VideoWriter::fourcc('M', 'J', 'P', 'G') : cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    if (!video.open(videoFile, fourcc, videoFps, job.frame.size()))
+    {
+      printf("error: unable to write %s.\n", videoFile.c_str());
+      videoFailed = true;
+    }
+  }
+  if (videoFailed)
+  {
+    droppedCount++;
+    return;
+  }
+
+  video.write(job.frame);
+  recordedCount++;
+}
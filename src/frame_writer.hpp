@@ -0,0 +1,88 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef FRAME_WRITER_HPP
+#define FRAME_WRITER_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "pipeline.hpp"
+
+// encodes snapshots and the frames of a video on a background thread, so that the frame loop never waits for
+// the jpeg or video encoder. a frame is copied into one of a fixed pool of buffers, which are reused from frame
+// to frame, and handed over through a bounded lock-free queue. when every buffer is queued, a snapshot waits
+// for the writer to free one, while a frame of the video is dropped and counted
+class FrameWriter
+{
+public:
+  // buffers: the number of frames that can wait to be written
+  FrameWriter(size_t buffers = 8);
+  ~FrameWriter();
+
+  // queue a frame to be saved as an image, waiting for a free buffer if all of them are queued
+  // filename: the path of the image, its extension chooses the format
+  // frame: the frame, copied
+  // return: 0 if queued, -1 if the writer is closed
+  int snapshot(std::string filename, const cv::Mat &frame);
+
+  // record the following frames to a video, with the size of the first one. call it before the first record
+  // filename: the path of the video, .avi is written with MJPG and anything else with mp4v
+  // fps: the frame rate the video is played at
+  void startRecording(std::string filename, double fps);
+
+  // return: whether a video is being recorded
+  bool recording() const;
+
+  // queue a frame of the video, without waiting
+  // frame: the frame, copied
+  // return: true if queued, false if every buffer was queued and the frame was dropped
+  bool record(const cv::Mat &frame);
+
+  // write the queued frames, stop the writer thread and close the video
+  void close();
+
+  // print the number of frames recorded and dropped, if a video was recorded
+  void report();
+
+private:
+  FrameWriter(const FrameWriter &);
+  FrameWriter &operator=(const FrameWriter &);
+
+  // a frame waiting to be written, as a snapshot or as the next frame of the video
+  struct Job
+  {
+    Job() : video(false) {}
+
+    cv::Mat frame;
+    std::string filename;
+    bool video;
+  };
+
+  void run();
+  void write(Job &job);
+
+  BoundedQueue<cv::Mat> freeBuffers;
+  BoundedQueue<Job> jobs;
+  std::thread thread;
+  std::atomic<bool> stopping;
+  bool closed;
+
+  // set before the first frame of the video is queued, then only read by the writer thread
+  std::string videoFile;
+  double videoFps;
+
+  // only touched by the writer thread
+  cv::VideoWriter video;
+  bool videoFailed;
+
+  std::atomic<long> snapshotCount;
+  std::atomic<long> recordedCount;
+  std::atomic<long> droppedCount;
+};
+
+#endif
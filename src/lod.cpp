@@ -0,0 +1,300 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include "lod.hpp"
+#include "mesh_cache.hpp"
+#include "util.hpp"
+
+// a level is kept only if it has at most this fraction of the triangles of the level before it
+static const double MIN_REDUCTION = 0.75;
+
+// the quadric of a set of planes, the squared distance of a point p to them is p^T A p + 2 b^T p + c
+struct Quadric
+{
+  Quadric() : a(0, 0, 0, 0, 0, 0, 0, 0, 0), b(0, 0, 0), c(0) {}
+
+  cv::Matx33d a;
+  cv::Vec3d b;
+  double c;
+};
+
+// simplify a mesh by clustering its vertices in a grid
+// mesh: the full mesh
+// resolution: the number of cells along the longest side of the bounding box
+// data: the simplified mesh, without edges
+static void cluster_vertices(const Mesh &mesh, int resolution, MeshData &data)
+{
+  int vertexCount = mesh.vertexCount();
+  int faceCount = mesh.faceCount();
+
+  // the grid over the bounding box
+  cv::Vec3f low(mesh.x[0], mesh.y[0], mesh.z[0]), high = low;
+  for (int i = 1; i < vertexCount; i++)
+  {
+    cv::Vec3f p(mesh.x[i], mesh.y[i], mesh.z[i]);
+    for (int k = 0; k < 3; k++)
+    {
+      low[k] = std::min(low[k], p[k]);
+      high[k] = std::max(high[k], p[k]);
+    }
+  }
+  float extent = std::max(high[0] - low[0], std::max(high[1] - low[1], high[2] - low[2]));
+  float cellSize = std::max(extent, 1e-6f) / resolution;
+
+  // number the cells that have vertices, in the order of their keys
+  std::vector<std::pair<int, int>> keys(vertexCount);
+  for (int i = 0; i < vertexCount; i++)
+  {
+    int cell[3];
+    float p[3] = {mesh.x[i], mesh.y[i], mesh.z[i]};
+    for (int k = 0; k < 3; k++)
+    {
+      cell[k] = std::min(resolution - 1, (int)((p[k] - low[k]) / cellSize));
+    }
+    keys[i] = std::make_pair((cell[0] * resolution + cell[1]) * resolution + cell[2], i);
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<int> clusterOf(vertexCount);
+  int clusterCount = 0;
+  for (int i = 0; i < vertexCount; i++)
+  {
+    if (i > 0 && keys[i].first != keys[i - 1].first)
+    {
+      clusterCount++;
+    }
+    clusterOf[keys[i].second] = clusterCount;
+  }
+  clusterCount++;
+
+  // sum the planes of the triangles around the vertices of every cluster, weighted by their area,
+  // and the vertices themselves for clusters whose planes do not pin down a point
+  std::vector<Quadric> quadrics(clusterCount);
+  std::vector<cv::Vec3d> sums(clusterCount, cv::Vec3d(0, 0, 0));
+  std::vector<int> counts(clusterCount, 0);
+  for (int i = 0; i < vertexCount; i++)
+  {
+    sums[clusterOf[i]] += cv::Vec3d(mesh.x[i], mesh.y[i], mesh.z[i]);
+    counts[clusterOf[i]]++;
+  }
+  for (int f = 0; f < faceCount; f++)
+  {
+    const int *face = &mesh.indices[f * 3];
+    cv::Vec3d a(mesh.x[face[0]], mesh.y[face[0]], mesh.z[face[0]]);
+    cv::Vec3d b(mesh.x[face[1]], mesh.y[face[1]], mesh.z[face[1]]);
+    cv::Vec3d c(mesh.x[face[2]], mesh.y[face[2]], mesh.z[face[2]]);
+    cv::Vec3d normal = (b - a).cross(c - a);
+    double length = cv::norm(normal);
+    if (length == 0)
+    {
+      continue;
+    }
+
+    // the area is half the length of the cross product
+    double area = length / 2;
+    normal *= 1.0 / length;
+    double d = -normal.dot(a);
+    cv::Matx31d column = normal;
+    cv::Matx33d nnT = column * column.t();
+    for (int j = 0; j < 3; j++)
+    {
+      Quadric &q = quadrics[clusterOf[face[j]]];
+      q.a += area * nnT;
+      q.b += area * d * normal;
+      q.c += area * d * d;
+    }
+  }
+
+  // place every cluster where the squared distance to its planes is smallest,
+  // or at the average of its vertices when that point is not unique or leaves the cell
+  data = MeshData();
+  data.x.resize(clusterCount);
+  data.y.resize(clusterCount);
+  data.z.resize(clusterCount);
+  for (int i = 0; i < clusterCount; i++)
+  {
+    cv::Vec3d average = sums[i] * (1.0 / counts[i]);
+    cv::Vec3d position = average;
+    double scale = cv::trace(quadrics[i].a);
+    if (scale > 0 && std::fabs(cv::determinant(quadrics[i].a)) > 1e-9 * scale * scale * scale)
+    {
+      cv::Vec3d solution = quadrics[i].a.solve(-quadrics[i].b, cv::DECOMP_LU);
+      if (cv::norm(solution - average) < cellSize)
+      {
+        position = solution;
+      }
+    }
+    data.x[i] = (float)position[0];
+    data.y[i] = (float)position[1];
+    data.z[i] = (float)position[2];
+  }
+
+  // keep the triangles whose corners stay in different clusters, once each
+  std::vector<std::pair<long long, int>> faces;
+  faces.reserve(faceCount);
+  for (int f = 0; f < faceCount; f++)
+  {
+    long long a = clusterOf[mesh.indices[f * 3]];
+    long long b = clusterOf[mesh.indices[f * 3 + 1]];
+    long long c = clusterOf[mesh.indices[f * 3 + 2]];
+    if (a == b || b == c || a == c)
+    {
+      continue;
+    }
+    long long low = std::min(a, std::min(b, c)), high = std::max(a, std::max(b, c));
+    long long middle = a + b + c - low - high;
+    faces.push_back(std::make_pair((low << 42) | (middle << 21) | high, f));
+  }
+  std::sort(faces.begin(), faces.end());
+  for (size_t i = 0; i < faces.size(); i++)
+  {
+    if (i > 0 && faces[i].first == faces[i - 1].first)
+    {
+      continue;
+    }
+    for (int j = 0; j < 3; j++)
+    {
+      data.indices.push_back(clusterOf[mesh.indices[faces[i].second * 3 + j]]);
+    }
+  }
+}
+
+int build_lod_chain(const Mesh &mesh, int maxResolution, int minResolution, LodChain &chain)
+{
+  // the full mesh is always there, even if it cannot be simplified
+  chain = LodChain();
+  chain.levels.push_back(mesh);
+  chain.resolutions.push_back(0);
+  chain.maxResolution = maxResolution;
+  chain.minResolution = minResolution;
+
+  // error checking
+  if (mesh.vertexCount() == 0 || mesh.faceCount() == 0)
+  {
+    printf("error: mesh is empty.\n");
+    return (-1);
+  }
+
+  // error checking, the cluster keys have 21 bits per cluster and the cell keys fit in an int
+  if (mesh.vertexCount() >= (1 << 21) || maxResolution > 1024)
+  {
+    printf("error: mesh or resolution too large for levels of detail.\n");
+    return (-1);
+  }
+
+  // the bounding sphere around the center of the bounding box
+  cv::Vec3f low(mesh.x[0], mesh.y[0], mesh.z[0]), high = low;
+  for (int i = 1; i < mesh.vertexCount(); i++)
+  {
+    cv::Vec3f p(mesh.x[i], mesh.y[i], mesh.z[i]);
+    for (int k = 0; k < 3; k++)
+    {
+      low[k] = std::min(low[k], p[k]);
+      high[k] = std::max(high[k], p[k]);
+    }
+  }
+  chain.center = (low + high) * 0.5f;
+  for (int i = 0; i < mesh.vertexCount(); i++)
+  {
+    cv::Vec3f p(mesh.x[i], mesh.y[i], mesh.z[i]);
+    chain.radius = std::max(chain.radius, (float)cv::norm(p - chain.center));
+  }
+
+  for (int resolution = maxResolution; resolution >= minResolution; resolution /= 2)
+  {
+    std::shared_ptr<MeshData> data = std::make_shared<MeshData>();
+    cluster_vertices(mesh, resolution, *data);
+    if (data->faceCount() == 0)
+    {
+      break;
+    }
+    if (data->faceCount() > MIN_REDUCTION * chain.levels.back().faceCount())
+    {
+      continue;
+    }
+
+    // clustering keeps the winding of the triangles, but a coarse level may be too open to tell it on its own
+    build_bvh(*data);
+    build_edges(*data);
+    data->orientation = mesh.orientation;
+    chain.levels.push_back(make_mesh(data));
+    chain.resolutions.push_back(resolution);
+  }
+
+  return (0);
+}
+
+int read_lod_chain(std::string filename, int maxResolution, int minResolution, LodChain &chain)
+{
+  // the cache has the levels if an earlier start built them with the same resolutions
+  if (map_mesh_cache(filename, chain) == 0 && chain.maxResolution == maxResolution &&
+      chain.minResolution == minResolution)
+  {
+    return (0);
+  }
+
+  // the full mesh from a cache written without the levels, or parsed without writing a cache of its own
+  Mesh mesh;
+  if (!chain.levels.empty())
+  {
+    mesh = chain.levels[0];
+  }
+  else if (read_object_data(filename, mesh, false) != 0)
+  {
+    chain = LodChain();
+    chain.levels.push_back(mesh);
+    chain.resolutions.push_back(0);
+    return (-1);
+  }
+  if (build_lod_chain(mesh, maxResolution, minResolution, chain) != 0)
+  {
+    return (-1);
+  }
+
+  // a cache that cannot be written, e.g. in a read-only folder, only costs the next start the building
+  write_mesh_cache(filename, chain);
+
+  return (0);
+}
+
+int select_lod(const LodChain &chain, float focalLength, const cv::Vec3d &rvec, const cv::Vec3d &tvec,
+               float pixelsPerCell)
+{
+  if (pixelsPerCell <= 0 || chain.levels.size() <= 1)
+  {
+    return (0);
+  }
+
+  // the depth of the center of the bounding sphere in the camera frame
+  cv::Matx33d rotation;
+  cv::Rodrigues(rvec, rotation);
+  cv::Vec3d center = rotation * cv::Vec3d(chain.center[0], chain.center[1], chain.center[2]) + tvec;
+  if (center[2] <= chain.radius)
+  {
+    // the camera is inside or right next to the object
+    return (0);
+  }
+
+  // the number of cells along the diameter that keeps every cell within the given size on the image
+  double diameter = 2 * chain.radius * focalLength / center[2];
+  double needed = diameter / pixelsPerCell;
+
+  // the coarsest level that is fine enough
+  int level = 0;
+  for (int i = (int)chain.levels.size() - 1; i > 0; i--)
+  {
+    if (chain.resolutions[i] >= needed)
+    {
+      level = i;
+      break;
+    }
+  }
+
+  return (level);
+}
@@ -0,0 +1,69 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef LOD_HPP
+#define LOD_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "mesh.hpp"
+
+// a mesh and simplified versions of it, from the full mesh to the coarsest
+// every simplified level is built by quadric vertex clustering: the bounding box is split into a grid of cells,
+// the vertices of each cell merge into one placed where it best keeps the planes of their triangles,
+// and the triangles that collapse are dropped
+struct LodChain
+{
+  LodChain() : radius(0), maxResolution(0), minResolution(0) {}
+
+  // the levels, levels[0] is the full mesh
+  std::vector<Mesh> levels;
+
+  // the number of grid cells along the longest side of the bounding box of each level, 0 for the full mesh
+  std::vector<int> resolutions;
+
+  // the bounding sphere of the mesh
+  cv::Vec3f center;
+  float radius;
+
+  // the resolutions the chain was built with, 0 if it only has the full mesh
+  int maxResolution;
+  int minResolution;
+};
+
+// build the levels of detail of a mesh
+// every level has half the resolution of the one before, and a level that drops less than a quarter
+// of the triangles of the one before is skipped
+// mesh: the full mesh
+// maxResolution: the resolution of the finest simplified level
+// minResolution: the resolution below which no level is built
+// chain: the levels, which has at least the full mesh even on error
+// return: 0 if successful, -1 if error
+int build_lod_chain(const Mesh &mesh, int maxResolution, int minResolution, LodChain &chain);
+
+// read the levels of detail of an object file from its mesh cache, or parse the file, build them
+// and write them to the cache, so that a later start maps them instead of building them again
+// filename: the path of the object file
+// maxResolution: the resolution of the finest simplified level
+// minResolution: the resolution below which no level is built
+// chain: the levels, which has at least the full mesh even on error
+// return: 0 if successful, -1 if error
+int read_lod_chain(std::string filename, int maxResolution, int minResolution, LodChain &chain);
+
+// pick the level of detail for a pose from the size of the bounding sphere on the image
+// the coarsest level is picked whose grid cells still cover no more than the given number of pixels,
+// so that the number of triangles drawn follows the size of the object on the image and not the mesh
+// chain: the levels
+// focalLength: the focal length of the camera in pixels
+// rvec: the rotation vector
+// tvec: the translation vector
+// pixelsPerCell: the largest size of a grid cell on the image in pixels, 0 for always the full mesh
+// return: the index of the level
+int select_lod(const LodChain &chain, float focalLength, const cv::Vec3d &rvec, const cv::Vec3d &tvec,
+               float pixelsPerCell);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <opencv2/opencv.hpp>
+#include "mesh.hpp"
+
+// the largest number of triangles in a leaf of the bounding volume hierarchy
+static const int BVH_LEAF_SIZE = 64;
+
+// the signed volume below which, relative to the bounding box, a mesh is considered too open to have an orientation
+static const double MIN_VOLUME_FRACTION = 1e-3;
+
+void build_edges(MeshData &mesh)
+{
+  int faceCount = mesh.faceCount();
+
+  // key every edge of every face by its sorted vertex pair, and remember which face side it came from
+  std::vector<std::pair<long long, int>> keys(faceCount * 3);
+  for (int f = 0; f < faceCount; f++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      long long a = mesh.indices[f * 3 + j];
+      long long b = mesh.indices[f * 3 + (j + 1) % 3];
+      keys[f * 3 + j] = std::make_pair(std::min(a, b) << 32 | std::max(a, b), f * 3 + j);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+
+  // give the same edge index to equal keys
+  mesh.edges.clear();
+  mesh.faceEdges.assign(faceCount * 3, -1);
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    if (i == 0 || keys[i].first != keys[i - 1].first)
+    {
+      mesh.edges.push_back((int)(keys[i].first >> 32));
+      mesh.edges.push_back((int)(keys[i].first & 0xffffffff));
+    }
+    mesh.faceEdges[keys[i].second] = mesh.edgeCount() - 1;
+  }
+
+  // the sign of the volume enclosed by the triangles tells their orientation
+  double volume = 0;
+  for (int f = 0; f < faceCount; f++)
+  {
+    const int *face = &mesh.indices[f * 3];
+    cv::Point3d a(mesh.x[face[0]], mesh.y[face[0]], mesh.z[face[0]]);
+    cv::Point3d b(mesh.x[face[1]], mesh.y[face[1]], mesh.z[face[1]]);
+    cv::Point3d c(mesh.x[face[2]], mesh.y[face[2]], mesh.z[face[2]]);
+    volume += a.dot(b.cross(c)) / 6;
+  }
+
+  // compare it with the bounding box, a flat or open mesh encloses next to nothing
+  double boxVolume = 0;
+  if (mesh.vertexCount() > 0)
+  {
+    double width = *std::max_element(mesh.x.begin(), mesh.x.end()) - *std::min_element(mesh.x.begin(), mesh.x.end());
+    double depth = *std::max_element(mesh.y.begin(), mesh.y.end()) - *std::min_element(mesh.y.begin(), mesh.y.end());
+    double height = *std::max_element(mesh.z.begin(), mesh.z.end()) - *std::min_element(mesh.z.begin(), mesh.z.end());
+    boxVolume = width * depth * height;
+  }
+  if (std::fabs(volume) <= MIN_VOLUME_FRACTION * boxVolume)
+  {
+    mesh.orientation = 0;
+  }
+  else
+  {
+    mesh.orientation = volume > 0 ? 1 : -1;
+  }
+}
+
+Mesh make_mesh(std::shared_ptr<const MeshData> data)
+{
+  Mesh mesh;
+  if (data->vertexCount() > 0)
+  {
+    mesh.x = &data->x[0];
+    mesh.y = &data->y[0];
+    mesh.z = &data->z[0];
+  }
+  if (data->faceCount() > 0)
+  {
+    mesh.indices = &data->indices[0];
+  }
+  if (data->edgeCount() > 0 && data->faceEdges.size() == data->indices.size())
+  {
+    mesh.edges = &data->edges[0];
+    mesh.faceEdges = &data->faceEdges[0];
+  }
+  if (!data->bvh.empty())
+  {
+    mesh.bvh = &data->bvh[0];
+  }
+  mesh.vertices = data->vertexCount();
+  mesh.faces = data->faceCount();
+  mesh.edgeTotal = mesh.edges == NULL ? 0 : data->edgeCount();
+  mesh.bvhNodes = (int)data->bvh.size();
+  mesh.orientation = data->orientation;
+  mesh.storage = data;
+
+  return (mesh);
+}
+
+// build a node of the bounding volume hierarchy and its children
+// mesh: the mesh
+// centroids: the centroid of every triangle
+// order: the triangles in the order of the hierarchy, the range of the node is sorted here
+// start: the first triangle of the node in order
+// count: the number of triangles of the node
+// nodes: the nodes, which the node and its children are appended to
+static void build_bvh_node(const MeshData &mesh, const std::vector<cv::Vec3f> &centroids, std::vector<int> &order,
+                           int start, int count, std::vector<BvhNode> &nodes)
+{
+  int index = (int)nodes.size();
+  nodes.push_back(BvhNode());
+
+  // the bounds of the triangles and of their centroids
+  BvhNode node;
+  cv::Vec3f low = centroids[order[start]], high = low;
+  for (int k = 0; k < 3; k++)
+  {
+    node.low[k] = FLT_MAX;
+    node.high[k] = -FLT_MAX;
+  }
+  for (int i = start; i < start + count; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      int v = mesh.indices[order[i] * 3 + j];
+      float p[3] = {mesh.x[v], mesh.y[v], mesh.z[v]};
+      for (int k = 0; k < 3; k++)
+      {
+        node.low[k] = std::min(node.low[k], p[k]);
+        node.high[k] = std::max(node.high[k], p[k]);
+      }
+    }
+    for (int k = 0; k < 3; k++)
+    {
+      low[k] = std::min(low[k], centroids[order[i]][k]);
+      high[k] = std::max(high[k], centroids[order[i]][k]);
+    }
+  }
+  node.start = start;
+  node.count = count;
+  node.right = 0;
+
+  // split at the median centroid along the longest side, unless the node is small or all centroids coincide
+  cv::Vec3f extent = high - low;
+  int axis = extent[0] >= extent[1] && extent[0] >= extent[2] ? 0 : (extent[1] >= extent[2] ? 1 : 2);
+  if (count > BVH_LEAF_SIZE && extent[axis] > 0)
+  {
+    int half = count / 2;
+    std::nth_element(order.begin() + start, order.begin() + start + half, order.begin() + start + count,
+                     [&](int a, int b)
+                     { return (centroids[a][axis] < centroids[b][axis]); });
+    build_bvh_node(mesh, centroids, order, start, half, nodes);
+    node.right = (int)nodes.size();
+    build_bvh_node(mesh, centroids, order, start + half, count - half, nodes);
+  }
+  nodes[index] = node;
+}
+
+void build_bvh(MeshData &mesh)
+{
+  mesh.bvh.clear();
+  int faceCount = mesh.faceCount();
+  if (faceCount == 0)
+  {
+    return;
+  }
+
+  std::vector<cv::Vec3f> centroids(faceCount);
+  std::vector<int> order(faceCount);
+  for (int f = 0; f < faceCount; f++)
+  {
+    const int *face = &mesh.indices[f * 3];
+    centroids[f] = cv::Vec3f(mesh.x[face[0]] + mesh.x[face[1]] + mesh.x[face[2]],
+                             mesh.y[face[0]] + mesh.y[face[1]] + mesh.y[face[2]],
+                             mesh.z[face[0]] + mesh.z[face[1]] + mesh.z[face[2]]) * (1.0f / 3);
+    order[f] = f;
+  }
+  build_bvh_node(mesh, centroids, order, 0, faceCount, mesh.bvh);
+
+  // reorder the triangles, so that every node covers a contiguous range
+  std::vector<int> indices(mesh.indices.size());
+  for (int f = 0; f < faceCount; f++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      indices[f * 3 + j] = mesh.indices[order[f] * 3 + j];
+    }
+  }
+  mesh.indices.swap(indices);
+  mesh.faceEdges.clear();
+  mesh.edges.clear();
+}
@@ -0,0 +1,140 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// a node of a bounding volume hierarchy over the triangles of a mesh
+// the nodes are stored depth first, so the left child of an inner node follows it, and the triangles are ordered
+// so that every node covers a contiguous range of them
+struct BvhNode
+{
+  float low[3];  // the corner of the bounding box with the smallest coordinates
+  float high[3]; // the corner of the bounding box with the largest coordinates
+  int start;     // the first triangle of the node
+  int count;     // the number of triangles of the node
+  int right;     // the index of the right child, 0 for a leaf
+};
+
+// the arrays of a triangle mesh, as built by a parser
+// the vertex coordinates are kept in separate contiguous arrays (structure of arrays)
+// and the triangles in one flat index buffer with three vertex indices per triangle
+// the unique edges are built once at load time, so that a wireframe draws every edge once
+struct MeshData
+{
+  MeshData() : orientation(0) {}
+
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<int> indices;
+
+  // two vertex indices per unique edge, and the three edges of every triangle
+  std::vector<int> edges;
+  std::vector<int> faceEdges;
+
+  // the bounding volume hierarchy over the triangles, empty if there is none
+  std::vector<BvhNode> bvh;
+
+  // 1 if the triangles are counter-clockwise seen from outside, -1 if clockwise,
+  // 0 if the mesh is too open or inconsistent to tell, which disables back-face culling
+  int orientation;
+
+  // return: the number of vertices
+  int vertexCount() const { return ((int)x.size()); }
+
+  // return: the number of triangles
+  int faceCount() const { return ((int)indices.size() / 3); }
+
+  // return: the number of unique edges
+  int edgeCount() const { return ((int)edges.size() / 2); }
+};
+
+// build the unique edges of a mesh and find the orientation of its triangles
+// mesh: the mesh, whose edges, faceEdges and orientation are filled in
+void build_edges(MeshData &mesh);
+
+// a read-only view of a triangle mesh laid out for rendering, with the same arrays as MeshData
+// the arrays live either in a MeshData or in a memory-mapped cache file, and the view keeps whichever it is alive,
+// so copies of a mesh are cheap and share the memory
+struct Mesh
+{
+  Mesh() : x(NULL), y(NULL), z(NULL), indices(NULL), edges(NULL), faceEdges(NULL), bvh(NULL),
+           vertices(0), faces(0), edgeTotal(0), bvhNodes(0), orientation(0) {}
+
+  const float *x;
+  const float *y;
+  const float *z;
+  const int *indices;
+  const int *edges;
+  const int *faceEdges;
+  const BvhNode *bvh;
+  int vertices;
+  int faces;
+  int edgeTotal;
+  int bvhNodes;
+  int orientation;
+
+  // the memory behind the arrays
+  std::shared_ptr<const void> storage;
+
+  // return: the number of vertices
+  int vertexCount() const { return (vertices); }
+
+  // return: the number of triangles
+  int faceCount() const { return (faces); }
+
+  // return: the number of unique edges
+  int edgeCount() const { return (edgeTotal); }
+};
+
+// make a view of the arrays of a mesh
+// data: the arrays, which the view keeps alive
+// return: the view
+Mesh make_mesh(std::shared_ptr<const MeshData> data);
+
+// build a bounding volume hierarchy over the triangles of a mesh, and reorder the triangles to match it
+// it has to be built before the edges, which refer to the triangles by their order
+// mesh: the mesh, whose indices are reordered and bvh filled in
+void build_bvh(MeshData &mesh);
+
+// buffers that the renderer reuses from frame to frame, so that drawing does not allocate
+// once they have grown to the size of the mesh
+struct RenderBuffers
+{
+  RenderBuffers() : vertexStamp(0), stamp(0) {}
+
+  std::vector<cv::Point2f> imagePoints;
+
+  // the vertices in the camera frame and which side of the view frustum they are outside of
+  std::vector<float> cameraX;
+  std::vector<float> cameraY;
+  std::vector<float> cameraZ;
+  std::vector<unsigned char> outcodes;
+
+  // the ranges of triangles as start and count that the bounding volume hierarchy did not cull
+  std::vector<cv::Vec2i> faceRanges;
+
+  // the vertices of those triangles when only they are transformed, found with per-vertex stamps,
+  // and their coordinates gathered for the projection
+  std::vector<int> vertexList;
+  std::vector<unsigned int> vertexStamps;
+  unsigned int vertexStamp;
+  std::vector<float> gatherX, gatherY, gatherZ;
+  std::vector<cv::Point2f> gatherPoints;
+  std::vector<float> gatherCameraX, gatherCameraY, gatherCameraZ;
+  std::vector<unsigned char> gatherOutcodes;
+
+  // the frame in which each edge was last drawn, so that shared edges are drawn once without clearing
+  std::vector<unsigned int> edgeStamps;
+  unsigned int stamp;
+};
+
+#endif
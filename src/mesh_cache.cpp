@@ -0,0 +1,440 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "mesh_cache.hpp"
+
+// the first bytes of a cache file
+static const char CACHE_MAGIC[8] = {'A', 'R', 'M', 'E', 'S', 'H', 0, 0};
+
+// the version of the format, increased whenever the layout or what the object loader bakes into the vertices changes
+static const uint32_t CACHE_VERSION = 4;
+
+// written as is, so that a cache written on a machine of the other byte order is rejected
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+// every array starts at a multiple of this many bytes, so that it can be loaded with aligned SIMD loads
+static const uint64_t CACHE_ALIGNMENT = 64;
+
+// the arrays of a mesh in the order they are stored
+enum CacheArray
+{
+  CACHE_X,
+  CACHE_Y,
+  CACHE_Z,
+  CACHE_INDICES,
+  CACHE_EDGES,
+  CACHE_FACE_EDGES,
+  CACHE_BVH,
+  CACHE_ARRAYS,
+};
+
+// the most levels of detail a cache file holds
+static const int CACHE_MAX_LEVELS = 16;
+
+// the header at the start of a cache file, followed by the table of levels and then their arrays
+struct CacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+
+  // the size and modification time in nanoseconds of the object file the cache was built from
+  uint64_t sourceSize;
+  int64_t sourceTime;
+
+  // the levels of detail, the first being the full mesh, and how they were built, see LodChain
+  int32_t levelCount;
+  int32_t maxResolution;
+  int32_t minResolution;
+  float center[3];
+  float radius;
+  int32_t reserved;
+};
+
+// a level of detail in the table after the header
+struct CacheLevel
+{
+  int32_t vertexCount;
+  int32_t faceCount;
+  int32_t edgeCount;
+  int32_t orientation;
+  int32_t bvhNodeCount;
+  int32_t resolution;
+
+  // the offset of each array from the start of the file
+  uint64_t offsets[CACHE_ARRAYS];
+};
+
+MappedFile::MappedFile()
+{
+  address = NULL;
+  length = 0;
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+int MappedFile::open(std::string path)
+{
+  close();
+
+#ifdef _WIN32
+  // without mmap, read the file into memory instead
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+  {
+    return (-1);
+  }
+  size_t size = (size_t)file.tellg();
+  void *buffer = malloc(size > 0 ? size : 1);
+  file.seekg(0);
+  if (buffer == NULL || !file.read((char *)buffer, size))
+  {
+    free(buffer);
+    return (-1);
+  }
+  address = buffer;
+  length = size;
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return (-1);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0)
+  {
+    ::close(fd);
+    return (-1);
+  }
+
+  // the mapping stays valid after the descriptor is closed
+  void *mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    return (-1);
+  }
+  address = mapped;
+  length = (size_t)info.st_size;
+#endif
+
+  return (0);
+}
+
+void MappedFile::close()
+{
+  if (address == NULL)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  free(address);
+#else
+  munmap(address, length);
+#endif
+  address = NULL;
+  length = 0;
+}
+
+const void *MappedFile::data() const
+{
+  return (address);
+}
+
+size_t MappedFile::size() const
+{
+  return (length);
+}
+
+std::string mesh_cache_path(std::string filename)
+{
+  return (filename + ".meshcache");
+}
+
+// get the size and modification time of a file
+// filename: the path of the file
+// size: the size in bytes
+// time: the modification time in nanoseconds, so that an edit within the same second that keeps the size is seen
+// return: 0 if successful, -1 if error
+static int file_stamp(std::string filename, uint64_t &size, int64_t &time)
+{
+  struct stat info;
+  if (stat(filename.c_str(), &info) != 0)
+  {
+    return (-1);
+  }
+  size = (uint64_t)info.st_size;
+#if defined(_WIN32)
+  time = (int64_t)info.st_mtime * 1000000000;
+#elif defined(__APPLE__)
+  time = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+  time = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+
+  return (0);
+}
+
+// point a mesh into a level of a mapped cache file
+// level: the level in the table
+// file: the mapped cache file, which the mesh keeps alive
+// mesh: the view of the level
+// return: 0 if successful, -1 if an array does not lie inside the file
+static int map_level(const CacheLevel &level, const std::shared_ptr<MappedFile> &file, Mesh &mesh)
+{
+  // check that every array lies inside the file, the contents are trusted so that mapping does not touch them
+  if (level.vertexCount <= 0 || level.faceCount <= 0 || level.edgeCount <= 0 || level.bvhNodeCount < 0)
+  {
+    return (-1);
+  }
+  uint64_t lengths[CACHE_ARRAYS] = {(uint64_t)level.vertexCount * sizeof(float),
+                                    (uint64_t)level.vertexCount * sizeof(float),
+                                    (uint64_t)level.vertexCount * sizeof(float),
+                                    (uint64_t)level.faceCount * 3 * sizeof(int32_t),
+                                    (uint64_t)level.edgeCount * 2 * sizeof(int32_t),
+                                    (uint64_t)level.faceCount * 3 * sizeof(int32_t),
+                                    (uint64_t)level.bvhNodeCount * sizeof(BvhNode)};
+  for (int i = 0; i < CACHE_ARRAYS; i++)
+  {
+    if (level.offsets[i] % CACHE_ALIGNMENT != 0 || level.offsets[i] > file->size() ||
+        lengths[i] > file->size() - level.offsets[i])
+    {
+      return (-1);
+    }
+  }
+
+  // point the view into the mapped file
+  const char *base = (const char *)file->data();
+  mesh = Mesh();
+  mesh.x = (const float *)(base + level.offsets[CACHE_X]);
+  mesh.y = (const float *)(base + level.offsets[CACHE_Y]);
+  mesh.z = (const float *)(base + level.offsets[CACHE_Z]);
+  mesh.indices = (const int *)(base + level.offsets[CACHE_INDICES]);
+  mesh.edges = (const int *)(base + level.offsets[CACHE_EDGES]);
+  mesh.faceEdges = (const int *)(base + level.offsets[CACHE_FACE_EDGES]);
+  mesh.bvh = level.bvhNodeCount > 0 ? (const BvhNode *)(base + level.offsets[CACHE_BVH]) : NULL;
+  mesh.vertices = level.vertexCount;
+  mesh.faces = level.faceCount;
+  mesh.edgeTotal = level.edgeCount;
+  mesh.bvhNodes = level.bvhNodeCount;
+  mesh.orientation = level.orientation;
+  mesh.storage = file;
+
+  return (0);
+}
+
+int map_mesh_cache(std::string filename, LodChain &chain)
+{
+  chain = LodChain();
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  if (file_stamp(filename, sourceSize, sourceTime) != 0)
+  {
+    return (-1);
+  }
+
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+  if (file->open(mesh_cache_path(filename)) != 0 || file->size() < sizeof(CacheHeader))
+  {
+    return (-1);
+  }
+
+  // check that the cache was written by this version from this object file
+  CacheHeader header;
+  memcpy(&header, file->data(), sizeof(header));
+  if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+      header.byteOrder != CACHE_BYTE_ORDER || header.sourceSize != sourceSize || header.sourceTime != sourceTime)
+  {
+    return (-1);
+  }
+  if (header.levelCount < 1 || header.levelCount > CACHE_MAX_LEVELS ||
+      file->size() < sizeof(header) + header.levelCount * sizeof(CacheLevel))
+  {
+    return (-1);
+  }
+
+  // map every level
+  LodChain mapped;
+  mapped.center = cv::Vec3f(header.center[0], header.center[1], header.center[2]);
+  mapped.radius = header.radius;
+  mapped.maxResolution = header.maxResolution;
+  mapped.minResolution = header.minResolution;
+  for (int l = 0; l < header.levelCount; l++)
+  {
+    CacheLevel level;
+    memcpy(&level, (const char *)file->data() + sizeof(header) + l * sizeof(CacheLevel), sizeof(level));
+    Mesh mesh;
+    if (map_level(level, file, mesh) != 0)
+    {
+      return (-1);
+    }
+    mapped.levels.push_back(mesh);
+    mapped.resolutions.push_back(level.resolution);
+  }
+  chain = mapped;
+
+  return (0);
+}
+
+int map_mesh_cache(std::string filename, Mesh &mesh)
+{
+  LodChain chain;
+  if (map_mesh_cache(filename, chain) != 0)
+  {
+    return (-1);
+  }
+  mesh = chain.levels[0];
+
+  return (0);
+}
+
+int write_mesh_cache(std::string filename, const Mesh &mesh)
+{
+  LodChain chain;
+  chain.levels.push_back(mesh);
+  chain.resolutions.push_back(0);
+
+  return (write_mesh_cache(filename, chain));
+}
+
+int write_mesh_cache(std::string filename, const LodChain &chain)
+{
+  // error checking
+  int levelCount = (int)chain.levels.size();
+  if (levelCount < 1 || levelCount > CACHE_MAX_LEVELS || chain.resolutions.size() != chain.levels.size())
+  {
+    printf("error: no levels or too many levels to cache.\n");
+    return (-1);
+  }
+  for (int l = 0; l < levelCount; l++)
+  {
+    const Mesh &mesh = chain.levels[l];
+    if (mesh.vertexCount() == 0 || mesh.faceCount() == 0 || mesh.faceEdges == NULL)
+    {
+      printf("error: mesh is empty or has no edges.\n");
+      return (-1);
+    }
+  }
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.byteOrder = CACHE_BYTE_ORDER;
+  if (file_stamp(filename, header.sourceSize, header.sourceTime) != 0)
+  {
+    printf("error: unable to stat %s.\n", filename.c_str());
+    return (-1);
+  }
+  header.levelCount = levelCount;
+  header.maxResolution = chain.maxResolution;
+  header.minResolution = chain.minResolution;
+  for (int k = 0; k < 3; k++)
+  {
+    header.center[k] = chain.center[k];
+  }
+  header.radius = chain.radius;
+
+  // lay out the arrays of the levels one after another after the table, each aligned
+  std::vector<CacheLevel> table(levelCount);
+  std::vector<const void *> arrays;
+  std::vector<uint64_t> lengths;
+  uint64_t offset = sizeof(header) + levelCount * sizeof(CacheLevel);
+  for (int l = 0; l < levelCount; l++)
+  {
+    const Mesh &mesh = chain.levels[l];
+    CacheLevel &level = table[l];
+    memset(&level, 0, sizeof(level));
+    level.vertexCount = mesh.vertexCount();
+    level.faceCount = mesh.faceCount();
+    level.edgeCount = mesh.edgeCount();
+    level.orientation = mesh.orientation;
+    level.bvhNodeCount = mesh.bvh == NULL ? 0 : mesh.bvhNodes;
+    level.resolution = chain.resolutions[l];
+
+    const void *levelArrays[CACHE_ARRAYS] = {mesh.x, mesh.y, mesh.z, mesh.indices, mesh.edges, mesh.faceEdges,
+                                             mesh.bvh};
+    uint64_t levelLengths[CACHE_ARRAYS] = {(uint64_t)mesh.vertexCount() * sizeof(float),
+                                           (uint64_t)mesh.vertexCount() * sizeof(float),
+                                           (uint64_t)mesh.vertexCount() * sizeof(float),
+                                           (uint64_t)mesh.faceCount() * 3 * sizeof(int),
+                                           (uint64_t)mesh.edgeCount() * 2 * sizeof(int),
+                                           (uint64_t)mesh.faceCount() * 3 * sizeof(int),
+                                           (uint64_t)level.bvhNodeCount * sizeof(BvhNode)};
+    for (int i = 0; i < CACHE_ARRAYS; i++)
+    {
+      offset = (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+      level.offsets[i] = offset;
+      offset += levelLengths[i];
+      arrays.push_back(levelArrays[i]);
+      lengths.push_back(levelLengths[i]);
+    }
+  }
+
+  // write under a name of this process, then move it in place
+#ifdef _WIN32
+  std::string temporary = mesh_cache_path(filename) + ".tmp" + std::to_string(_getpid());
+#else
+  std::string temporary = mesh_cache_path(filename) + ".tmp" + std::to_string(getpid());
+#endif
+  std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    printf("error: unable to write %s.\n", temporary.c_str());
+    return (-1);
+  }
+  file.write((const char *)&header, sizeof(header));
+  file.write((const char *)&table[0], (std::streamsize)(levelCount * sizeof(CacheLevel)));
+  static const char padding[CACHE_ALIGNMENT] = {0};
+  uint64_t written = sizeof(header) + levelCount * sizeof(CacheLevel);
+  for (size_t i = 0; i < arrays.size(); i++)
+  {
+    uint64_t start = table[i / CACHE_ARRAYS].offsets[i % CACHE_ARRAYS];
+    file.write(padding, (std::streamsize)(start - written));
+    file.write((const char *)arrays[i], (std::streamsize)lengths[i]);
+    written = start + lengths[i];
+  }
+  file.close();
+  if (file.fail())
+  {
+    printf("error: unable to write %s.\n", temporary.c_str());
+    remove(temporary.c_str());
+    return (-1);
+  }
+
+#ifdef _WIN32
+  // rename does not replace an existing file on windows
+  remove(mesh_cache_path(filename).c_str());
+#endif
+  if (rename(temporary.c_str(), mesh_cache_path(filename).c_str()) != 0)
+  {
+    printf("error: unable to write %s.\n", mesh_cache_path(filename).c_str());
+    remove(temporary.c_str());
+    return (-1);
+  }
+
+  return (0);
+}
@@ -0,0 +1,75 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <cstddef>
+#include <string>
+#include "lod.hpp"
+#include "mesh.hpp"
+
+// a file mapped read-only into memory, so that every process mapping it shares the same pages
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  // map a file, unmapping the previous one
+  // path: the path of the file
+  // return: 0 if successful, -1 if error
+  int open(std::string path);
+
+  // return: the first byte of the file, NULL if none is mapped
+  const void *data() const;
+
+  // return: the size of the file in bytes
+  size_t size() const;
+
+private:
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+  void close();
+
+  void *address;
+  size_t length;
+};
+
+// get the path of the cache file of an object file
+// filename: the path of the object file
+// return: the path of the cache file next to it
+std::string mesh_cache_path(std::string filename);
+
+// map the cache file of an object file, if it is up to date
+// a cache is stale when it was written by another version of the format, or from an object file
+// of another size or modification time
+// filename: the path of the object file
+// mesh: the full mesh, a view of the mapped cache file
+// return: 0 if successful, -1 if there is no cache file or it is stale
+int map_mesh_cache(std::string filename, Mesh &mesh);
+
+// map the cache file of an object file with its levels of detail, if it is up to date
+// filename: the path of the object file
+// chain: the levels, views of the mapped cache file, only the full mesh if the cache was written without levels,
+// or empty if there is no cache file or it is stale
+// return: 0 if successful, -1 if there is no cache file or it is stale
+int map_mesh_cache(std::string filename, LodChain &chain);
+
+// write the cache file of an object file
+// the file is written under a temporary name and renamed, so that another process never maps a partial file
+// filename: the path of the object file
+// mesh: the mesh read from the object file
+// return: 0 if successful, -1 if error
+int write_mesh_cache(std::string filename, const Mesh &mesh);
+
+// write the cache file of an object file with its levels of detail
+// filename: the path of the object file
+// chain: the levels built from the mesh read from the object file
+// return: 0 if successful, -1 if error
+int write_mesh_cache(std::string filename, const LodChain &chain);
+
+#endif
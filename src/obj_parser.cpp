@@ -0,0 +1,440 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <opencv2/opencv.hpp>
+#include "mesh_cache.hpp"
+#include "obj_parser.hpp"
+
+// a chunk is never smaller than this, so that small files are parsed on one thread
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+// the significant digits kept of a number, more than a double can hold
+static const int MAX_DIGITS = 19;
+
+// the powers of ten that a double holds exactly
+static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// the vertices and triangles of one chunk of the file
+struct ObjChunk
+{
+  ObjChunk() : begin(NULL), end(NULL), error(NULL), errorLine(0) {}
+
+  const char *begin;
+  const char *end;
+
+  std::vector<float> x, y, z;
+
+  // the triangles, whose vertex indices are absolute, except for the ones listed in relative,
+  // which came from negative indices and count from the first vertex of the chunk
+  std::vector<int> indices;
+  std::vector<int> relative;
+
+  ObjStats stats;
+
+  // the first error in the chunk and the line of the chunk it is on
+  const char *error;
+  long errorLine;
+};
+
+// skip spaces and tabs
+// p: the current position
+// end: the end of the line
+// return: the first other character
+static inline const char *skip_blanks(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+  {
+    p++;
+  }
+
+  return (p);
+}
+
+// parse a decimal number like strtof, but independent of the locale
+// p: the current position
+// end: the end of the line
+// value: the number
+// return: the position after the number, NULL if there is no number
+static inline const char *parse_float(const char *p, const char *end, float &value)
+{
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    negative = *p == '-';
+    p++;
+  }
+
+  // collect the significant digits, and the power of ten they are scaled by
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  while (p < end && (unsigned)(*p - '0') < 10)
+  {
+    if (digits < MAX_DIGITS)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    }
+    else
+    {
+      exponent++;
+    }
+    any = true;
+    p++;
+  }
+  if (p < end && *p == '.')
+  {
+    p++;
+    while (p < end && (unsigned)(*p - '0') < 10)
+    {
+      if (digits < MAX_DIGITS)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+      any = true;
+      p++;
+    }
+  }
+  if (!any)
+  {
+    return (NULL);
+  }
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char *q = p + 1;
+    bool negativeExponent = false;
+    if (q < end && (*q == '-' || *q == '+'))
+    {
+      negativeExponent = *q == '-';
+      q++;
+    }
+    if (q < end && (unsigned)(*q - '0') < 10)
+    {
+      int e = 0;
+      while (q < end && (unsigned)(*q - '0') < 10)
+      {
+        e = std::min(e * 10 + (*q - '0'), 10000);
+        q++;
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  // scale in double precision, which rounds to the nearest float in all but pathological cases
+  double result = (double)mantissa;
+  if (exponent < 0)
+  {
+    result = -exponent <= 22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+  }
+  else if (exponent > 0)
+  {
+    result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+  }
+  value = (float)(negative ? -result : result);
+
+  return (p);
+}
+
+// parse a decimal integer
+// p: the current position
+// end: the end of the line
+// value: the integer
+// return: the position after the integer, NULL if there is no integer
+static inline const char *parse_int(const char *p, const char *end, long long &value)
+{
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    negative = *p == '-';
+    p++;
+  }
+  if (p >= end || (unsigned)(*p - '0') >= 10)
+  {
+    return (NULL);
+  }
+  long long result = 0;
+  while (p < end && (unsigned)(*p - '0') < 10)
+  {
+    result = std::min(result * 10 + (*p - '0'), (long long)INT32_MAX + 1);
+    p++;
+  }
+  value = negative ? -result : result;
+
+  return (p);
+}
+
+// parse the corners of a face and split it into a fan of triangles
+// p: the position after the f
+// end: the end of the line
+// chunk: the chunk to add the triangles to
+// polygon: reused buffer of the vertex indices of the corners
+// polygonRelative: reused buffer of whether each corner counts from the first vertex of the chunk
+// return: NULL if successful, the error otherwise
+static const char *parse_face(const char *p, const char *end, ObjChunk &chunk, std::vector<int> &polygon,
+                              std::vector<char> &polygonRelative)
+{
+  polygon.clear();
+  polygonRelative.clear();
+  long localVertices = (long)chunk.x.size();
+  while ((p = skip_blanks(p, end)) < end)
+  {
+    // the vertex index, then the optional texture coordinate and normal indices, which are not used
+    long long index;
+    p = parse_int(p, end, index);
+    if (p == NULL || index == 0 || index > INT32_MAX)
+    {
+      return ("invalid face");
+    }
+    for (int i = 0; i < 2 && p < end && *p == '/'; i++)
+    {
+      long long unused;
+      const char *q = parse_int(p + 1, end, unused);
+      p = q == NULL ? p + 1 : q;
+    }
+    if (p < end && *p != ' ' && *p != '\t')
+    {
+      return ("invalid face");
+    }
+
+    // a positive index counts from the first vertex of the file, a negative one back from the last vertex so far
+    if (index > 0)
+    {
+      polygon.push_back((int)(index - 1));
+      polygonRelative.push_back(0);
+    }
+    else
+    {
+      polygon.push_back((int)(localVertices + index));
+      polygonRelative.push_back(1);
+    }
+  }
+
+  if (polygon.size() < 3)
+  {
+    return ("face with less than three corners");
+  }
+
+  for (size_t i = 1; i + 1 < polygon.size(); i++)
+  {
+    size_t corners[3] = {0, i, i + 1};
+    for (int j = 0; j < 3; j++)
+    {
+      if (polygonRelative[corners[j]])
+      {
+        chunk.relative.push_back((int)chunk.indices.size());
+      }
+      chunk.indices.push_back(polygon[corners[j]]);
+    }
+    chunk.stats.triangles++;
+  }
+  chunk.stats.polygons++;
+
+  return (NULL);
+}
+
+// parse the lines of a chunk
+// chunk: the chunk, whose begin and end are set
+static void parse_chunk(ObjChunk &chunk)
+{
+  // guess the sizes from the length of a typical line
+  size_t guess = (chunk.end - chunk.begin) / 64;
+  chunk.x.reserve(guess);
+  chunk.y.reserve(guess);
+  chunk.z.reserve(guess);
+  chunk.indices.reserve(guess * 3);
+
+  std::vector<int> polygon;
+  std::vector<char> polygonRelative;
+  const char *p = chunk.begin;
+  while (p < chunk.end)
+  {
+    const char *lineEnd = (const char *)memchr(p, '\n', chunk.end - p);
+    if (lineEnd == NULL)
+    {
+      lineEnd = chunk.end;
+    }
+    const char *next = lineEnd + 1;
+    chunk.stats.lines++;
+
+    // ignore the carriage return of windows line endings
+    if (lineEnd > p && lineEnd[-1] == '\r')
+    {
+      lineEnd--;
+    }
+
+    // get the first word of the line, which indicates the type of the line
+    p = skip_blanks(p, lineEnd);
+    const char *word = p;
+    while (p < lineEnd && *p != ' ' && *p != '\t')
+    {
+      p++;
+    }
+    size_t length = p - word;
+
+    const char *error = NULL;
+    if (length == 1 && word[0] == 'v')
+    {
+      float x, y, z;
+      if ((p = parse_float(skip_blanks(p, lineEnd), lineEnd, x)) == NULL ||
+          (p = parse_float(skip_blanks(p, lineEnd), lineEnd, y)) == NULL ||
+          (p = parse_float(skip_blanks(p, lineEnd), lineEnd, z)) == NULL)
+      {
+        error = "invalid vertex";
+      }
+      else
+      {
+        chunk.x.push_back(x);
+        chunk.y.push_back(y);
+        chunk.z.push_back(z);
+        chunk.stats.vertices++;
+      }
+    }
+    else if (length == 1 && word[0] == 'f')
+    {
+      error = parse_face(p, lineEnd, chunk, polygon, polygonRelative);
+    }
+    else if (length == 2 && word[0] == 'v' && word[1] == 't')
+    {
+      chunk.stats.texcoords++;
+    }
+    else if (length == 2 && word[0] == 'v' && word[1] == 'n')
+    {
+      chunk.stats.normals++;
+    }
+
+    // stop at the first error, the chunks after it are not needed
+    if (error != NULL)
+    {
+      chunk.error = error;
+      chunk.errorLine = chunk.stats.lines;
+      return;
+    }
+
+    p = next;
+  }
+}
+
+int parse_obj(const char *data, size_t size, MeshData &mesh, int threads, ObjStats *stats)
+{
+  // split the text into chunks that start at the beginning of a line
+  if (threads <= 0)
+  {
+    threads = std::max(1, cv::getNumThreads());
+  }
+  size_t chunkCount = std::max((size_t)1, std::min((size_t)threads, size / MIN_CHUNK_SIZE));
+  std::vector<ObjChunk> chunks(chunkCount);
+  const char *end = data + size;
+  const char *p = data;
+  for (size_t i = 0; i < chunkCount; i++)
+  {
+    chunks[i].begin = p;
+    if (i + 1 == chunkCount)
+    {
+      p = end;
+    }
+    else
+    {
+      p = std::max(p, data + size / chunkCount * (i + 1));
+      const char *newline = (const char *)memchr(p, '\n', end - p);
+      p = newline == NULL ? end : newline + 1;
+    }
+    chunks[i].end = p;
+  }
+
+  cv::parallel_for_(cv::Range(0, (int)chunkCount), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      parse_chunk(chunks[i]);
+    }
+  });
+
+  // report the first error with its line in the file
+  long line = 0;
+  for (size_t i = 0; i < chunkCount; i++)
+  {
+    if (chunks[i].error != NULL)
+    {
+      printf("error: %s on line %ld.\n", chunks[i].error, line + chunks[i].errorLine);
+      return (-1);
+    }
+    line += chunks[i].stats.lines;
+  }
+
+  // find where each chunk goes in the mesh
+  std::vector<size_t> vertexBase(chunkCount + 1, 0), indexBase(chunkCount + 1, 0);
+  for (size_t i = 0; i < chunkCount; i++)
+  {
+    vertexBase[i + 1] = vertexBase[i] + chunks[i].x.size();
+    indexBase[i + 1] = indexBase[i] + chunks[i].indices.size();
+  }
+  if (vertexBase[chunkCount] > (size_t)INT32_MAX || indexBase[chunkCount] > (size_t)INT32_MAX)
+  {
+    printf("error: too many vertices or faces.\n");
+    return (-1);
+  }
+
+  // copy the chunks into the mesh in parallel, resolving the relative indices
+  mesh = MeshData();
+  mesh.x.resize(vertexBase[chunkCount]);
+  mesh.y.resize(vertexBase[chunkCount]);
+  mesh.z.resize(vertexBase[chunkCount]);
+  mesh.indices.resize(indexBase[chunkCount]);
+  cv::parallel_for_(cv::Range(0, (int)chunkCount), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      ObjChunk &chunk = chunks[i];
+      std::copy(chunk.x.begin(), chunk.x.end(), mesh.x.begin() + vertexBase[i]);
+      std::copy(chunk.y.begin(), chunk.y.end(), mesh.y.begin() + vertexBase[i]);
+      std::copy(chunk.z.begin(), chunk.z.end(), mesh.z.begin() + vertexBase[i]);
+      for (size_t j = 0; j < chunk.relative.size(); j++)
+      {
+        chunk.indices[chunk.relative[j]] += (int)vertexBase[i];
+      }
+      std::copy(chunk.indices.begin(), chunk.indices.end(), mesh.indices.begin() + indexBase[i]);
+    }
+  });
+
+  if (stats != NULL)
+  {
+    *stats = ObjStats();
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+      stats->lines += chunks[i].stats.lines;
+      stats->vertices += chunks[i].stats.vertices;
+      stats->texcoords += chunks[i].stats.texcoords;
+      stats->normals += chunks[i].stats.normals;
+      stats->polygons += chunks[i].stats.polygons;
+      stats->triangles += chunks[i].stats.triangles;
+    }
+  }
+
+  return (0);
+}
+
+int parse_obj_file(std::string filename, MeshData &mesh, int threads, ObjStats *stats)
+{
+  // map the file, it is read once front to back
+  MappedFile file;
+  if (file.open(filename) != 0)
+  {
+    printf("error: unable to open file.\n");
+    return (-1);
+  }
+
+  return (parse_obj((const char *)file.data(), file.size(), mesh, threads, stats));
+}
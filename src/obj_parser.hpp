@@ -0,0 +1,51 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef OBJ_PARSER_HPP
+#define OBJ_PARSER_HPP
+
+#include <cstddef>
+#include <string>
+#include "mesh.hpp"
+
+// what a parsed obj file contained
+struct ObjStats
+{
+  ObjStats() : lines(0), vertices(0), texcoords(0), normals(0), polygons(0), triangles(0) {}
+
+  long lines;
+  long vertices;
+  long texcoords; // vt lines, which are skipped
+  long normals;   // vn lines, which are skipped
+  long polygons;  // f lines
+  long triangles; // the triangles the polygons were split into
+};
+
+// parse the vertices and faces of an obj file in memory
+// the text is split into chunks at line boundaries and the chunks are parsed in parallel, without locales or streams
+// supported are:
+//   v x y z [w], where w and any vertex colors are ignored
+//   f with v, v/vt, v//vn or v/vt/vn corners, 1-based or negative (relative) vertex indices,
+//     and polygons of more than three corners, which are split into a fan of triangles
+//   vt, vn, o, g, s, usemtl, mtllib, comments and any other statement, which are skipped
+// the coordinates are kept as they are in the file, and the edges are not built
+// data: the text of the file
+// size: the size of the text in bytes
+// mesh: the mesh to store the vertices and triangles in
+// threads: the number of chunks to parse in parallel, 0 for the number of threads of OpenCV
+// stats: if not NULL, what the file contained
+// return: 0 if successful, -1 if error
+int parse_obj(const char *data, size_t size, MeshData &mesh, int threads = 0, ObjStats *stats = NULL);
+
+// parse an obj file, which is mapped into memory instead of read
+// filename: the path of the obj file
+// mesh: the mesh to store the vertices and triangles in
+// threads: the number of chunks to parse in parallel, 0 for the number of threads of OpenCV
+// stats: if not NULL, what the file contained
+// return: 0 if successful, -1 if error
+int parse_obj_file(std::string filename, MeshData &mesh, int threads = 0, ObjStats *stats = NULL);
+
+#endif
@@ -0,0 +1,367 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+// what a full queue does with a new item
+enum DropPolicy
+{
+  DROP_BLOCK,  // wait until the consumer makes room, so no item is lost
+  DROP_OLDEST, // throw away the oldest queued item, so the latency stays bounded
+};
+
+// parse a drop policy from its name
+// name: "block" or "oldest"
+// policy: the parsed policy
+// return: 0 if successful, -1 if the name is unknown
+inline int parse_drop_policy(std::string name, DropPolicy &policy)
+{
+  if (name == "block")
+  {
+    policy = DROP_BLOCK;
+  }
+  else if (name == "oldest")
+  {
+    policy = DROP_OLDEST;
+  }
+  else
+  {
+    return (-1);
+  }
+
+  return (0);
+}
+
+// waits for a queue to become non-empty or non-full. a short wait only yields, so a frame handed over right away
+// is picked up at once, while a longer one sleeps, doubling up to 0.5 ms, so that a stage waiting on a 30 fps camera
+// leaves its core idle instead of spinning
+class Backoff
+{
+public:
+  Backoff() : rounds(0) {}
+
+  // wait a little longer than the previous time
+  void wait()
+  {
+    const int YIELD_ROUNDS = 16;
+    const int MAX_SLEEP_US = 500;
+    if (rounds < YIELD_ROUNDS)
+    {
+      rounds++;
+      std::this_thread::yield();
+      return;
+    }
+
+    int sleep = std::min(50 << std::min(rounds - YIELD_ROUNDS, 5), MAX_SLEEP_US);
+    if (sleep < MAX_SLEEP_US)
+    {
+      rounds++;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(sleep));
+  }
+
+  // start over with yielding, once the wait is over
+  void reset()
+  {
+    rounds = 0;
+  }
+
+private:
+  int rounds;
+};
+
+// a bounded lock-free queue after Dmitry Vyukov's MPMC ring buffer
+// every cell carries a sequence number telling whether it is free for the producer or full for the consumer,
+// so any thread may push or pop without locks. the capacity is rounded up to a power of two
+template <typename T>
+class BoundedQueue
+{
+public:
+  BoundedQueue(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity)
+    {
+      size *= 2;
+    }
+
+    cells.reset(new Cell[size]);
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+    {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueuePos.store(0, std::memory_order_relaxed);
+    dequeuePos.store(0, std::memory_order_relaxed);
+  }
+
+  // push an item if there is room
+  // item: the item, moved from on success
+  // return: true if the item was queued, false if the queue is full
+  bool try_push(T &item)
+  {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Cell &cell = cells[pos & mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+      if (diff == 0)
+      {
+        // the cell is free, claim it
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          cell.data = std::move(item);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return (true);
+        }
+      }
+      else if (diff < 0)
+      {
+        // the cell still holds an item from the previous lap, the queue is full
+        return (false);
+      }
+      else
+      {
+        // another producer claimed the cell, try the next position
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // pop the oldest item if there is one
+  // item: the item to move into
+  // return: true if an item was popped, false if the queue is empty
+  bool try_pop(T &item)
+  {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Cell &cell = cells[pos & mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(pos + 1);
+      if (diff == 0)
+      {
+        // the cell is full, claim it
+        if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          item = std::move(cell.data);
+          cell.data = T();
+          cell.sequence.store(pos + mask + 1, std::memory_order_release);
+          return (true);
+        }
+      }
+      else if (diff < 0)
+      {
+        // the cell has not been filled yet, the queue is empty
+        return (false);
+      }
+      else
+      {
+        // another consumer claimed the cell, try the next position
+        pos = dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // push an item, applying the drop policy when the queue is full
+  // item: the item, moved from
+  // policy: whether to wait for room or to drop the oldest item
+  // stop: a flag that aborts a blocking push when it is set
+  // return: the number of items dropped to make room, or -1 if the push was aborted
+  long push(T &item, DropPolicy policy, const std::atomic<bool> &stop)
+  {
+    long dropped = 0;
+    T oldest;
+    Backoff backoff;
+    while (!try_push(item))
+    {
+      if (stop.load(std::memory_order_relaxed))
+      {
+        return (-1);
+      }
+
+      // the producer pops the oldest item itself, which is safe since the queue allows several consumers
+      if (policy == DROP_OLDEST && try_pop(oldest))
+      {
+        dropped++;
+      }
+      else
+      {
+        backoff.wait();
+      }
+    }
+
+    return (dropped);
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+
+  // keep the two positions on separate cache lines, they are written by different threads
+  alignas(64) std::atomic<size_t> enqueuePos;
+  alignas(64) std::atomic<size_t> dequeuePos;
+};
+
+// options of a capture -> process -> consume pipeline
+struct PipelineOptions
+{
+  PipelineOptions() : queueDepth(2), policy(DROP_BLOCK) {}
+
+  size_t queueDepth; // the capacity of each queue between two stages
+  DropPolicy policy;  // what a stage does when the queue to the next stage is full
+};
+
+// counters of a pipeline run
+struct PipelineStats
+{
+  PipelineStats() : captured(0), processed(0), consumed(0), dropped(0) {}
+
+  long captured;
+  long processed;
+  long consumed;
+  long dropped;
+};
+
+// run three stages on separate threads connected by bounded lock-free queues, so that consecutive items
+// overlap across cores. the capture and process stages get their own threads, the consume stage runs on
+// the calling thread because window functions such as cv::imshow must stay on the main thread
+// capture: fills in the next item, returns false when there are no more items
+// process: processes an item in place, items are processed in order
+// consume: consumes a processed item, returns false to stop the pipeline
+// options: the queue depth and the drop policy
+// return: the stage counters
+template <typename T>
+PipelineStats run_pipeline(std::function<bool(T &)> capture, std::function<void(T &)> process,
+                           std::function<bool(T &)> consume, PipelineOptions options)
+{
+  BoundedQueue<T> captureQueue(options.queueDepth);
+  BoundedQueue<T> processQueue(options.queueDepth);
+  std::atomic<bool> stop(false);
+  std::atomic<bool> captureDone(false);
+  std::atomic<bool> processDone(false);
+  std::atomic<long> captured(0);
+  std::atomic<long> processed(0);
+  std::atomic<long> dropped(0);
+
+  // the capture stage
+  std::thread captureThread([&]()
+  {
+    while (!stop.load(std::memory_order_relaxed))
+    {
+      // capture into a fresh item, since the previous one may still be in flight
+      T item;
+      if (!capture(item))
+      {
+        break;
+      }
+      captured++;
+
+      long n = captureQueue.push(item, options.policy, stop);
+      if (n < 0)
+      {
+        break;
+      }
+      dropped += n;
+    }
+    captureDone.store(true, std::memory_order_release);
+  });
+
+  // the process stage
+  std::thread processThread([&]()
+  {
+    T item;
+    Backoff backoff;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+      if (!captureQueue.try_pop(item))
+      {
+        if (!captureDone.load(std::memory_order_acquire))
+        {
+          backoff.wait();
+          continue;
+        }
+
+        // the capture stage is done, drain what it left before finishing
+        if (!captureQueue.try_pop(item))
+        {
+          break;
+        }
+      }
+      backoff.reset();
+
+      process(item);
+      processed++;
+
+      long n = processQueue.push(item, options.policy, stop);
+      if (n < 0)
+      {
+        break;
+      }
+      dropped += n;
+    }
+    processDone.store(true, std::memory_order_release);
+  });
+
+  // the consume stage on the calling thread
+  PipelineStats stats;
+  T item;
+  Backoff backoff;
+  for (;;)
+  {
+    if (!processQueue.try_pop(item))
+    {
+      if (!processDone.load(std::memory_order_acquire))
+      {
+        backoff.wait();
+        continue;
+      }
+
+      // the process stage is done, drain what it left before finishing
+      if (!processQueue.try_pop(item))
+      {
+        break;
+      }
+    }
+    backoff.reset();
+
+    stats.consumed++;
+    if (!consume(item))
+    {
+      break;
+    }
+  }
+
+  // stop the other stages and wait for them
+  stop.store(true);
+  captureThread.join();
+  processThread.join();
+
+  stats.captured = captured.load();
+  stats.processed = processed.load();
+  stats.dropped = dropped.load();
+
+  return (stats);
+}
+
+#endif
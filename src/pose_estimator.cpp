@@ -0,0 +1,162 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <cmath>
+#include <opencv2/opencv.hpp>
+#include "pose_estimator.hpp"
+#include "profiler.hpp"
+
+// the rms reprojection error in pixels above which a warm-started pose is solved again from scratch,
+// e.g. when the prediction fell into the wrong local minimum after a sudden motion
+static const double MAX_GUESS_ERROR = 2.0;
+
+int parse_pose_solver(std::string name, PoseSolver &solver)
+{
+  if (name == "iterative")
+  {
+    solver = POSE_ITERATIVE;
+  }
+  else if (name == "guess")
+  {
+    solver = POSE_ITERATIVE_GUESS;
+  }
+  else if (name == "ippe")
+  {
+    solver = POSE_IPPE;
+  }
+  else
+  {
+    return (-1);
+  }
+
+  return (0);
+}
+
+std::string pose_solver_name(PoseSolver solver)
+{
+  if (solver == POSE_ITERATIVE_GUESS)
+  {
+    return ("guess");
+  }
+  else if (solver == POSE_IPPE)
+  {
+    return ("ippe");
+  }
+
+  return ("iterative");
+}
+
+// compute the rms distance between two sets of points
+// a: the first set
+// b: the second set
+// return: the rms distance
+static double rms_distance(const std::vector<cv::Point2f> &a, const std::vector<cv::Point2f> &b)
+{
+  double sum = 0;
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    cv::Point2f diff = a[i] - b[i];
+    sum += diff.x * diff.x + diff.y * diff.y;
+  }
+
+  return (a.empty() ? 0 : std::sqrt(sum / a.size()));
+}
+
+PoseEstimator::PoseEstimator(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, PoseSolver solver)
+{
+  this->cameraMatrix = cameraMatrix;
+  this->distCoeffs = distCoeffs;
+  this->solver = solver;
+  lastError = 0;
+  reset();
+}
+
+void PoseEstimator::reset()
+{
+  history = 0;
+  angularVelocity = cv::Vec3d(0, 0, 0);
+  linearVelocity = cv::Vec3d(0, 0, 0);
+}
+
+bool PoseEstimator::estimate(const std::vector<cv::Vec3f> &objectPoints, const std::vector<cv::Point2f> &corners,
+                             cv::Vec3d &rvec, cv::Vec3d &tvec)
+{
+  ScopedTimer timer(PROFILE_POSE);
+  bool found;
+  if (solver == POSE_IPPE)
+  {
+    // the closed-form planar solver does not use a guess
+    found = cv::solvePnP(objectPoints, corners, cameraMatrix, distCoeffs, rvec, tvec, false, cv::SOLVEPNP_IPPE);
+  }
+  else if (solver == POSE_ITERATIVE_GUESS && predict(1, rvec, tvec))
+  {
+    // start from where the chessboard should be by now
+    found = cv::solvePnP(objectPoints, corners, cameraMatrix, distCoeffs, rvec, tvec, true, cv::SOLVEPNP_ITERATIVE);
+  }
+  else
+  {
+    found = cv::solvePnP(objectPoints, corners, cameraMatrix, distCoeffs, rvec, tvec, false, cv::SOLVEPNP_ITERATIVE);
+  }
+
+  // measure how well the pose explains the corners
+  if (found)
+  {
+    cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, projected);
+    lastError = rms_distance(projected, corners);
+
+    // a bad warm start is solved again from scratch
+    if (solver == POSE_ITERATIVE_GUESS && history > 0 && lastError > MAX_GUESS_ERROR)
+    {
+      found = cv::solvePnP(objectPoints, corners, cameraMatrix, distCoeffs, rvec, tvec, false, cv::SOLVEPNP_ITERATIVE);
+      cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, projected);
+      lastError = rms_distance(projected, corners);
+    }
+  }
+
+  if (!found)
+  {
+    reset();
+    return (false);
+  }
+
+  // update the motion, the rotation between the frames is R * lastR^T
+  if (history > 0)
+  {
+    cv::Matx33d rotation, lastRotation;
+    cv::Rodrigues(rvec, rotation);
+    cv::Rodrigues(lastRvec, lastRotation);
+    cv::Matx33d delta = rotation * lastRotation.t();
+    cv::Rodrigues(delta, angularVelocity);
+    linearVelocity = tvec - lastTvec;
+  }
+  lastRvec = rvec;
+  lastTvec = tvec;
+  history++;
+
+  return (true);
+}
+
+bool PoseEstimator::predict(double frames, cv::Vec3d &rvec, cv::Vec3d &tvec)
+{
+  if (history == 0)
+  {
+    return (false);
+  }
+
+  // keep rotating and moving with the last velocity, a single pose has no velocity yet
+  cv::Matx33d rotation, delta;
+  cv::Rodrigues(lastRvec, rotation);
+  cv::Rodrigues(angularVelocity * frames, delta);
+  cv::Rodrigues(delta * rotation, rvec);
+  tvec = lastTvec + linearVelocity * frames;
+
+  return (true);
+}
+
+double PoseEstimator::error()
+{
+  return (lastError);
+}
@@ -0,0 +1,82 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef POSE_ESTIMATOR_HPP
+#define POSE_ESTIMATOR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// the solver used to estimate the pose of the chessboard
+enum PoseSolver
+{
+  POSE_ITERATIVE,       // cv::solvePnP with SOLVEPNP_ITERATIVE from scratch, as the original ar loop did
+  POSE_ITERATIVE_GUESS, // SOLVEPNP_ITERATIVE started from the pose predicted from the previous frames
+  POSE_IPPE,            // the closed-form SOLVEPNP_IPPE for planar objects
+};
+
+// parse a pose solver from its name
+// name: "iterative", "guess" or "ippe"
+// solver: the parsed solver
+// return: 0 if successful, -1 if the name is unknown
+int parse_pose_solver(std::string name, PoseSolver &solver);
+
+// get the name of a pose solver
+// solver: the solver
+// return: the name, as accepted by parse_pose_solver
+std::string pose_solver_name(PoseSolver solver);
+
+// estimates the pose of the chessboard in a stream of frames
+// it keeps the pose of the previous frame and the motion between the last two frames, so that the iterative
+// solver can start from a constant-velocity prediction instead of from scratch, and so that the pose can be
+// predicted a few frames ahead to compensate for the latency of rendering
+class PoseEstimator
+{
+public:
+  // cameraMatrix: the camera matrix
+  // distCoeffs: the distortion coefficients
+  // solver: the solver to use
+  PoseEstimator(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, PoseSolver solver);
+
+  // estimate the pose of the chessboard in the next frame
+  // objectPoints: the 3D points of the chessboard corners
+  // corners: the corners found in the frame
+  // rvec: the rotation vector
+  // tvec: the translation vector
+  // return: true if a pose was found
+  bool estimate(const std::vector<cv::Vec3f> &objectPoints, const std::vector<cv::Point2f> &corners,
+                cv::Vec3d &rvec, cv::Vec3d &tvec);
+
+  // predict the pose some frames after the last estimated one, assuming constant velocity
+  // frames: the number of frames to look ahead
+  // rvec: the predicted rotation vector
+  // tvec: the predicted translation vector
+  // return: true if there is a pose to predict from
+  bool predict(double frames, cv::Vec3d &rvec, cv::Vec3d &tvec);
+
+  // forget the previous poses, e.g. when the chessboard is lost
+  void reset();
+
+  // return: the rms reprojection error in pixels of the last estimated pose
+  double error();
+
+private:
+  cv::Mat cameraMatrix;
+  cv::Mat distCoeffs;
+  PoseSolver solver;
+
+  // the last pose and the motion between the last two poses
+  int history;
+  cv::Vec3d lastRvec, lastTvec;
+  cv::Vec3d angularVelocity, linearVelocity;
+  double lastError;
+
+  // reused buffer of projected corners
+  std::vector<cv::Point2f> projected;
+};
+
+#endif
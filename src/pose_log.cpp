@@ -0,0 +1,212 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "pose_log.hpp"
+
+// the first bytes of a pose log
+static const char LOG_MAGIC[8] = {'A', 'R', 'P', 'O', 'S', 'E', 'S', 0};
+
+// the version of the format, increased whenever the layout of the header or the records changes
+static const uint32_t LOG_VERSION = 1;
+
+// written as is, so that a log written on a machine of the other byte order is rejected
+static const uint32_t LOG_BYTE_ORDER = 0x01020304;
+
+// how long the writer sleeps when the queue is empty, short enough to keep the queue far from full
+static const std::chrono::milliseconds WRITER_IDLE(2);
+
+// the header at the start of a pose log, followed by the records
+struct LogHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t recordSize;
+  uint32_t reserved;
+  int64_t startTime; // when the log was opened, in microseconds since the unix epoch
+};
+
+PoseLog::PoseLog(size_t capacity) : queue(capacity)
+{
+  file = NULL;
+  stopping = false;
+  writtenCount = 0;
+  droppedCount = 0;
+  start = std::chrono::steady_clock::now();
+}
+
+PoseLog::~PoseLog()
+{
+  close();
+}
+
+int PoseLog::open(std::string filename)
+{
+  close();
+
+  file = fopen(filename.c_str(), "wb");
+  if (file == NULL)
+  {
+    printf("error: unable to write %s.\n", filename.c_str());
+    return (-1);
+  }
+
+  LogHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+  header.version = LOG_VERSION;
+  header.byteOrder = LOG_BYTE_ORDER;
+  header.recordSize = sizeof(PoseRecord);
+  header.startTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  if (fwrite(&header, sizeof(header), 1, file) != 1)
+  {
+    printf("error: unable to write %s.\n", filename.c_str());
+    fclose(file);
+    file = NULL;
+    return (-1);
+  }
+
+  stopping = false;
+  writtenCount = 0;
+  droppedCount = 0;
+  start = std::chrono::steady_clock::now();
+  thread = std::thread(&PoseLog::run, this);
+
+  return (0);
+}
+
+bool PoseLog::isOpen() const
+{
+  return (file != NULL);
+}
+
+int64_t PoseLog::clock() const
+{
+  return (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+bool PoseLog::write(const PoseRecord &record)
+{
+  if (file == NULL)
+  {
+    return (false);
+  }
+
+  PoseRecord item = record;
+  if (!queue.try_push(item))
+  {
+    droppedCount++;
+    return (false);
+  }
+
+  return (true);
+}
+
+void PoseLog::close()
+{
+  if (file == NULL)
+  {
+    return;
+  }
+
+  // the writer drains the queue before it stops
+  stopping = true;
+  thread.join();
+  fclose(file);
+  file = NULL;
+}
+
+long PoseLog::written() const
+{
+  return (writtenCount.load());
+}
+
+long PoseLog::dropped() const
+{
+  return (droppedCount.load());
+}
+
+// write the queued poses until stopped, through the buffer of the file
+void PoseLog::run()
+{
+  PoseRecord record;
+  for (;;)
+  {
+    // read the flag before draining, so that a pose queued before the stop is still written
+    bool stop = stopping.load();
+    while (queue.try_pop(record))
+    {
+      if (fwrite(&record, sizeof(record), 1, file) == 1)
+      {
+        writtenCount++;
+      }
+    }
+    if (stop)
+    {
+      break;
+    }
+
+    // the queue is empty, flush so that a reader sees the poses so far
+    fflush(file);
+    std::this_thread::sleep_for(WRITER_IDLE);
+  }
+  fflush(file);
+}
+
+long pose_log_to_csv(std::string logFile, std::string csvFile)
+{
+  FILE *input = fopen(logFile.c_str(), "rb");
+  if (input == NULL)
+  {
+    printf("error: unable to open %s.\n", logFile.c_str());
+    return (-1);
+  }
+
+  // check that the log was written by this version
+  LogHeader header;
+  if (fread(&header, sizeof(header), 1, input) != 1 || memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 ||
+      header.version != LOG_VERSION || header.byteOrder != LOG_BYTE_ORDER || header.recordSize != sizeof(PoseRecord))
+  {
+    printf("error: %s is not a pose log of this version.\n", logFile.c_str());
+    fclose(input);
+    return (-1);
+  }
+
+  FILE *output = csvFile == "-" ? stdout : fopen(csvFile.c_str(), "w");
+  if (output == NULL)
+  {
+    printf("error: unable to write %s.\n", csvFile.c_str());
+    fclose(input);
+    return (-1);
+  }
+
+  // the poses at full precision, a record cut off at the end by a crash is ignored
+  fprintf(output, "frame,time,rx,ry,rz,tx,ty,tz,corners,error\n");
+  long count = 0;
+  PoseRecord record;
+  while (fread(&record, sizeof(record), 1, input) == 1)
+  {
+    fprintf(output, "%lld,%.9f,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%d,%.9g\n", (long long)record.frame,
+            record.captureTime * 1e-9, record.rvec[0], record.rvec[1], record.rvec[2], record.tvec[0], record.tvec[1],
+            record.tvec[2], record.corners, record.error);
+    count++;
+  }
+  fclose(input);
+  if (output != stdout && fclose(output) != 0)
+  {
+    printf("error: unable to write %s.\n", csvFile.c_str());
+    return (-1);
+  }
+
+  return (count);
+}
@@ -0,0 +1,86 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef POSE_LOG_HPP
+#define POSE_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "pipeline.hpp"
+
+// a pose of the chessboard as it is stored in a pose log
+struct PoseRecord
+{
+  int64_t frame;       // the index of the frame
+  int64_t captureTime; // when the frame was captured, in nanoseconds since the log was opened
+  double rvec[3];
+  double tvec[3];
+  int32_t corners; // the number of corners the pose was solved from
+  float error;     // the rms reprojection error of the corners in pixels
+};
+
+// writes poses to a binary file on a background thread, so that the frame loop never waits for the disk
+// the poses are handed over through a bounded lock-free queue; when the writer falls that far behind,
+// new poses are dropped and counted instead of blocking the loop
+// the file is a header followed by the records as they are in memory, see pose_log_to_csv
+class PoseLog
+{
+public:
+  // capacity: the number of poses the queue holds
+  PoseLog(size_t capacity = 1024);
+  ~PoseLog();
+
+  // create the file and start the writer thread
+  // filename: the path of the log file
+  // return: 0 if successful, -1 if error
+  int open(std::string filename);
+
+  // return: whether a log is open
+  bool isOpen() const;
+
+  // return: the nanoseconds since the log was opened, for PoseRecord::captureTime
+  int64_t clock() const;
+
+  // queue a pose for writing, without waiting
+  // record: the pose
+  // return: true if queued, false if the queue was full and the pose was dropped or no log is open
+  bool write(const PoseRecord &record);
+
+  // write the queued poses, stop the writer thread and close the file
+  void close();
+
+  // return: the number of poses written
+  long written() const;
+
+  // return: the number of poses dropped because the queue was full
+  long dropped() const;
+
+private:
+  PoseLog(const PoseLog &);
+  PoseLog &operator=(const PoseLog &);
+  void run();
+
+  FILE *file;
+  BoundedQueue<PoseRecord> queue;
+  std::thread thread;
+  std::atomic<bool> stopping;
+  std::atomic<long> writtenCount;
+  std::atomic<long> droppedCount;
+  std::chrono::steady_clock::time_point start;
+};
+
+// convert a pose log to a csv file with a header line
+// frame,time,rx,ry,rz,tx,ty,tz,corners,error, with the time in seconds since the log was opened
+// logFile: the path of the pose log
+// csvFile: the path of the csv file, or "-" for the standard output
+// return: the number of poses converted, or -1 if error
+long pose_log_to_csv(std::string logFile, std::string csvFile);
+
+#endif
@@ -0,0 +1,33 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <cstdio>
+#include <string>
+#include "pose_log.hpp"
+
+int main(int argc, char *argv[])
+{
+  // error checking
+  if (argc < 2 || argc > 3)
+  {
+    printf("usage: %s <pose log> [<csv file>]\n", argv[0]);
+    printf("converts a pose log written by ar --pose-log to csv, on the standard output if no csv file is given\n");
+    return (-1);
+  }
+
+  std::string csvFile = argc == 3 ? argv[2] : "-";
+  long count = pose_log_to_csv(argv[1], csvFile);
+  if (count < 0)
+  {
+    return (-1);
+  }
+  if (csvFile != "-")
+  {
+    printf("converted %ld poses to %s\n", count, csvFile.c_str());
+  }
+
+  return (0);
+}
@@ -0,0 +1,310 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "profiler.hpp"
+
+std::atomic<bool> profilingEnabled(false);
+
+// the histograms have 16 buckets per power of two of nanoseconds, so a bucket is at most 1/16 of its value wide
+static const int SUB_BITS = 4;
+static const int SUB_BUCKETS = 1 << SUB_BITS;
+
+// the longest interval told apart, about 18 minutes, longer ones count in the last bucket
+static const int MAX_OCTAVE = 40;
+static const int BUCKETS = (MAX_OCTAVE - SUB_BITS + 2) * SUB_BUCKETS;
+
+// the most intervals a thread keeps for the trace, about 16 MB
+static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+// an interval kept for the trace
+struct TraceEvent
+{
+  int stage;
+  int64_t start;
+  int64_t duration;
+};
+
+// the histograms of one thread, written by that thread only and read by any
+// the counters are atomic so that reading them while the thread records is safe, but the thread that owns them
+// updates them with a relaxed load and store instead of a read-modify-write
+struct ThreadProfile
+{
+  ThreadProfile() : id(0)
+  {
+    for (int s = 0; s < PROFILE_STAGES; s++)
+    {
+      total[s].store(0, std::memory_order_relaxed);
+      longest[s].store(0, std::memory_order_relaxed);
+      for (int b = 0; b < BUCKETS; b++)
+      {
+        counts[s][b].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  int id;
+  std::atomic<uint32_t> counts[PROFILE_STAGES][BUCKETS];
+  std::atomic<int64_t> total[PROFILE_STAGES];
+  std::atomic<int64_t> longest[PROFILE_STAGES];
+
+  // only touched by the owning thread until the trace is written
+  std::vector<TraceEvent> events;
+};
+
+// the histograms of every thread that recorded anything, kept until the program exits
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadProfile>> registry;
+static bool tracing = false;
+static std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// the histograms of the calling thread
+static thread_local ThreadProfile *threadProfile = NULL;
+
+// find the bucket of an interval
+// duration: the interval in nanoseconds
+// return: the index of the bucket
+static int bucket_index(int64_t duration)
+{
+  uint64_t value = duration > 0 ? (uint64_t)duration : 0;
+  if (value < (uint64_t)SUB_BUCKETS)
+  {
+    return ((int)value);
+  }
+
+  // the power of two, then the next SUB_BITS bits below the leading one
+  int octave = 63;
+  while (!(value >> octave))
+  {
+    octave--;
+  }
+  if (octave > MAX_OCTAVE)
+  {
+    return (BUCKETS - 1);
+  }
+
+  return ((octave - SUB_BITS + 1) * SUB_BUCKETS + (int)((value >> (octave - SUB_BITS)) & (SUB_BUCKETS - 1)));
+}
+
+// find the middle of a bucket
+// index: the index of the bucket
+// return: the middle in nanoseconds
+static double bucket_middle(int index)
+{
+  if (index < SUB_BUCKETS)
+  {
+    return (index);
+  }
+
+  int octave = index / SUB_BUCKETS + SUB_BITS - 1;
+  double width = std::ldexp(1.0, octave - SUB_BITS);
+
+  return ((SUB_BUCKETS + index % SUB_BUCKETS) * width + width / 2);
+}
+
+void start_profiling(bool trace)
+{
+  std::lock_guard<std::mutex> lock(registryMutex);
+  tracing = trace;
+  epoch = std::chrono::steady_clock::now();
+  profilingEnabled.store(true, std::memory_order_release);
+}
+
+int64_t profile_clock()
+{
+  return (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+
+void record_profile(ProfileStage stage, int64_t start, int64_t duration)
+{
+  // the first interval of a thread registers its histograms
+  ThreadProfile *profile = threadProfile;
+  if (profile == NULL)
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(std::unique_ptr<ThreadProfile>(new ThreadProfile()));
+    profile = threadProfile = registry.back().get();
+    profile->id = (int)registry.size();
+  }
+
+  std::atomic<uint32_t> &count = profile->counts[stage][bucket_index(duration)];
+  count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  profile->total[stage].store(profile->total[stage].load(std::memory_order_relaxed) + duration,
+                              std::memory_order_relaxed);
+  if (duration > profile->longest[stage].load(std::memory_order_relaxed))
+  {
+    profile->longest[stage].store(duration, std::memory_order_relaxed);
+  }
+
+  if (tracing && profile->events.size() < MAX_TRACE_EVENTS)
+  {
+    TraceEvent event = {stage, start, duration};
+    profile->events.push_back(event);
+  }
+}
+
+std::string profile_stage_name(ProfileStage stage)
+{
+  static const char *names[PROFILE_STAGES] = {"capture", "undistort", "cvtColor", "detect",
+                                              "track",   "cornerSubPix", "solvePnP", "project",
+                                              "draw",    "features", "calibrate", "display"};
+
+  return (stage >= 0 && stage < PROFILE_STAGES ? names[stage] : "unknown");
+}
+
+void profile_summary(ProfileStage stage, ProfileSummary &summary)
+{
+  summary = ProfileSummary();
+
+  // add up the histograms of all threads
+  std::vector<uint64_t> counts(BUCKETS, 0);
+  int64_t total = 0, longest = 0;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); t++)
+    {
+      const ThreadProfile &profile = *registry[t];
+      for (int b = 0; b < BUCKETS; b++)
+      {
+        counts[b] += profile.counts[stage][b].load(std::memory_order_relaxed);
+      }
+      total += profile.total[stage].load(std::memory_order_relaxed);
+      longest = std::max(longest, profile.longest[stage].load(std::memory_order_relaxed));
+    }
+  }
+  uint64_t count = 0;
+  for (int b = 0; b < BUCKETS; b++)
+  {
+    count += counts[b];
+  }
+  if (count == 0)
+  {
+    return;
+  }
+
+  // the percentiles are the buckets the cumulative count reaches them in
+  const double fractions[3] = {0.5, 0.95, 0.99};
+  double *percentiles[3] = {&summary.p50, &summary.p95, &summary.p99};
+  uint64_t cumulative = 0;
+  int next = 0;
+  for (int b = 0; b < BUCKETS && next < 3; b++)
+  {
+    cumulative += counts[b];
+    while (next < 3 && cumulative >= (uint64_t)std::ceil(fractions[next] * count))
+    {
+      *percentiles[next] = std::min(bucket_middle(b), (double)longest) * 1e-6;
+      next++;
+    }
+  }
+  summary.count = (long)count;
+  summary.mean = (double)total / count * 1e-6;
+  summary.max = longest * 1e-6;
+}
+
+void print_profile()
+{
+  if (!profiling())
+  {
+    return;
+  }
+
+  printf("%-14s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "mean ms", "p50 ms", "p95 ms", "p99 ms",
+         "max ms");
+  for (int s = 0; s < PROFILE_STAGES; s++)
+  {
+    ProfileSummary summary;
+    profile_summary((ProfileStage)s, summary);
+    if (summary.count == 0)
+    {
+      continue;
+    }
+    printf("%-14s %10ld %10.3f %10.3f %10.3f %10.3f %10.3f\n", profile_stage_name((ProfileStage)s).c_str(),
+           summary.count, summary.mean, summary.p50, summary.p95, summary.p99, summary.max);
+  }
+}
+
+void draw_profile_hud(cv::Mat &frame)
+{
+  if (!profiling() || frame.empty())
+  {
+    return;
+  }
+
+  // one line per stage on a dark box, so it stays readable on any frame
+  std::vector<std::string> lines;
+  char line[64];
+  snprintf(line, sizeof(line), "%-12s %6s %6s %6s", "ms", "p50", "p95", "p99");
+  lines.push_back(line);
+  for (int s = 0; s < PROFILE_STAGES; s++)
+  {
+    ProfileSummary summary;
+    profile_summary((ProfileStage)s, summary);
+    if (summary.count == 0)
+    {
+      continue;
+    }
+    snprintf(line, sizeof(line), "%-12s %6.2f %6.2f %6.2f", profile_stage_name((ProfileStage)s).c_str(), summary.p50,
+             summary.p95, summary.p99);
+    lines.push_back(line);
+  }
+
+  const int LINE_HEIGHT = 16;
+  cv::Rect box(0, 0, std::min(frame.cols, 300), std::min(frame.rows, LINE_HEIGHT * (int)lines.size() + 8));
+  cv::Mat background = frame(box);
+  background.convertTo(background, -1, 0.3);
+  for (size_t i = 0; i < lines.size(); i++)
+  {
+    cv::putText(frame, lines[i], cv::Point(6, LINE_HEIGHT * (int)(i + 1)), cv::FONT_HERSHEY_PLAIN, 0.9,
+                cv::Scalar(0, 255, 0), 1);
+  }
+}
+
+int write_profile_trace(std::string filename)
+{
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == NULL)
+  {
+    printf("error: unable to write %s.\n", filename.c_str());
+    return (-1);
+  }
+
+  // complete events with the times in microseconds, and a name for every thread
+  std::lock_guard<std::mutex> lock(registryMutex);
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  long events = 0;
+  for (size_t t = 0; t < registry.size(); t++)
+  {
+    const ThreadProfile &profile = *registry[t];
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            first ? "" : ",\n", profile.id, profile.id);
+    first = false;
+    for (size_t i = 0; i < profile.events.size(); i++)
+    {
+      const TraceEvent &event = profile.events[i];
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              profile_stage_name((ProfileStage)event.stage).c_str(), profile.id, event.start * 1e-3,
+              event.duration * 1e-3);
+    }
+    events += (long)profile.events.size();
+  }
+  fprintf(file, "\n]}\n");
+  if (fclose(file) != 0)
+  {
+    printf("error: unable to write %s.\n", filename.c_str());
+    return (-1);
+  }
+  printf("wrote %ld intervals of %d threads to %s\n", events, (int)registry.size(), filename.c_str());
+
+  return (0);
+}
@@ -0,0 +1,120 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// the stages of the frame loops that are timed
+enum ProfileStage
+{
+  PROFILE_CAPTURE,   // reading a frame from the frame source
+  PROFILE_UNDISTORT, // remapping a frame with the undistortion maps
+  PROFILE_GRAY,      // cv::cvtColor to grayscale
+  PROFILE_DETECT,    // cv::findChessboardCorners
+  PROFILE_TRACK,     // tracking the corners with optical flow
+  PROFILE_SUBPIX,    // cv::cornerSubPix
+  PROFILE_POSE,      // cv::solvePnP and its checks
+  PROFILE_PROJECT,   // transforming and projecting the vertices of the meshes
+  PROFILE_DRAW,      // drawing the corners and the meshes, including their projection
+  PROFILE_FEATURES,  // detecting and drawing the features of the feature program
+  PROFILE_CALIBRATE, // calibrating the camera
+  PROFILE_DISPLAY,   // showing a frame and polling the keyboard
+  PROFILE_STAGES,
+};
+
+// the latency of a stage over all threads, in milliseconds
+struct ProfileSummary
+{
+  ProfileSummary() : count(0), mean(0), p50(0), p95(0), p99(0), max(0) {}
+
+  long count;
+  double mean;
+  double p50, p95, p99; // the percentiles, to the resolution of the histogram, about 3%
+  double max;
+};
+
+// start recording the stages
+// every thread records into its own histograms, which only it writes, so recording takes no lock;
+// when nothing is recorded, a timer costs one load of a flag
+// trace: whether to also keep every timed interval for write_profile_trace
+void start_profiling(bool trace);
+
+// set by start_profiling, read by every timer
+extern std::atomic<bool> profilingEnabled;
+
+// return: whether the stages are being recorded
+inline bool profiling()
+{
+  return (profilingEnabled.load(std::memory_order_acquire));
+}
+
+// record an interval of a stage on the calling thread
+// stage: the stage
+// start: when it started, in nanoseconds since the profiler started
+// duration: how long it took, in nanoseconds
+void record_profile(ProfileStage stage, int64_t start, int64_t duration);
+
+// return: the nanoseconds since the profiler started
+int64_t profile_clock();
+
+// times the scope it lives in as a stage, if profiling
+class ScopedTimer
+{
+public:
+  ScopedTimer(ProfileStage stage) : stage(stage), start(profiling() ? profile_clock() : -1) {}
+
+  ~ScopedTimer()
+  {
+    stop();
+  }
+
+  // record the stage now instead of at the end of the scope
+  void stop()
+  {
+    if (start >= 0)
+    {
+      record_profile(stage, start, profile_clock() - start);
+      start = -1;
+    }
+  }
+
+private:
+  ScopedTimer(const ScopedTimer &);
+  ScopedTimer &operator=(const ScopedTimer &);
+
+  ProfileStage stage;
+  int64_t start;
+};
+
+// get the name of a stage
+// stage: the stage
+// return: the name, as shown in the summary and the trace
+std::string profile_stage_name(ProfileStage stage);
+
+// merge the histograms of all threads for a stage
+// stage: the stage
+// summary: the count, mean, percentiles and maximum
+void profile_summary(ProfileStage stage, ProfileSummary &summary);
+
+// print the summary of every stage that was recorded
+void print_profile();
+
+// draw the p50, p95 and p99 of every stage recorded so far in the top left corner of the frame
+// frame: the 8-bit BGR frame to draw on
+void draw_profile_hud(cv::Mat &frame);
+
+// write the intervals recorded since start_profiling as a Chrome trace, which chrome://tracing
+// and Perfetto open, with one row per thread. call it once the profiled threads are done or idle
+// filename: the json file
+// return: 0 if successful, -1 if error
+int write_profile_trace(std::string filename);
+
+#endif
@@ -0,0 +1,358 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <cstring>
+#include <opencv2/opencv.hpp>
+#include "projection.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// the number of points above which a projection is split across threads
+static const int PARALLEL_POINTS = 65536;
+
+// one float, the fallback for the tail of a batch and for targets without SIMD
+struct ScalarFloat
+{
+  static const int width = 1;
+  float v;
+
+  ScalarFloat() {}
+  ScalarFloat(float f) : v(f) {}
+  static ScalarFloat load(const float *p) { return (ScalarFloat(*p)); }
+  void store(float *p) const { *p = v; }
+};
+inline ScalarFloat operator+(ScalarFloat a, ScalarFloat b) { return (ScalarFloat(a.v + b.v)); }
+inline ScalarFloat operator-(ScalarFloat a, ScalarFloat b) { return (ScalarFloat(a.v - b.v)); }
+inline ScalarFloat operator*(ScalarFloat a, ScalarFloat b) { return (ScalarFloat(a.v * b.v)); }
+inline ScalarFloat operator/(ScalarFloat a, ScalarFloat b) { return (ScalarFloat(a.v / b.v)); }
+
+#if defined(__AVX__)
+// eight floats in an AVX register
+struct SimdFloat
+{
+  static const int width = 8;
+  __m256 v;
+
+  SimdFloat() {}
+  SimdFloat(__m256 m) : v(m) {}
+  SimdFloat(float f) : v(_mm256_set1_ps(f)) {}
+  static SimdFloat load(const float *p) { return (SimdFloat(_mm256_loadu_ps(p))); }
+  void store(float *p) const { _mm256_storeu_ps(p, v); }
+};
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm256_add_ps(a.v, b.v))); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm256_sub_ps(a.v, b.v))); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm256_mul_ps(a.v, b.v))); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm256_div_ps(a.v, b.v))); }
+static const char *SIMD_NAME = "avx";
+#elif defined(__SSE2__)
+// four floats in an SSE register
+struct SimdFloat
+{
+  static const int width = 4;
+  __m128 v;
+
+  SimdFloat() {}
+  SimdFloat(__m128 m) : v(m) {}
+  SimdFloat(float f) : v(_mm_set1_ps(f)) {}
+  static SimdFloat load(const float *p) { return (SimdFloat(_mm_loadu_ps(p))); }
+  void store(float *p) const { _mm_storeu_ps(p, v); }
+};
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm_add_ps(a.v, b.v))); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm_sub_ps(a.v, b.v))); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm_mul_ps(a.v, b.v))); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return (SimdFloat(_mm_div_ps(a.v, b.v))); }
+static const char *SIMD_NAME = "sse2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// four floats in a NEON register
+struct SimdFloat
+{
+  static const int width = 4;
+  float32x4_t v;
+
+  SimdFloat() {}
+  SimdFloat(float32x4_t m) : v(m) {}
+  SimdFloat(float f) : v(vdupq_n_f32(f)) {}
+  static SimdFloat load(const float *p) { return (SimdFloat(vld1q_f32(p))); }
+  void store(float *p) const { vst1q_f32(p, v); }
+};
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return (SimdFloat(vaddq_f32(a.v, b.v))); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return (SimdFloat(vsubq_f32(a.v, b.v))); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return (SimdFloat(vmulq_f32(a.v, b.v))); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return (SimdFloat(vdivq_f32(a.v, b.v))); }
+static const char *SIMD_NAME = "neon";
+#else
+typedef ScalarFloat SimdFloat;
+static const char *SIMD_NAME = "scalar";
+#endif
+
+// the constants of one projection: the pose, the intrinsics and the distortion coefficients
+struct ProjectionParams
+{
+  float r[9];
+  float t[3];
+  float fx, fy, cx, cy;
+  const float *k;
+};
+
+// project the points in [begin, end) with a vector type V, leaving the tail that does not fill a whole vector
+// Model: the distortion model, so that the unused terms are compiled out
+// V: ScalarFloat or SimdFloat
+// return: the index of the first point that was not projected
+template <int Model, typename V>
+static int project_range(const ProjectionParams &p, const float *x, const float *y, const float *z, int begin, int end,
+                         cv::Point2f *imagePoints, float *cameraX, float *cameraY, float *cameraZ)
+{
+  const V one(1.0f), two(2.0f);
+  const V r0(p.r[0]), r1(p.r[1]), r2(p.r[2]), r3(p.r[3]), r4(p.r[4]), r5(p.r[5]), r6(p.r[6]), r7(p.r[7]), r8(p.r[8]);
+  const V t0(p.t[0]), t1(p.t[1]), t2(p.t[2]);
+  const V fx(p.fx), fy(p.fy), cx(p.cx), cy(p.cy);
+  const V k1(p.k[0]), k2(p.k[1]), p1(p.k[2]), p2(p.k[3]), k3(p.k[4]), k4(p.k[5]), k5(p.k[6]), k6(p.k[7]);
+  const V s1(p.k[8]), s2(p.k[9]), s3(p.k[10]), s4(p.k[11]);
+
+  float u[V::width], v[V::width];
+  int i = begin;
+  for (; i + V::width <= end; i += V::width)
+  {
+    // transform the points to the camera frame
+    V px = V::load(x + i), py = V::load(y + i), pz = V::load(z + i);
+    V X = r0 * px + r1 * py + r2 * pz + t0;
+    V Y = r3 * px + r4 * py + r5 * pz + t1;
+    V Z = r6 * px + r7 * py + r8 * pz + t2;
+    if (cameraX != NULL)
+    {
+      X.store(cameraX + i);
+      Y.store(cameraY + i);
+      Z.store(cameraZ + i);
+    }
+
+    // divide by the depth
+    V iz = one / Z;
+    V xp = X * iz, yp = Y * iz;
+
+    // distort the normalized coordinates
+    if (Model == DISTORTION_RADIAL)
+    {
+      V rr = xp * xp + yp * yp;
+      V radial = one + rr * (k1 + rr * (k2 + rr * k3));
+      xp = xp * radial;
+      yp = yp * radial;
+    }
+    else if (Model == DISTORTION_RATIONAL)
+    {
+      V rr = xp * xp + yp * yp;
+      V rr2 = rr * rr;
+      V radial = (one + rr * (k1 + rr * (k2 + rr * k3))) / (one + rr * (k4 + rr * (k5 + rr * k6)));
+      V a1 = two * xp * yp;
+      V a2 = rr + two * xp * xp;
+      V a3 = rr + two * yp * yp;
+      V xd = xp * radial + p1 * a1 + p2 * a2 + s1 * rr + s2 * rr2;
+      V yd = yp * radial + p1 * a3 + p2 * a1 + s3 * rr + s4 * rr2;
+      xp = xd;
+      yp = yd;
+    }
+
+    // apply the intrinsics and interleave the result
+    (fx * xp + cx).store(u);
+    (fy * yp + cy).store(v);
+    for (int j = 0; j < V::width; j++)
+    {
+      imagePoints[i + j] = cv::Point2f(u[j], v[j]);
+    }
+  }
+
+  return (i);
+}
+
+// project all points in [begin, end), the SIMD kernel first and the scalar kernel for the tail
+template <int Model>
+static void project_all(const ProjectionParams &p, const float *x, const float *y, const float *z, int begin, int end,
+                        cv::Point2f *imagePoints, float *cameraX, float *cameraY, float *cameraZ)
+{
+  int i = project_range<Model, SimdFloat>(p, x, y, z, begin, end, imagePoints, cameraX, cameraY, cameraZ);
+  project_range<Model, ScalarFloat>(p, x, y, z, i, end, imagePoints, cameraX, cameraY, cameraZ);
+}
+
+std::string distortion_model_name(DistortionModel model)
+{
+  if (model == DISTORTION_NONE)
+  {
+    return ("none");
+  }
+  else if (model == DISTORTION_RADIAL)
+  {
+    return ("radial");
+  }
+  else if (model == DISTORTION_RATIONAL)
+  {
+    return ("rational");
+  }
+
+  return ("generic");
+}
+
+Projector::Projector()
+{
+  distortionModel = DISTORTION_NONE;
+  memset(k, 0, sizeof(k));
+  fx = fy = 1;
+  cx = cy = 0;
+}
+
+Projector::Projector(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs)
+{
+  camera = cameraMatrix;
+  distortion = distCoeffs;
+
+  // read the intrinsics
+  cv::Mat K;
+  cameraMatrix.convertTo(K, CV_64F);
+  fx = (float)K.at<double>(0, 0);
+  fy = (float)K.at<double>(1, 1);
+  cx = (float)K.at<double>(0, 2);
+  cy = (float)K.at<double>(1, 2);
+
+  // read the distortion coefficients, the missing ones are zero
+  memset(k, 0, sizeof(k));
+  cv::Mat D;
+  if (!distCoeffs.empty())
+  {
+    distCoeffs.convertTo(D, CV_64F);
+    for (int i = 0; i < (int)D.total() && i < 14; i++)
+    {
+      k[i] = (float)D.at<double>(i);
+    }
+  }
+
+  // pick the cheapest model that reproduces the coefficients
+  bool tangential = k[2] != 0 || k[3] != 0;
+  bool rational = k[5] != 0 || k[6] != 0 || k[7] != 0;
+  bool prism = k[8] != 0 || k[9] != 0 || k[10] != 0 || k[11] != 0;
+  bool tilt = k[12] != 0 || k[13] != 0;
+  if (tilt)
+  {
+    distortionModel = DISTORTION_GENERIC;
+  }
+  else if (tangential || rational || prism)
+  {
+    distortionModel = DISTORTION_RATIONAL;
+  }
+  else if (k[0] != 0 || k[1] != 0 || k[4] != 0)
+  {
+    distortionModel = DISTORTION_RADIAL;
+  }
+  else
+  {
+    distortionModel = DISTORTION_NONE;
+  }
+}
+
+void Projector::project(const cv::Vec3d &rvec, const cv::Vec3d &tvec, const float *x, const float *y, const float *z,
+                        int count, cv::Point2f *imagePoints, float *cameraX, float *cameraY, float *cameraZ) const
+{
+  if (count <= 0)
+  {
+    return;
+  }
+
+  // convert the pose to a rotation matrix
+  cv::Matx33d rotation;
+  cv::Rodrigues(rvec, rotation);
+
+  // the generic model is left to OpenCV
+  if (distortionModel == DISTORTION_GENERIC)
+  {
+    std::vector<cv::Point3f> objectPoints(count);
+    std::vector<cv::Point2f> projected;
+    for (int i = 0; i < count; i++)
+    {
+      objectPoints[i] = cv::Point3f(x[i], y[i], z[i]);
+      if (cameraX != NULL)
+      {
+        cameraX[i] = (float)(rotation(0, 0) * x[i] + rotation(0, 1) * y[i] + rotation(0, 2) * z[i] + tvec[0]);
+        cameraY[i] = (float)(rotation(1, 0) * x[i] + rotation(1, 1) * y[i] + rotation(1, 2) * z[i] + tvec[1]);
+        cameraZ[i] = (float)(rotation(2, 0) * x[i] + rotation(2, 1) * y[i] + rotation(2, 2) * z[i] + tvec[2]);
+      }
+    }
+    cv::projectPoints(objectPoints, rvec, tvec, camera, distortion, projected);
+    std::copy(projected.begin(), projected.end(), imagePoints);
+    return;
+  }
+
+  ProjectionParams p;
+  for (int i = 0; i < 9; i++)
+  {
+    p.r[i] = (float)rotation.val[i];
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    p.t[i] = (float)tvec[i];
+  }
+  p.fx = fx;
+  p.fy = fy;
+  p.cx = cx;
+  p.cy = cy;
+  p.k = k;
+
+  // run the kernel of the model, split across threads for large meshes
+  void (*kernel)(const ProjectionParams &, const float *, const float *, const float *, int, int, cv::Point2f *,
+                 float *, float *, float *) = project_all<DISTORTION_NONE>;
+  if (distortionModel == DISTORTION_RADIAL)
+  {
+    kernel = project_all<DISTORTION_RADIAL>;
+  }
+  else if (distortionModel == DISTORTION_RATIONAL)
+  {
+    kernel = project_all<DISTORTION_RATIONAL>;
+  }
+
+  if (count < PARALLEL_POINTS)
+  {
+    kernel(p, x, y, z, 0, count, imagePoints, cameraX, cameraY, cameraZ);
+  }
+  else
+  {
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+    {
+      kernel(p, x, y, z, range.start, range.end, imagePoints, cameraX, cameraY, cameraZ);
+    });
+  }
+}
+
+void Projector::projectCamera(const float *x, const float *y, const float *z, int count, cv::Point2f *imagePoints) const
+{
+  project(cv::Vec3d(0, 0, 0), cv::Vec3d(0, 0, 0), x, y, z, count, imagePoints);
+}
+
+DistortionModel Projector::model() const
+{
+  return (distortionModel);
+}
+
+cv::Vec4f Projector::intrinsics() const
+{
+  return (cv::Vec4f(fx, fy, cx, cy));
+}
+
+const cv::Mat &Projector::cameraMatrix() const
+{
+  return (camera);
+}
+
+const cv::Mat &Projector::distCoeffs() const
+{
+  return (distortion);
+}
+
+std::string Projector::instructionSet()
+{
+  return (SIMD_NAME);
+}
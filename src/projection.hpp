@@ -0,0 +1,78 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef PROJECTION_HPP
+#define PROJECTION_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// the distortion models that have a specialized projection kernel
+enum DistortionModel
+{
+  DISTORTION_NONE,     // a pinhole camera, all coefficients are zero
+  DISTORTION_RADIAL,   // only k1, k2 and k3 are used
+  DISTORTION_RATIONAL, // the rational model with k1-k6, p1, p2 and s1-s4, as calibrated by CALIB_RATIONAL_MODEL
+  DISTORTION_GENERIC,  // anything else, e.g. a tilted sensor, which falls back to cv::projectPoints
+};
+
+// get the name of a distortion model
+// model: the model
+// return: the name
+std::string distortion_model_name(DistortionModel model);
+
+// projects batches of 3D points to the image plane, like cv::projectPoints without the Jacobians
+// the distortion model is picked once from the coefficients, and each model has its own kernel that works on
+// structure-of-arrays input with AVX, SSE2 or NEON, whichever the compiler targets, and plain C++ otherwise
+class Projector
+{
+public:
+  Projector();
+
+  // cameraMatrix: the camera matrix
+  // distCoeffs: the distortion coefficients, up to 14 as in cv::projectPoints
+  Projector(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs);
+
+  // project points given as separate coordinate arrays
+  // rvec: the rotation vector
+  // tvec: the translation vector
+  // x, y, z: the coordinates of the points
+  // count: the number of points
+  // imagePoints: the projected points, count of them
+  // cameraX, cameraY, cameraZ: if not NULL, the coordinates of the points in the camera frame, count of each
+  void project(const cv::Vec3d &rvec, const cv::Vec3d &tvec, const float *x, const float *y, const float *z, int count,
+               cv::Point2f *imagePoints, float *cameraX = NULL, float *cameraY = NULL, float *cameraZ = NULL) const;
+
+  // project points given in the camera frame already
+  // x, y, z: the coordinates of the points in the camera frame
+  // count: the number of points
+  // imagePoints: the projected points, count of them
+  void projectCamera(const float *x, const float *y, const float *z, int count, cv::Point2f *imagePoints) const;
+
+  // return: the distortion model of the kernel used
+  DistortionModel model() const;
+
+  // return: the focal lengths and the principal point as fx, fy, cx, cy
+  cv::Vec4f intrinsics() const;
+
+  // return: the camera matrix
+  const cv::Mat &cameraMatrix() const;
+
+  // return: the distortion coefficients
+  const cv::Mat &distCoeffs() const;
+
+  // return: the name of the instruction set the kernels use
+  static std::string instructionSet();
+
+private:
+  cv::Mat camera;
+  cv::Mat distortion;
+  DistortionModel distortionModel;
+  float k[14];
+  float fx, fy, cx, cy;
+};
+
+#endif
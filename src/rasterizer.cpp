@@ -0,0 +1,268 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include "rasterizer.hpp"
+#include "util.hpp"
+
+// the width and height of a tile in pixels
+static const int TILE_SIZE = 64;
+
+// triangles with a smaller area in square pixels cover no pixel centers worth drawing
+static const float MIN_AREA = 1e-6f;
+
+int parse_render_mode(std::string name, RenderMode &mode)
+{
+  if (name == "wire")
+  {
+    mode = RENDER_WIREFRAME;
+  }
+  else if (name == "flat")
+  {
+    mode = RENDER_FLAT;
+  }
+  else if (name == "gouraud")
+  {
+    mode = RENDER_GOURAUD;
+  }
+  else
+  {
+    return (-1);
+  }
+
+  return (0);
+}
+
+std::string render_mode_name(RenderMode mode)
+{
+  if (mode == RENDER_FLAT)
+  {
+    return ("flat");
+  }
+  else if (mode == RENDER_GOURAUD)
+  {
+    return ("gouraud");
+  }
+
+  return ("wire");
+}
+
+// map the z coordinate of the object to a shade of gray, like the wireframe does
+// z: the z coordinate
+// return: the shade
+static inline float z_shade(float z)
+{
+  return ((float)((int)(z / 3.5 * 155) + 100));
+}
+
+Rasterizer::Rasterizer()
+{
+  tilesX = 0;
+  tilesY = 0;
+}
+
+int Rasterizer::triangleCount() const
+{
+  return ((int)triangles.size());
+}
+
+int Rasterizer::render(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Mesh &mesh,
+                       RenderMode mode, RenderBuffers &buffers, cv::Mat &frame)
+{
+  // check if the vertices, faces, and frame are empty
+  if (mesh.vertexCount() == 0 || mesh.faceCount() == 0 || frame.empty())
+  {
+    printf("error: vertices, faces, or frame is empty.\n");
+    return (-1);
+  }
+
+  // error checking
+  if (frame.type() != CV_8UC3)
+  {
+    printf("error: frame is not an 8-bit BGR image.\n");
+    return (-1);
+  }
+
+  // transform and project the vertices, then set up, bin and rasterize the visible triangles
+  transform_vertices(projector, rvec, tvec, mesh, frame.size(), buffers);
+  begin(frame.size());
+  add(mesh, mode, buffers, buffers.faceRanges, 0);
+  finish(frame);
+
+  return (0);
+}
+
+void Rasterizer::begin(cv::Size size)
+{
+  // size the tiles and the z-buffer to the frame, they are reused while the size stays the same
+  if (depth.size() != size)
+  {
+    depth.create(size, CV_32F);
+    tilesX = (size.width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (size.height + TILE_SIZE - 1) / TILE_SIZE;
+    bins.assign(tilesX * tilesY, std::vector<int>());
+    activeTiles.clear();
+  }
+
+  // empty the bins, keeping their capacity
+  for (size_t i = 0; i < activeTiles.size(); i++)
+  {
+    bins[activeTiles[i]].clear();
+  }
+  activeTiles.clear();
+  triangles.clear();
+}
+
+void Rasterizer::add(const Mesh &mesh, RenderMode mode, const RenderBuffers &buffers,
+                     const std::vector<cv::Vec2i> &ranges, int base)
+{
+  cv::Size size = depth.size();
+  const cv::Point2f *points = &buffers.imagePoints[base];
+  const float *Z = &buffers.cameraZ[base];
+
+  // only the triangles in the ranges are looked at
+  for (size_t r = 0; r < ranges.size(); r++)
+  {
+    int end = ranges[r][0] + ranges[r][1];
+    for (int i = ranges[r][0]; i < end; i++)
+    {
+      if (!face_visible(mesh, buffers, i, base))
+      {
+        continue;
+      }
+
+      // the bounding box of the pixels covered, clipped to the frame, with the pixel centers on integer
+      // coordinates as projectPoints and cv::line have them, so the solid modes line up with the wireframe
+      const int *face = &mesh.indices[i * 3];
+      const cv::Point2f &p0 = points[face[0]], &p1 = points[face[1]], &p2 = points[face[2]];
+      Triangle t;
+      t.minX = std::max(0, (int)std::ceil(std::min(p0.x, std::min(p1.x, p2.x))));
+      t.minY = std::max(0, (int)std::ceil(std::min(p0.y, std::min(p1.y, p2.y))));
+      t.maxX = std::min(size.width - 1, (int)std::floor(std::max(p0.x, std::max(p1.x, p2.x))));
+      t.maxY = std::min(size.height - 1, (int)std::floor(std::max(p0.y, std::max(p1.y, p2.y))));
+      if (t.minX > t.maxX || t.minY > t.maxY)
+      {
+        continue;
+      }
+
+      // the signed area, either winding is drawn since back faces are culled already when the orientation is known
+      float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+      if (std::fabs(area) < MIN_AREA)
+      {
+        continue;
+      }
+
+      // the edge function of each vertex is zero on the opposite edge and one at the vertex,
+      // evaluated at the integer pixel coordinates
+      float scale = 1.0f / area;
+      const cv::Point2f *v[3] = {&p0, &p1, &p2};
+      for (int j = 0; j < 3; j++)
+      {
+        const cv::Point2f &from = *v[(j + 1) % 3], &to = *v[(j + 2) % 3];
+        t.a[j] = (from.y - to.y) * scale;
+        t.b[j] = (to.x - from.x) * scale;
+        t.c[j] = (from.x * to.y - from.y * to.x) * scale;
+        t.invZ[j] = 1.0f / Z[face[j]];
+        t.shade[j] = z_shade(mesh.z[face[j]]);
+      }
+
+      // a flat triangle has the color of its average z, like an edge of the wireframe
+      if (mode == RENDER_FLAT)
+      {
+        float shade = z_shade((mesh.z[face[0]] + mesh.z[face[1]] + mesh.z[face[2]]) / 3);
+        t.shade[0] = t.shade[1] = t.shade[2] = shade;
+      }
+
+      // add the triangle to the tiles its bounding box overlaps
+      int index = (int)triangles.size();
+      triangles.push_back(t);
+      for (int ty = t.minY / TILE_SIZE; ty <= t.maxY / TILE_SIZE; ty++)
+      {
+        for (int tx = t.minX / TILE_SIZE; tx <= t.maxX / TILE_SIZE; tx++)
+        {
+          std::vector<int> &bin = bins[ty * tilesX + tx];
+          if (bin.empty())
+          {
+            activeTiles.push_back(ty * tilesX + tx);
+          }
+          bin.push_back(index);
+        }
+      }
+    }
+  }
+}
+
+void Rasterizer::finish(cv::Mat &frame)
+{
+  // rasterize the tiles in parallel, each tile is written by one thread only
+  cv::parallel_for_(cv::Range(0, (int)activeTiles.size()), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      rasterizeTile(activeTiles[i], frame);
+    }
+  });
+}
+
+// rasterize the triangles of a tile into the frame, in the order they were set up
+// tile: the index of the tile
+// frame: the frame to draw on
+void Rasterizer::rasterizeTile(int tile, cv::Mat &frame)
+{
+  int tileX = (tile % tilesX) * TILE_SIZE;
+  int tileY = (tile / tilesX) * TILE_SIZE;
+  int tileMaxX = std::min(tileX + TILE_SIZE, frame.cols) - 1;
+  int tileMaxY = std::min(tileY + TILE_SIZE, frame.rows) - 1;
+
+  // clear the z-buffer of the tile
+  for (int y = tileY; y <= tileMaxY; y++)
+  {
+    float *depthRow = depth.ptr<float>(y);
+    std::fill(depthRow + tileX, depthRow + tileMaxX + 1, 0.0f);
+  }
+
+  const std::vector<int> &bin = bins[tile];
+  for (size_t i = 0; i < bin.size(); i++)
+  {
+    const Triangle &t = triangles[bin[i]];
+    int x0 = std::max(t.minX, tileX), x1 = std::min(t.maxX, tileMaxX);
+    int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, tileMaxY);
+
+    // the inverse depth and shade are planes over the screen, so they step by a constant per pixel too
+    float dzdx = t.a[0] * t.invZ[0] + t.a[1] * t.invZ[1] + t.a[2] * t.invZ[2];
+    float dsdx = t.a[0] * t.shade[0] + t.a[1] * t.shade[1] + t.a[2] * t.shade[2];
+    for (int y = y0; y <= y1; y++)
+    {
+      float w0 = t.a[0] * x0 + t.b[0] * y + t.c[0];
+      float w1 = t.a[1] * x0 + t.b[1] * y + t.c[1];
+      float w2 = t.a[2] * x0 + t.b[2] * y + t.c[2];
+      float invZ = w0 * t.invZ[0] + w1 * t.invZ[1] + w2 * t.invZ[2];
+      float shade = w0 * t.shade[0] + w1 * t.shade[1] + w2 * t.shade[2];
+      float *depthRow = depth.ptr<float>(y);
+      uchar *pixel = frame.ptr<uchar>(y);
+      for (int x = x0; x <= x1; x++)
+      {
+        // a pixel center on a shared edge is covered by both triangles, and the closer one wins
+        if (w0 >= 0 && w1 >= 0 && w2 >= 0 && invZ > depthRow[x])
+        {
+          depthRow[x] = invZ;
+          uchar value = cv::saturate_cast<uchar>(shade);
+          pixel[x * 3] = value;
+          pixel[x * 3 + 1] = value;
+          pixel[x * 3 + 2] = value;
+        }
+        w0 += t.a[0];
+        w1 += t.a[1];
+        w2 += t.a[2];
+        invZ += dzdx;
+        shade += dsdx;
+      }
+    }
+  }
+}
@@ -0,0 +1,101 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef RASTERIZER_HPP
+#define RASTERIZER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "mesh.hpp"
+#include "projection.hpp"
+
+// how the object is drawn on the frame
+enum RenderMode
+{
+  RENDER_WIREFRAME, // the depth-colored edges of the visible triangles, as draw_object draws them
+  RENDER_FLAT,      // solid triangles with one color per triangle, hidden surfaces removed with a z-buffer
+  RENDER_GOURAUD,   // solid triangles with the colors of their vertices interpolated across them
+};
+
+// parse a render mode from its name
+// name: "wire", "flat" or "gouraud"
+// mode: the parsed mode
+// return: 0 if successful, -1 if the name is unknown
+int parse_render_mode(std::string name, RenderMode &mode);
+
+// get the name of a render mode
+// mode: the mode
+// return: the name, as accepted by parse_render_mode
+std::string render_mode_name(RenderMode mode);
+
+// draws solid triangle meshes on a frame with a z-buffer
+// the visible triangles are set up once, binned into square tiles of the frame by their bounding boxes,
+// and the tiles are rasterized in parallel, each by one thread, so that no two threads write the same pixel
+class Rasterizer
+{
+public:
+  Rasterizer();
+
+  // draw the object on the frame
+  // projector: projects points with the camera matrix and distortion coefficients
+  // rvec: the rotation vector
+  // tvec: the translation vector
+  // mesh: the vertices and faces of the object
+  // mode: RENDER_FLAT or RENDER_GOURAUD
+  // buffers: the buffers reused between frames
+  // frame: the 8-bit BGR frame to draw on
+  // return: 0 if successful, -1 if error
+  int render(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Mesh &mesh,
+             RenderMode mode, RenderBuffers &buffers, cv::Mat &frame);
+
+  // start a frame of several meshes, whose vertices the caller transforms into one set of buffers
+  // size: the size of the frame
+  void begin(cv::Size size);
+
+  // set up and bin the visible triangles of a mesh
+  // mesh: the vertices and faces of the object
+  // mode: RENDER_FLAT or RENDER_GOURAUD
+  // buffers: the buffers with the transformed vertices
+  // ranges: the ranges of faces to draw as start and count
+  // base: the index of the first vertex of the mesh in the buffers
+  void add(const Mesh &mesh, RenderMode mode, const RenderBuffers &buffers, const std::vector<cv::Vec2i> &ranges,
+           int base);
+
+  // rasterize the triangles added since begin
+  // frame: the 8-bit BGR frame to draw on, of the size passed to begin
+  void finish(cv::Mat &frame);
+
+  // return: the number of triangles rasterized in the last frame
+  int triangleCount() const;
+
+private:
+  // a triangle set up for rasterization
+  struct Triangle
+  {
+    // the edge functions w = a * x + b * y + c, normalized so that the three of them sum to 1 inside
+    float a[3], b[3], c[3];
+    // the inverse depth and the shade at each vertex, interpolated with the edge functions
+    float invZ[3];
+    float shade[3];
+    // the bounding box in pixels, inclusive
+    int minX, minY, maxX, maxY;
+  };
+
+  void rasterizeTile(int tile, cv::Mat &frame);
+
+  std::vector<Triangle> triangles;
+
+  // the triangles overlapping each tile, and the tiles that have any
+  std::vector<std::vector<int>> bins;
+  std::vector<int> activeTiles;
+  int tilesX, tilesY;
+
+  // the inverse depth of the closest triangle at each pixel, 0 where there is none
+  cv::Mat depth;
+};
+
+#endif
@@ -0,0 +1,328 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "profiler.hpp"
+#include "scene.hpp"
+#include "util.hpp"
+
+// the center of the chessboard, where read_object_data puts the objects
+static const cv::Vec3f BOARD_CENTER(4, -2.5f, 0);
+
+int add_scene_mesh(Scene &scene, std::string name, const Mesh &mesh)
+{
+  // the bounding sphere around the center of the bounding box
+  cv::Vec3f low(0, 0, 0), high(0, 0, 0);
+  if (mesh.vertexCount() > 0)
+  {
+    low = high = cv::Vec3f(mesh.x[0], mesh.y[0], mesh.z[0]);
+  }
+  for (int i = 1; i < mesh.vertexCount(); i++)
+  {
+    cv::Vec3f p(mesh.x[i], mesh.y[i], mesh.z[i]);
+    for (int k = 0; k < 3; k++)
+    {
+      low[k] = std::min(low[k], p[k]);
+      high[k] = std::max(high[k], p[k]);
+    }
+  }
+  cv::Vec3f center = (low + high) * 0.5f;
+  float radius = 0;
+  for (int i = 0; i < mesh.vertexCount(); i++)
+  {
+    cv::Vec3f p(mesh.x[i], mesh.y[i], mesh.z[i]);
+    radius = std::max(radius, (float)cv::norm(p - center));
+  }
+
+  scene.names.push_back(name);
+  scene.meshes.push_back(mesh);
+  scene.spheres.push_back(cv::Vec4f(center[0], center[1], center[2], radius));
+
+  return ((int)scene.meshes.size() - 1);
+}
+
+int add_scene_instance(Scene &scene, int mesh, cv::Vec3f position, cv::Vec3f angles, float scale)
+{
+  // error checking
+  if (mesh < 0 || mesh >= (int)scene.meshes.size())
+  {
+    printf("error: instance refers to a mesh that does not exist.\n");
+    return (-1);
+  }
+
+  // error checking
+  if (!(scale > 0))
+  {
+    printf("error: instance scale must be larger than 0.\n");
+    return (-1);
+  }
+
+  // rotate about x, then y, then z
+  cv::Matx33f rotation = cv::Matx33f::eye();
+  for (int k = 0; k < 3; k++)
+  {
+    cv::Vec3d axis(0, 0, 0);
+    axis[k] = angles[k] * CV_PI / 180;
+    cv::Matx33d step;
+    cv::Rodrigues(axis, step);
+    rotation = cv::Matx33f(step) * rotation;
+  }
+
+  MeshInstance instance;
+  instance.mesh = mesh;
+  instance.rotation = rotation * scale;
+  instance.translation = BOARD_CENTER + position - instance.rotation * BOARD_CENTER;
+  instance.scale = scale;
+  scene.instances.push_back(instance);
+
+  return (0);
+}
+
+int read_scene(std::string filename, Scene &scene)
+{
+  std::ifstream file(filename);
+  if (!file.is_open())
+  {
+    printf("error: could not open scene file %s.\n", filename.c_str());
+    return (-1);
+  }
+
+  // the obj files are relative to the folder of the scene file
+  std::string folder;
+  size_t slash = filename.find_last_of("/\\");
+  if (slash != std::string::npos)
+  {
+    folder = filename.substr(0, slash + 1);
+  }
+
+  scene = Scene();
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line))
+  {
+    lineNumber++;
+    std::istringstream stream(line);
+    std::string keyword;
+    if (!(stream >> keyword) || keyword[0] == '#')
+    {
+      continue;
+    }
+
+    if (keyword == "mesh")
+    {
+      std::string name, path;
+      if (!(stream >> name >> path))
+      {
+        printf("error: expected mesh <name> <obj file> on line %d of %s.\n", lineNumber, filename.c_str());
+        return (-1);
+      }
+      if (std::find(scene.names.begin(), scene.names.end(), name) != scene.names.end())
+      {
+        printf("error: mesh %s is defined twice on line %d of %s.\n", name.c_str(), lineNumber, filename.c_str());
+        return (-1);
+      }
+      if (path[0] != '/')
+      {
+        path = folder + path;
+      }
+
+      Mesh mesh;
+      if (read_object_data(path, mesh) != 0)
+      {
+        return (-1);
+      }
+      add_scene_mesh(scene, name, mesh);
+    }
+    else if (keyword == "instance")
+    {
+      std::string name;
+      cv::Vec3f position, angles(0, 0, 0);
+      float scale = 1;
+      if (!(stream >> name >> position[0] >> position[1] >> position[2]))
+      {
+        printf("error: expected instance <name> <x> <y> <z> on line %d of %s.\n", lineNumber, filename.c_str());
+        return (-1);
+      }
+
+      // the angles come as all three or none, and the scale only after them
+      std::vector<float> values;
+      float value;
+      while (stream >> value)
+      {
+        values.push_back(value);
+      }
+      if (!stream.eof() || (values.size() != 0 && values.size() != 3 && values.size() != 4))
+      {
+        printf("error: expected [<rx> <ry> <rz> [<scale>]] on line %d of %s.\n", lineNumber, filename.c_str());
+        return (-1);
+      }
+      if (values.size() >= 3)
+      {
+        angles = cv::Vec3f(values[0], values[1], values[2]);
+      }
+      if (values.size() == 4)
+      {
+        scale = values[3];
+      }
+
+      std::vector<std::string>::iterator found = std::find(scene.names.begin(), scene.names.end(), name);
+      if (found == scene.names.end())
+      {
+        printf("error: unknown mesh %s on line %d of %s.\n", name.c_str(), lineNumber, filename.c_str());
+        return (-1);
+      }
+      if (add_scene_instance(scene, (int)(found - scene.names.begin()), position, angles, scale) != 0)
+      {
+        printf("error: invalid instance on line %d of %s.\n", lineNumber, filename.c_str());
+        return (-1);
+      }
+    }
+    else
+    {
+      printf("error: unknown statement %s on line %d of %s.\n", keyword.c_str(), lineNumber, filename.c_str());
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+int draw_scene(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Scene &scene,
+               RenderMode mode, Rasterizer &rasterizer, RenderBuffers &buffers, SceneBuffers &sceneBuffers,
+               cv::Mat &frame)
+{
+  // check if the frame is empty
+  if (frame.empty())
+  {
+    printf("error: frame is empty.\n");
+    return (-1);
+  }
+
+  // error checking
+  if (mode != RENDER_WIREFRAME && frame.type() != CV_8UC3)
+  {
+    printf("error: frame is not an 8-bit BGR image.\n");
+    return (-1);
+  }
+
+  // the frustum planes in the camera frame, normalized so that they give the distance to the center of a sphere
+  cv::Vec4d planes[5];
+  frustum_planes(projector, cv::Vec3d(0, 0, 0), cv::Vec3d(0, 0, 0), frame.size(), planes);
+  for (int i = 0; i < 5; i++)
+  {
+    planes[i] *= 1.0 / cv::norm(cv::Vec3d(planes[i][0], planes[i][1], planes[i][2]));
+  }
+
+  // compose the pose of the chessboard with the model transform of every instance once,
+  // and keep the instances whose bounding sphere is not entirely outside one of the planes
+  cv::Matx33d board;
+  cv::Rodrigues(rvec, board);
+  cv::Matx33f boardRotation(board);
+  cv::Vec3f boardTranslation(tvec);
+  std::vector<MeshInstance> &visible = sceneBuffers.visible;
+  std::vector<int> &bases = sceneBuffers.bases;
+  visible.clear();
+  bases.clear();
+  visible.reserve(scene.instances.size());
+  bases.reserve(scene.instances.size());
+  int total = 0;
+  for (size_t i = 0; i < scene.instances.size(); i++)
+  {
+    const MeshInstance &instance = scene.instances[i];
+    const cv::Vec4f &sphere = scene.spheres[instance.mesh];
+    MeshInstance composed = instance;
+    composed.rotation = boardRotation * instance.rotation;
+    composed.translation = boardRotation * instance.translation + boardTranslation;
+
+    cv::Vec3f center = composed.rotation * cv::Vec3f(sphere[0], sphere[1], sphere[2]) + composed.translation;
+    double radius = sphere[3] * instance.scale;
+    bool outside = false;
+    for (int j = 0; j < 5 && !outside; j++)
+    {
+      outside = planes[j][0] * center[0] + planes[j][1] * center[1] + planes[j][2] * center[2] + planes[j][3] < -radius;
+    }
+    if (outside)
+    {
+      continue;
+    }
+
+    visible.push_back(composed);
+    bases.push_back(total);
+    total += scene.meshes[instance.mesh].vertexCount();
+  }
+
+  if (total == 0)
+  {
+    return (0);
+  }
+
+  // transform the vertices of the visible instances into one set of buffers, one instance per task
+  {
+    ScopedTimer timer(PROFILE_PROJECT);
+    buffers.cameraX.resize(total);
+    buffers.cameraY.resize(total);
+    buffers.cameraZ.resize(total);
+    buffers.imagePoints.resize(total);
+    buffers.outcodes.resize(total);
+    cv::parallel_for_(cv::Range(0, (int)visible.size()), [&](const cv::Range &range)
+    {
+      for (int i = range.start; i < range.end; i++)
+      {
+        const Mesh &mesh = scene.meshes[visible[i].mesh];
+        const cv::Matx33f &r = visible[i].rotation;
+        const cv::Vec3f &t = visible[i].translation;
+        float *X = &buffers.cameraX[bases[i]];
+        float *Y = &buffers.cameraY[bases[i]];
+        float *Z = &buffers.cameraZ[bases[i]];
+        for (int j = 0; j < mesh.vertexCount(); j++)
+        {
+          float x = mesh.x[j], y = mesh.y[j], z = mesh.z[j];
+          X[j] = r(0, 0) * x + r(0, 1) * y + r(0, 2) * z + t[0];
+          Y[j] = r(1, 0) * x + r(1, 1) * y + r(1, 2) * z + t[1];
+          Z[j] = r(2, 0) * x + r(2, 1) * y + r(2, 2) * z + t[2];
+        }
+      }
+    });
+
+    // project all of them in one batch
+    projector.projectCamera(&buffers.cameraX[0], &buffers.cameraY[0], &buffers.cameraZ[0], total,
+                            &buffers.imagePoints[0]);
+    compute_outcodes(projector, frame.size(), &buffers.cameraX[0], &buffers.cameraY[0], &buffers.cameraZ[0], total,
+                     &buffers.outcodes[0]);
+  }
+
+  // draw every instance from its range of the buffers, the solid modes share one z-buffer
+  std::vector<cv::Vec2i> &ranges = sceneBuffers.ranges;
+  ranges.resize(1);
+  if (mode != RENDER_WIREFRAME)
+  {
+    rasterizer.begin(frame.size());
+  }
+  for (size_t i = 0; i < visible.size(); i++)
+  {
+    const Mesh &mesh = scene.meshes[visible[i].mesh];
+    ranges[0] = cv::Vec2i(0, mesh.faceCount());
+    if (mode == RENDER_WIREFRAME)
+    {
+      draw_wireframe(mesh, ranges, bases[i], buffers, frame);
+    }
+    else
+    {
+      rasterizer.add(mesh, mode, buffers, ranges, bases[i]);
+    }
+  }
+  if (mode != RENDER_WIREFRAME)
+  {
+    rasterizer.finish(frame);
+  }
+
+  return (0);
+}
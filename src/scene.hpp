@@ -0,0 +1,91 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "mesh.hpp"
+#include "projection.hpp"
+#include "rasterizer.hpp"
+
+// a mesh placed on the chessboard
+// the model transform rotates and scales the mesh about the center of the chessboard, where read_object_data
+// puts it, then moves it, so p' = rotation * (p - center) + center + position
+struct MeshInstance
+{
+  int mesh;              // the index of the mesh in the scene
+  cv::Matx33f rotation;  // the rotation times the scale
+  cv::Vec3f translation; // center + position - rotation * center
+  float scale;
+};
+
+// meshes and the instances of them placed on the chessboard, which share the storage of their mesh
+struct Scene
+{
+  std::vector<std::string> names;
+  std::vector<Mesh> meshes;
+
+  // the bounding sphere of every mesh, as the center and the radius
+  std::vector<cv::Vec4f> spheres;
+
+  std::vector<MeshInstance> instances;
+};
+
+// the per-frame lists of draw_scene, kept between frames so that they keep their memory
+struct SceneBuffers
+{
+  std::vector<MeshInstance> visible; // the instances inside the view frustum, composed with the pose
+  std::vector<int> bases;            // the first vertex of every visible instance in the render buffers
+  std::vector<cv::Vec2i> ranges;     // the range of triangles drawn of one instance
+};
+
+// add a mesh to a scene
+// scene: the scene
+// name: the name the instances refer to it by
+// mesh: the mesh
+// return: the index of the mesh
+int add_scene_mesh(Scene &scene, std::string name, const Mesh &mesh);
+
+// add an instance of a mesh to a scene
+// scene: the scene
+// mesh: the index of the mesh
+// position: where the mesh is moved to, relative to the center of the chessboard
+// angles: the rotation about the x, y and z axes of the chessboard in degrees, applied in that order
+// scale: the scale, larger than 0
+// return: 0 if successful, -1 if error
+int add_scene_instance(Scene &scene, int mesh, cv::Vec3f position, cv::Vec3f angles, float scale);
+
+// read a scene file
+// every line is empty, a comment starting with #, or one of
+//   mesh <name> <obj file>, where the path is relative to the scene file
+//   instance <name> <x> <y> <z> [<rx> <ry> <rz> [<scale>]], with the angles in degrees
+// filename: the path of the scene file
+// scene: the scene
+// return: 0 if successful, -1 if error
+int read_scene(std::string filename, Scene &scene);
+
+// draw the instances of a scene on the frame
+// the model transform of every instance is composed with the pose of the chessboard once, the instances outside
+// the view frustum are culled by their bounding spheres, and the vertices of all the others are transformed into
+// one set of buffers and projected in one batch
+// projector: projects points with the camera matrix and distortion coefficients
+// rvec: the rotation vector of the chessboard
+// tvec: the translation vector of the chessboard
+// scene: the scene
+// mode: how to draw the meshes
+// rasterizer: the rasterizer for the solid modes
+// buffers: the buffers reused between frames
+// sceneBuffers: the lists of visible instances reused between frames
+// frame: the frame to draw on
+// return: 0 if successful, -1 if error
+int draw_scene(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Scene &scene,
+               RenderMode mode, Rasterizer &rasterizer, RenderBuffers &buffers, SceneBuffers &sceneBuffers,
+               cv::Mat &frame);
+
+#endif
@@ -0,0 +1,50 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#include <opencv2/opencv.hpp>
+#include "undistorter.hpp"
+
+Undistorter::Undistorter(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs)
+{
+  camera = cameraMatrix.clone();
+  distortion = distCoeffs.clone();
+  zero = cv::Mat::zeros(1, 5, CV_64F);
+  passThrough = distCoeffs.empty() || cv::countNonZero(distCoeffs.reshape(1, 1)) == 0;
+}
+
+void Undistorter::apply(const cv::Mat &frame, cv::Mat &undistorted)
+{
+  if (passThrough)
+  {
+    undistorted = frame;
+    return;
+  }
+
+  // the maps depend on the size of the frame only, a camera keeps its size so they are built once
+  if (frame.size() != mapSize)
+  {
+    cv::initUndistortRectifyMap(camera, distortion, cv::Mat(), camera, frame.size(), CV_16SC2, map1, map2);
+    mapSize = frame.size();
+  }
+
+  // the pixels mapped from outside of the frame are left black
+  cv::remap(frame, undistorted, map1, map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+}
+
+const cv::Mat &Undistorter::cameraMatrix() const
+{
+  return (camera);
+}
+
+const cv::Mat &Undistorter::distCoeffs() const
+{
+  return (passThrough ? distortion : zero);
+}
+
+bool Undistorter::identity() const
+{
+  return (passThrough);
+}
@@ -0,0 +1,50 @@
+/*
+  Yixiang Xie
+  Fall 2023
+  CS 5330
+*/
+
+#ifndef UNDISTORTER_HPP
+#define UNDISTORTER_HPP
+
+#include <opencv2/opencv.hpp>
+
+// removes the lens distortion from frames with maps precomputed from the calibration
+// the maps are built once per frame size with cv::initUndistortRectifyMap in the fixed-point CV_16SC2 format,
+// which cv::remap reads with integer table lookups and splits into stripes of rows across the threads.
+// the undistorted frames keep the camera matrix and have no distortion, so that the chessboard detection,
+// the pose solver and the pinhole projection kernel can work on them without the distortion model
+class Undistorter
+{
+public:
+  // cameraMatrix: the camera matrix
+  // distCoeffs: the distortion coefficients
+  Undistorter(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs);
+
+  // undistort a frame, building the maps first if the size of the frame changed
+  // without distortion the frame is passed through without a copy
+  // frame: the frame from the camera
+  // undistorted: the undistorted frame, which must not be the same as frame
+  void apply(const cv::Mat &frame, cv::Mat &undistorted);
+
+  // return: the camera matrix of the undistorted frames
+  const cv::Mat &cameraMatrix() const;
+
+  // return: the distortion coefficients of the undistorted frames, all zero
+  const cv::Mat &distCoeffs() const;
+
+  // return: true if the calibration has no distortion to remove
+  bool identity() const;
+
+private:
+  cv::Mat camera;
+  cv::Mat distortion;
+  cv::Mat zero;
+  bool passThrough;
+
+  // the integer pixel coordinates and the interpolation table index for every pixel of the undistorted frame
+  cv::Mat map1, map2;
+  cv::Size mapSize;
+};
+
+#endif
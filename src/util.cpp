@@ -4,10 +4,14 @@
   CS 5330
 */
 
-#include <fstream>
+#include <algorithm>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
+#include "mesh_cache.hpp"
+#include "obj_parser.hpp"
+#include "profiler.hpp"
 #include "util.hpp"
 
 // get the image name
@@ -168,151 +172,108 @@ int vector_to_mat(std::vector<double> vec, cv::Mat &cameraMatrix, cv::Mat &distC
   return (0);
 }
 
-// read the object data from a obj file
-// for each line in the obj file, if the line is a vertex, it should be in the format:
-//   v x y z
-// if the line is a face, it should be in the format:
-//   f v1 v2 v3
+// parse an obj file and place the object at the center of the chessboard
+// the y and z coordinates are swapped, so that the object stands on the chessboard
 // filename: the filename of the obj file
-// vertices: the vector to store the vertices
-// faces: the vector to store the faces
+// mesh: the mesh to store the vertices and faces in
 // return: 0 if successful, -1 if error
-int read_object_data(std::string filename, std::vector<cv::Point3f> &vertices, std::vector<std::vector<int>> &faces)
+static int parse_object_file(std::string filename, MeshData &mesh)
 {
-  // open the file
-  std::ifstream file(filename);
-
-  // error checking
-  if (!file.is_open())
+  if (parse_obj_file(filename, mesh) != 0)
   {
-    printf("error: unable to open file.\n");
     return (-1);
   }
 
-  // read the file line by line
-  std::string line;
-  while (std::getline(file, line))
+  // reverse the y and z coordinates, and move the vertices to the center of the chessboard
+  for (int i = 0; i < mesh.vertexCount(); i++)
   {
-    // check if the line is empty
-    if (line.empty())
-    {
-      continue;
-    }
-
-    // get the first word of the line, which indicates the type of the line
-    std::string type;
-    std::stringstream ss(line);
-    ss >> type;
+    float y = mesh.y[i];
+    mesh.y[i] = mesh.z[i] - 2.5f;
+    mesh.z[i] = y;
+    mesh.x[i] += 4;
+  }
 
-    // check if the line is a vertex
-    if (type == "v")
+  // error checking, the renderer does not check the indices
+  for (size_t i = 0; i < mesh.indices.size(); i++)
+  {
+    if (mesh.indices[i] < 0 || mesh.indices[i] >= mesh.vertexCount())
     {
-      // get the x, y, z coordinates of the vertex, and reverse the y and z coordinates
-      float x, y, z;
-      ss >> x >> z >> y;
-
-      // error checking
-      if (ss.fail())
-      {
-        printf("error: invalid vertex.\n");
-        return (-1);
-      }
-
-      // create a vertex that is at the center of the chessboard
-      cv::Point3f vertex(x + 4, y - 2.5, z);
-
-      // add the vertex to the vector
-      vertices.push_back(vertex);
+      printf("error: face refers to a vertex that does not exist.\n");
+      return (-1);
     }
+  }
 
-    // check if the line is a face
-    else if (type == "f")
-    {
-      // create a face
-      std::vector<int> face;
-
-      // get the three vertices of the face
-      int v1, v2, v3;
-      ss >> v1 >> v2 >> v3;
-
-      // error checking
-      if (ss.fail())
-      {
-        printf("error: invalid face.\n");
-        return (-1);
-      }
+  // build the hierarchy for frustum culling, and the unique edges for the wireframe
+  build_bvh(mesh);
+  build_edges(mesh);
 
-      // add the vertices to the face, and subtract 1 because the vertices are 1-indexed
-      face.push_back(v1 - 1);
-      face.push_back(v2 - 1);
-      face.push_back(v3 - 1);
+  return (0);
+}
 
-      // add the face to the vector
-      faces.push_back(face);
-    }
+// read the object data from a obj file, or from its binary cache file if it is up to date
+// the cache is written next to the obj file the first time it is parsed, and mapped read-only after that,
+// so concurrent processes share its memory
+// filename: the filename of the obj file
+// mesh: the mesh to store the vertices and faces in
+// useCache: whether to map and write the cache file
+// return: 0 if successful, -1 if error
+int read_object_data(std::string filename, Mesh &mesh, bool useCache)
+{
+  if (useCache && map_mesh_cache(filename, mesh) == 0)
+  {
+    return (0);
+  }
 
-    // error checking
-    else
-    {
-      printf("error: invalid line type.\n");
-      return (-1);
-    }
+  std::shared_ptr<MeshData> data = std::make_shared<MeshData>();
+  if (parse_object_file(filename, *data) != 0)
+  {
+    return (-1);
   }
+  mesh = make_mesh(data);
 
-  // close the file
-  file.close();
+  // a cache that cannot be written, e.g. in a read-only folder, only costs the next start the parsing
+  if (useCache)
+  {
+    write_mesh_cache(filename, mesh);
+  }
 
   return (0);
 }
 
 // draw the four outside corners of the chessboard
 // and the 3D axes at the origin of the chessboard on the frame
-// cameraMatrix: the camera matrix
-// distCoeffs: the distortion coefficients
+// projector: projects points with the camera matrix and distortion coefficients
 // rvec: the rotation vector
 // tvec: the translation vector
 // frame: the frame to draw on
 // return: 0 if successful, -1 if error
-int draw_corners(cv::Mat cameraMatrix, cv::Mat distCoeffs, cv::Vec3d rvec, cv::Vec3d tvec, cv::Mat &frame)
+int draw_corners(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, cv::Mat &frame)
 {
-  // check if the camera matrix, distortion coefficients, and frame are empty
-  if (cameraMatrix.empty() || distCoeffs.empty() || frame.empty())
+  // check if the frame is empty
+  if (frame.empty())
   {
-    printf("error: camera matrix, distortion coefficients, or frame is empty.\n");
+    printf("error: frame is empty.\n");
     return (-1);
   }
 
-  // define some 3D points in the space
-  std::vector<cv::Point3f> objectPoints;
-  // the four outside corners of the chessboard
-  objectPoints.push_back(cv::Point3f(0, 0, 0));
-  objectPoints.push_back(cv::Point3f(8, 0, 0));
-  objectPoints.push_back(cv::Point3f(8, -5, 0));
-  objectPoints.push_back(cv::Point3f(0, -5, 0));
-  // the 3D axes at the origin of the chessboard
-  objectPoints.push_back(cv::Point3f(2, 0, 0));
-  objectPoints.push_back(cv::Point3f(0, -2, 0));
-  objectPoints.push_back(cv::Point3f(0, 0, 2));
-  // the 3D points of the rectangle masking the chessboard
-  objectPoints.push_back(cv::Point3f(-1, 1, 0));
-  objectPoints.push_back(cv::Point3f(9, 1, 0));
-  objectPoints.push_back(cv::Point3f(9, -6, 0));
-  objectPoints.push_back(cv::Point3f(-1, -6, 0));
+  // define some 3D points in the space:
+  // the four outside corners of the chessboard (0-3),
+  // the 3D axes at the origin of the chessboard (4-6),
+  // and the 3D points of the rectangle masking the chessboard (7-10)
+  static const float objectX[] = {0, 8, 8, 0, 2, 0, 0, -1, 9, 9, -1};
+  static const float objectY[] = {0, 0, -5, -5, 0, -2, 0, 1, 1, -6, -6};
+  static const float objectZ[] = {0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0};
 
   // project the 3D points to the image plane
-  std::vector<cv::Point2f> imagePoints;
-  cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, imagePoints);
+  cv::Point2f imagePoints[11];
+  projector.project(rvec, tvec, objectX, objectY, objectZ, 11, imagePoints);
 
   // draw a rectangle masking the chessboard
-  std::vector<cv::Point> squareCorners;
-  squareCorners.push_back(imagePoints[7]);
-  squareCorners.push_back(imagePoints[8]);
-  squareCorners.push_back(imagePoints[9]);
-  squareCorners.push_back(imagePoints[10]);
-  std::vector<std::vector<cv::Point>> contours;
-  contours.push_back(squareCorners);
-  cv::polylines(frame, contours, true, cv::Scalar(255, 255, 255), 2);
-  cv::fillPoly(frame, contours, cv::Scalar(255, 255, 255));
+  cv::Point squareCorners[4] = {imagePoints[7], imagePoints[8], imagePoints[9], imagePoints[10]};
+  const cv::Point *contours[1] = {squareCorners};
+  int contourSizes[1] = {4};
+  cv::polylines(frame, contours, contourSizes, 1, true, cv::Scalar(255, 255, 255), 2);
+  cv::fillPoly(frame, contours, contourSizes, 1, cv::Scalar(255, 255, 255));
 
   // draw the four outside corners of the chessboard as circles
   cv::circle(frame, imagePoints[0], 6, cv::Scalar(0, 0, 0), -1);
@@ -328,41 +289,394 @@ int draw_corners(cv::Mat cameraMatrix, cv::Mat distCoeffs, cv::Vec3d rvec, cv::V
   return (0);
 }
 
-// draw the object on the frame
-// cameraMatrix: the camera matrix
-// distCoeffs: the distortion coefficients
+// the sides of the view frustum a vertex can be outside of
+enum
+{
+  OUTSIDE_LEFT = 1,
+  OUTSIDE_RIGHT = 2,
+  OUTSIDE_TOP = 4,
+  OUTSIDE_BOTTOM = 8,
+  OUTSIDE_NEAR = 16,
+};
+
+// the distance of the near plane from the camera, in chessboard squares
+static const float NEAR_PLANE = 0.1f;
+
+// the margin around the frame that still counts as inside, as a fraction of the frame size,
+// because the frustum planes ignore the lens distortion
+static const float FRUSTUM_MARGIN = 0.1f;
+
+// find which sides of the view frustum each vertex is outside of, in the camera frame
+// projector: the projector with the intrinsics
+// size: the size of the frame
+// X, Y, Z: the coordinates of the vertices in the camera frame
+// count: the number of vertices
+// outcodes: the sides of the frustum each vertex is outside of
+void compute_outcodes(const Projector &projector, cv::Size size, const float *X, const float *Y, const float *Z,
+                      int count, unsigned char *outcodes)
+{
+  cv::Vec4f k = projector.intrinsics();
+  float marginX = FRUSTUM_MARGIN * size.width;
+  float marginY = FRUSTUM_MARGIN * size.height;
+
+  // u = fx * X / Z + cx is left of -marginX when fx * X + (cx + marginX) * Z < 0, and so on for the other sides
+  float left = k[2] + marginX;
+  float right = k[2] - size.width - marginX;
+  float top = k[3] + marginY;
+  float bottom = k[3] - size.height - marginY;
+  for (int i = 0; i < count; i++)
+  {
+    unsigned char code = 0;
+    code |= (k[0] * X[i] + left * Z[i] < 0) ? OUTSIDE_LEFT : 0;
+    code |= (k[0] * X[i] + right * Z[i] > 0) ? OUTSIDE_RIGHT : 0;
+    code |= (k[1] * Y[i] + top * Z[i] < 0) ? OUTSIDE_TOP : 0;
+    code |= (k[1] * Y[i] + bottom * Z[i] > 0) ? OUTSIDE_BOTTOM : 0;
+    code |= (Z[i] < NEAR_PLANE) ? OUTSIDE_NEAR : 0;
+    outcodes[i] = code;
+  }
+}
+
+// find the planes of the view frustum in the frame of the object, the same planes as compute_outcodes
+// a point p of the object is inside a plane (n, d) when n . p + d >= 0
+// projector: the projector with the intrinsics
 // rvec: the rotation vector
 // tvec: the translation vector
-// vertices: the vertices of the object
-// faces: the faces of the object
+// size: the size of the frame
+// planes: the left, right, top, bottom and near planes
+void frustum_planes(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, cv::Size size,
+                    cv::Vec4d planes[5])
+{
+  cv::Vec4f k = projector.intrinsics();
+  double marginX = FRUSTUM_MARGIN * size.width;
+  double marginY = FRUSTUM_MARGIN * size.height;
+  cv::Vec4d camera[5] = {cv::Vec4d(k[0], 0, k[2] + marginX, 0),
+                         cv::Vec4d(-k[0], 0, size.width + marginX - k[2], 0),
+                         cv::Vec4d(0, k[1], k[3] + marginY, 0),
+                         cv::Vec4d(0, -k[1], size.height + marginY - k[3], 0),
+                         cv::Vec4d(0, 0, 1, -NEAR_PLANE)};
+
+  // with X = R p + t, n . X + d = (R^T n) . p + (n . t + d)
+  cv::Matx33d rotation;
+  cv::Rodrigues(rvec, rotation);
+  for (int i = 0; i < 5; i++)
+  {
+    cv::Vec3d n(camera[i][0], camera[i][1], camera[i][2]);
+    cv::Vec3d objectNormal = rotation.t() * n;
+    planes[i] = cv::Vec4d(objectNormal[0], objectNormal[1], objectNormal[2], n.dot(tvec) + camera[i][3]);
+  }
+}
+
+// add a range of triangles, merging it with the last one when they touch
+// ranges: the ranges as start and count
+// start: the first triangle
+// count: the number of triangles
+static void add_face_range(std::vector<cv::Vec2i> &ranges, int start, int count)
+{
+  if (!ranges.empty() && ranges.back()[0] + ranges.back()[1] == start)
+  {
+    ranges.back()[1] += count;
+  }
+  else
+  {
+    ranges.push_back(cv::Vec2i(start, count));
+  }
+}
+
+// find the triangles of a mesh that may be inside the view frustum with its bounding volume hierarchy,
+// rejecting and accepting whole subtrees whose bounding boxes are outside or inside the frustum
+// mesh: the mesh with a hierarchy
+// planes: the planes of the frustum in the frame of the object
+// ranges: the ranges of triangles as start and count that may be visible
+// return: the number of triangles in the ranges
+static int cull_bvh(const Mesh &mesh, const cv::Vec4d planes[5], std::vector<cv::Vec2i> &ranges)
+{
+  ranges.clear();
+  int visible = 0;
+
+  // the nodes left to visit, the hierarchy is about as deep as the log of the number of leaves
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0)
+  {
+    int index = stack[--top];
+    const BvhNode &node = mesh.bvh[index];
+
+    // the corner of the box furthest inside a plane decides whether the box is outside it,
+    // and the corner furthest outside whether the box is inside it
+    bool outside = false, inside = true;
+    for (int i = 0; i < 5 && !outside; i++)
+    {
+      double highest = planes[i][3], lowest = planes[i][3];
+      for (int k = 0; k < 3; k++)
+      {
+        highest += planes[i][k] * (planes[i][k] > 0 ? node.high[k] : node.low[k]);
+        lowest += planes[i][k] * (planes[i][k] > 0 ? node.low[k] : node.high[k]);
+      }
+      outside = highest < 0;
+      inside = inside && lowest >= 0;
+    }
+    if (outside)
+    {
+      continue;
+    }
+
+    // a subtree inside the frustum is kept whole, and so is a node too deep for the stack
+    if (inside || node.right == 0 || top + 2 > 64)
+    {
+      add_face_range(ranges, node.start, node.count);
+      visible += node.count;
+    }
+    else
+    {
+      // visit the left child first, so that the ranges come out in order and merge
+      stack[top++] = node.right;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return (visible);
+}
+
+// transform the vertices of a mesh to the camera frame, project them to the image plane,
+// and find which sides of the view frustum they are outside of
+// with a bounding volume hierarchy, the triangles outside the frustum are culled first, and when they are most
+// of the mesh, only the vertices of the remaining triangles are transformed, so the cost follows what is visible
+// projector: projects points with the camera matrix and distortion coefficients
+// rvec: the rotation vector
+// tvec: the translation vector
+// mesh: the mesh
+// size: the size of the frame
+// buffers: the buffers to fill in, they keep their capacity between frames
+// return: 0 if successful, -1 if error
+int transform_vertices(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Mesh &mesh, cv::Size size, RenderBuffers &buffers)
+{
+  ScopedTimer timer(PROFILE_PROJECT);
+
+  // check if the vertices are empty
+  if (mesh.vertexCount() == 0)
+  {
+    printf("error: vertices are empty.\n");
+    return (-1);
+  }
+
+  // size the buffers
+  int vertexCount = mesh.vertexCount();
+  buffers.imagePoints.resize(vertexCount);
+  buffers.cameraX.resize(vertexCount);
+  buffers.cameraY.resize(vertexCount);
+  buffers.cameraZ.resize(vertexCount);
+  buffers.outcodes.resize(vertexCount);
+
+  // find the triangles that may be visible
+  int visible = mesh.faceCount();
+  if (mesh.bvh != NULL)
+  {
+    cv::Vec4d planes[5];
+    frustum_planes(projector, rvec, tvec, size, planes);
+    visible = cull_bvh(mesh, planes, buffers.faceRanges);
+  }
+  else
+  {
+    buffers.faceRanges.assign(1, cv::Vec2i(0, mesh.faceCount()));
+  }
+
+  // when most of the mesh is visible, transform all vertices in one pass, which beats gathering them
+  if (visible * 2 > mesh.faceCount())
+  {
+    projector.project(rvec, tvec, &mesh.x[0], &mesh.y[0], &mesh.z[0], vertexCount, &buffers.imagePoints[0],
+                      &buffers.cameraX[0], &buffers.cameraY[0], &buffers.cameraZ[0]);
+    compute_outcodes(projector, size, &buffers.cameraX[0], &buffers.cameraY[0], &buffers.cameraZ[0], vertexCount,
+                     &buffers.outcodes[0]);
+    return (0);
+  }
+
+  // start a new vertex stamp, clearing the stamps when the counter wraps around
+  buffers.vertexStamps.resize(vertexCount, 0);
+  if (++buffers.vertexStamp == 0)
+  {
+    std::fill(buffers.vertexStamps.begin(), buffers.vertexStamps.end(), 0);
+    buffers.vertexStamp = 1;
+  }
+
+  // gather the vertices of the remaining triangles once each
+  buffers.vertexList.clear();
+  for (size_t r = 0; r < buffers.faceRanges.size(); r++)
+  {
+    const int *indices = &mesh.indices[buffers.faceRanges[r][0] * 3];
+    for (int i = 0; i < buffers.faceRanges[r][1] * 3; i++)
+    {
+      if (buffers.vertexStamps[indices[i]] != buffers.vertexStamp)
+      {
+        buffers.vertexStamps[indices[i]] = buffers.vertexStamp;
+        buffers.vertexList.push_back(indices[i]);
+      }
+    }
+  }
+  int count = (int)buffers.vertexList.size();
+  if (count == 0)
+  {
+    return (0);
+  }
+  buffers.gatherX.resize(count);
+  buffers.gatherY.resize(count);
+  buffers.gatherZ.resize(count);
+  buffers.gatherPoints.resize(count);
+  buffers.gatherCameraX.resize(count);
+  buffers.gatherCameraY.resize(count);
+  buffers.gatherCameraZ.resize(count);
+  buffers.gatherOutcodes.resize(count);
+  for (int i = 0; i < count; i++)
+  {
+    int v = buffers.vertexList[i];
+    buffers.gatherX[i] = mesh.x[v];
+    buffers.gatherY[i] = mesh.y[v];
+    buffers.gatherZ[i] = mesh.z[v];
+  }
+
+  // transform and project them, then scatter the results back to the vertices
+  projector.project(rvec, tvec, &buffers.gatherX[0], &buffers.gatherY[0], &buffers.gatherZ[0], count,
+                    &buffers.gatherPoints[0], &buffers.gatherCameraX[0], &buffers.gatherCameraY[0],
+                    &buffers.gatherCameraZ[0]);
+  compute_outcodes(projector, size, &buffers.gatherCameraX[0], &buffers.gatherCameraY[0], &buffers.gatherCameraZ[0],
+                   count, &buffers.gatherOutcodes[0]);
+  for (int i = 0; i < count; i++)
+  {
+    int v = buffers.vertexList[i];
+    buffers.imagePoints[v] = buffers.gatherPoints[i];
+    buffers.cameraX[v] = buffers.gatherCameraX[i];
+    buffers.cameraY[v] = buffers.gatherCameraY[i];
+    buffers.cameraZ[v] = buffers.gatherCameraZ[i];
+    buffers.outcodes[v] = buffers.gatherOutcodes[i];
+  }
+
+  return (0);
+}
+
+// check whether a face of a mesh is visible, after transform_vertices
+// the face is hidden if it is entirely outside one side of the view frustum, reaches behind the near plane,
+// or points away from the camera, which looks at it from the origin
+// mesh: the mesh
+// buffers: the buffers filled in by transform_vertices
+// face: the index of the face
+// base: the index of the first vertex of the mesh in the buffers, when they hold several meshes
+// return: true if the face is visible
+bool face_visible(const Mesh &mesh, const RenderBuffers &buffers, int face, int base)
+{
+  const int *indices = &mesh.indices[face * 3];
+  int a = base + indices[0], b = base + indices[1], c = base + indices[2];
+  const unsigned char *outcodes = &buffers.outcodes[0];
+  if ((outcodes[a] & outcodes[b] & outcodes[c]) != 0 || ((outcodes[a] | outcodes[b] | outcodes[c]) & OUTSIDE_NEAR) != 0)
+  {
+    return (false);
+  }
+
+  if (mesh.orientation != 0)
+  {
+    const float *X = &buffers.cameraX[0];
+    const float *Y = &buffers.cameraY[0];
+    const float *Z = &buffers.cameraZ[0];
+    float ux = X[b] - X[a], uy = Y[b] - Y[a], uz = Z[b] - Z[a];
+    float vx = X[c] - X[a], vy = Y[c] - Y[a], vz = Z[c] - Z[a];
+    float nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+    if (mesh.orientation * (nx * X[a] + ny * Y[a] + nz * Z[a]) >= 0)
+    {
+      return (false);
+    }
+  }
+
+  return (true);
+}
+
+// draw the edges of the visible faces of a mesh whose vertices were transformed by transform_vertices or alike,
+// every edge once
+// mesh: the vertices, faces and edges of the object
+// ranges: the ranges of faces to draw as start and count
+// base: the index of the first vertex of the mesh in the buffers, when they hold several meshes
+// buffers: the buffers with the transformed vertices, and the edge stamps
 // frame: the frame to draw on
 // return: 0 if successful, -1 if error
-int draw_object(cv::Mat cameraMatrix, cv::Mat distCoeffs, cv::Vec3d rvec, cv::Vec3d tvec, std::vector<cv::Point3f> vertices, std::vector<std::vector<int>> faces, cv::Mat &frame)
+int draw_wireframe(const Mesh &mesh, const std::vector<cv::Vec2i> &ranges, int base, RenderBuffers &buffers, cv::Mat &frame)
 {
-  // check if the camera matrix, distortion coefficients, vertices, faces, and frame are empty
-  if (cameraMatrix.empty() || distCoeffs.empty() || vertices.empty() || faces.empty() || frame.empty())
+  // error checking
+  if (mesh.faceEdges == NULL)
   {
-    printf("error: camera matrix, distortion coefficients, vertices, faces, or frame is empty.\n");
+    printf("error: mesh has no edges.\n");
     return (-1);
   }
 
-  // project the vertices to the image plane
-  std::vector<cv::Point2f> imagePoints;
-  cv::projectPoints(vertices, rvec, tvec, cameraMatrix, distCoeffs, imagePoints);
+  // start a new stamp, clearing the stamps when the counter wraps around
+  buffers.edgeStamps.resize(mesh.edgeCount(), 0);
+  if (++buffers.stamp == 0)
+  {
+    std::fill(buffers.edgeStamps.begin(), buffers.edgeStamps.end(), 0);
+    buffers.stamp = 1;
+  }
 
-  // draw the faces of the object
-  for (int i = 0; i < faces.size(); i++)
+  // draw the faces of the object in the ranges
+  const std::vector<cv::Point2f> &imagePoints = buffers.imagePoints;
+  for (size_t r = 0; r < ranges.size(); r++)
   {
-    // map the z coordinate of the face to a color
-    float z = (vertices[faces[i][0]].z + vertices[faces[i][1]].z + vertices[faces[i][2]].z) / 3;
-    int color = (int)(z / 3.5 * 155) + 100;
-    cv::Scalar faceColor(color, color, color);
+    int end = ranges[r][0] + ranges[r][1];
+    for (int i = ranges[r][0]; i < end; i++)
+    {
+      // skip the faces that cannot be seen
+      if (!face_visible(mesh, buffers, i, base))
+      {
+        continue;
+      }
 
-    // draw the face
-    cv::line(frame, imagePoints[faces[i][0]], imagePoints[faces[i][1]], faceColor, 3);
-    cv::line(frame, imagePoints[faces[i][1]], imagePoints[faces[i][2]], faceColor, 3);
-    cv::line(frame, imagePoints[faces[i][2]], imagePoints[faces[i][0]], faceColor, 3);
+      // map the z coordinate of the face to a color
+      const int *face = &mesh.indices[i * 3];
+      float z = (mesh.z[face[0]] + mesh.z[face[1]] + mesh.z[face[2]]) / 3;
+      int color = (int)(z / 3.5 * 155) + 100;
+      cv::Scalar faceColor(color, color, color);
+
+      // draw the edges of the face that no visible face has drawn yet
+      for (int j = 0; j < 3; j++)
+      {
+        int edge = mesh.faceEdges[i * 3 + j];
+        if (buffers.edgeStamps[edge] == buffers.stamp)
+        {
+          continue;
+        }
+        buffers.edgeStamps[edge] = buffers.stamp;
+        cv::line(frame, imagePoints[base + mesh.edges[edge * 2]], imagePoints[base + mesh.edges[edge * 2 + 1]], faceColor, 3);
+      }
+    }
   }
 
   return (0);
-}
\ No newline at end of file
+}
+
+// draw the object on the frame
+// only the triangles facing the camera and inside the view frustum are drawn, and every edge is drawn once
+// projector: projects points with the camera matrix and distortion coefficients
+// rvec: the rotation vector
+// tvec: the translation vector
+// mesh: the vertices and faces of the object
+// buffers: the buffers reused between frames
+// frame: the frame to draw on
+// return: 0 if successful, -1 if error
+int draw_object(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Mesh &mesh, RenderBuffers &buffers, cv::Mat &frame)
+{
+  // check if the vertices, faces, and frame are empty
+  if (mesh.vertexCount() == 0 || mesh.faceCount() == 0 || frame.empty())
+  {
+    printf("error: vertices, faces, or frame is empty.\n");
+    return (-1);
+  }
+
+  // error checking
+  if (mesh.faceEdges == NULL)
+  {
+    printf("error: mesh has no edges.\n");
+    return (-1);
+  }
+
+  // transform and project the vertices, then draw the faces of the object that the hierarchy did not cull
+  transform_vertices(projector, rvec, tvec, mesh, frame.size(), buffers);
+  draw_wireframe(mesh, buffers.faceRanges, 0, buffers, frame);
+
+  return (0);
+}
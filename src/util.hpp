@@ -7,11 +7,18 @@
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
+#include "mesh.hpp"
+#include "projection.hpp"
 
 std::string get_image_name(std::string foldername, std::string imageType);
 int print_mat(cv::Mat mat);
 int mat_to_vector(cv::Mat cameraMatrix, cv::Mat distCoeffs, std::vector<double> &vec);
 int vector_to_mat(std::vector<double> vec, cv::Mat &cameraMatrix, cv::Mat &distCoeffs);
-int read_object_data(std::string filename, std::vector<cv::Point3f> &vertices, std::vector<std::vector<int>> &faces);
-int draw_corners(cv::Mat cameraMatrix, cv::Mat distCoeffs, cv::Vec3d rvec, cv::Vec3d tvec, cv::Mat &frame);
-int draw_object(cv::Mat cameraMatrix, cv::Mat distCoeffs, cv::Vec3d rvec, cv::Vec3d tvec, std::vector<cv::Point3f> vertices, std::vector<std::vector<int>> faces, cv::Mat &frame);
+int read_object_data(std::string filename, Mesh &mesh, bool useCache = true);
+int draw_corners(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, cv::Mat &frame);
+void compute_outcodes(const Projector &projector, cv::Size size, const float *X, const float *Y, const float *Z, int count, unsigned char *outcodes);
+void frustum_planes(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, cv::Size size, cv::Vec4d planes[5]);
+int transform_vertices(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Mesh &mesh, cv::Size size, RenderBuffers &buffers);
+bool face_visible(const Mesh &mesh, const RenderBuffers &buffers, int face, int base = 0);
+int draw_wireframe(const Mesh &mesh, const std::vector<cv::Vec2i> &ranges, int base, RenderBuffers &buffers, cv::Mat &frame);
+int draw_object(const Projector &projector, const cv::Vec3d &rvec, const cv::Vec3d &tvec, const Mesh &mesh, RenderBuffers &buffers, cv::Mat &frame);